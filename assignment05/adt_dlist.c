@@ -2,6 +2,19 @@
 
 #include "adt_dlist.h"
 
+// number of nodes the iterator prefetches ahead of the consumer
+#define LIST_PREFETCH	4
+
+#define prefetch(p)	__builtin_prefetch(p)
+
+// operation counters (see LIST_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(pList, field, n)	((pList)->stats.field += (n))
+#define STAT_PEAK(pList)			do { if ((pList)->count > (pList)->stats.peak) (pList)->stats.peak = (pList)->count; } while (0)
+#else
+#define STAT_ADD(pList, field, n)	((void)(pList))
+#define STAT_PEAK(pList)			((void)(pList))
+#endif
 
 
 // internal insert function
@@ -13,6 +26,7 @@ static int _insert( LIST *pList, NODE *pPre, void *dataInPtr){ //here is the pro
     NODE * newNode = malloc(sizeof(NODE));
     if(newNode == NULL)
         return 0;
+    STAT_ADD(pList, allocs, 1);
     newNode->dataPtr = dataInPtr;
     newNode->rlink = NULL;
     newNode->llink = NULL;
@@ -45,6 +59,7 @@ static int _insert( LIST *pList, NODE *pPre, void *dataInPtr){ //here is the pro
         pPre->rlink = newNode;
     }
     pList->count++;
+    STAT_PEAK(pList);
     return 1;
 }
 
@@ -86,9 +101,11 @@ static int _search( LIST *pList, NODE **pPre, NODE **pLoc, void *pArgu) {
     int result;
     while (*pLoc != NULL) {
         result = pList->compare((*pLoc)->dataPtr, pArgu); //need to be fixed
+        STAT_ADD(pList, compares, 1);
         if (result < 0) {
             *pPre = *pLoc;
             *pLoc = (*pLoc)->rlink;
+            STAT_ADD(pList, hops, 1);
         }else break;
     }
     if(result == 0){
@@ -111,6 +128,9 @@ LIST *createList( int (*compare)(const void *, const void *)){
     nList->rear = NULL;
     nList->count = 0;
     nList->compare = (*compare);
+#ifdef ADT_STATS
+    nList->stats = (LIST_STATS){0};
+#endif
     return nList;
 }
 
@@ -137,6 +157,7 @@ int addNode( LIST *pList, void *dataInPtr, void (*callback)(const void *)){
     NODE * newNode = malloc(sizeof(NODE));
     if(newNode == NULL)
         return 0;
+    STAT_ADD(pList, allocs, 1);
     newNode->rlink = NULL;
     newNode->llink = NULL;
     newNode->dataPtr = dataInPtr;
@@ -210,6 +231,7 @@ void traverseList( LIST *pList, void (*callback)(const void *)){
     while(pPre != NULL){
         callback(pPre->dataPtr);
         pPre = pPre->rlink;
+        STAT_ADD(pList, hops, 1);
     }
 }
 
@@ -219,8 +241,82 @@ void traverseListR( LIST *pList, void (*callback)(const void *)){
     while(pPre != NULL){
         callback(pPre->dataPtr);
         pPre = pPre->llink;
+        STAT_ADD(pList, hops, 1);
     }
 }
 
+// returns operation counters of the list
+// all zero if not compiled with -DADT_STATS
+LIST_STATS statsList( LIST *pList){
+#ifdef ADT_STATS
+    return pList->stats;
+#else
+    (void)pList;
+    return (LIST_STATS){0};
+#endif
+}
+
+// internal function
+// points pAhead LIST_PREFETCH nodes ahead of pNext, prefetching on the way
+// used in beginList, seekList
+static void _prime( LIST_ITER *pIter){
+    NODE *pNode = pIter->pNext;
+    for(int i = 0; i < LIST_PREFETCH && pNode != NULL; i++){
+        prefetch(pNode->dataPtr);
+        pNode = pNode->rlink;
+        if(pNode != NULL) prefetch(pNode);
+    }
+    pIter->pAhead = pNode;
+}
+
+// positions the iterator before the first node
+void beginList( LIST *pList, LIST_ITER *pIter){
+    pIter->pList = pList;
+    pIter->pNext = pList->head;
+    _prime(pIter);
+}
+
+// positions the iterator after the last node (for prevList)
+void endList( LIST *pList, LIST_ITER *pIter){
+    pIter->pList = pList;
+    pIter->pNext = NULL;
+    pIter->pAhead = NULL;
+    if(pList->rear != NULL) prefetch(pList->rear->dataPtr);
+}
 
+// positions the iterator before the first node whose data is not less than pArgu
+void seekList( LIST *pList, LIST_ITER *pIter, void *pArgu){
+    NODE *pPre, *pLoc;
+    _search(pList, &pPre, &pLoc, pArgu);
+    pIter->pList = pList;
+    pIter->pNext = pLoc;
+    _prime(pIter);
+}
 
+// returns data after the cursor and moves the cursor forward
+//			NULL if at the end
+void *nextList( LIST_ITER *pIter){
+    NODE *pNode = pIter->pNext;
+    if(pNode == NULL) return NULL;
+
+    pIter->pNext = pNode->rlink;
+    if(pIter->pAhead != NULL){
+        // pAhead was prefetched one step earlier; reading its link does not stall
+        prefetch(pIter->pAhead->dataPtr);
+        pIter->pAhead = pIter->pAhead->rlink;
+        if(pIter->pAhead != NULL) prefetch(pIter->pAhead);
+    }
+    return pNode->dataPtr;
+}
+
+// returns data before the cursor and moves the cursor backward
+//			NULL if at the beginning
+void *prevList( LIST_ITER *pIter){
+    NODE *pNode = (pIter->pNext != NULL) ? pIter->pNext->llink : pIter->pList->rear;
+    if(pNode == NULL) return NULL;
+
+    pIter->pNext = pNode;
+    pIter->pAhead = NULL; // forward prefetching stops once the direction changes
+    if(pNode->llink != NULL) prefetch(pNode->llink);
+    return pNode->dataPtr;
+}
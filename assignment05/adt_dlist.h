@@ -9,14 +9,36 @@ typedef struct node
 	struct node	*rlink;
 } NODE;
 
+// operation counters (compiled in only with -DADT_STATS)
+typedef struct
+{
+	long	compares;	// comparator calls
+	long	hops;		// pointer hops (rlink/llink followed)
+	long	allocs;		// node allocations
+	int		peak;		// peak node count
+} LIST_STATS;
+
 typedef struct
 {
 	int		count;
 	NODE	*head;
 	NODE	*rear;
 	int		(*compare)(const void *, const void *); // used in _search function
+#ifdef ADT_STATS
+	LIST_STATS	stats;
+#endif
 } LIST;
 
+// external iterator
+// the cursor sits between two nodes; nextList/prevList return the data after/before it
+// any addNode/removeNode invalidates the iterator
+typedef struct
+{
+	LIST	*pList;
+	NODE	*pNext;		// node after the cursor, NULL if at the end
+	NODE	*pAhead;	// prefetch cursor, a few nodes ahead of pNext
+} LIST_ITER;
+
 ////////////////////////////////////////////////////////////////////////////////
 // function declarations
 
@@ -59,3 +81,24 @@ void traverseList( LIST *pList, void (*callback)(const void *));
 
 // traverses data from list (backward)
 void traverseListR( LIST *pList, void (*callback)(const void *));
+
+// returns operation counters of the list
+// all zero if not compiled with -DADT_STATS
+LIST_STATS statsList( LIST *pList);
+
+// positions the iterator before the first node
+void beginList( LIST *pList, LIST_ITER *pIter);
+
+// positions the iterator after the last node (for prevList)
+void endList( LIST *pList, LIST_ITER *pIter);
+
+// positions the iterator before the first node whose data is not less than pArgu
+void seekList( LIST *pList, LIST_ITER *pIter, void *pArgu);
+
+// returns data after the cursor and moves the cursor forward
+//			NULL if at the end
+void *nextList( LIST_ITER *pIter);
+
+// returns data before the cursor and moves the cursor backward
+//			NULL if at the beginning
+void *prevList( LIST_ITER *pIter);
@@ -0,0 +1,204 @@
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Type-specialized doubly linked list
+//
+// DEFINE_DLIST( name, T, cmp) generates the adt_dlist API for element type T
+// with the data stored inline in each node and a comparator that is known at
+// compile time, so the compiler can inline it into the search loop.
+//	name	prefix of the generated types and functions (name_LIST, name_addNode, ...)
+//	T		element type (copied by value into the node); a key held in T itself, e.g. a
+//			char array, is compared without leaving the node
+//	cmp		int cmp( const T *, const T *); function or macro, ordered like strcmp
+//
+// ex)	typedef struct { char word[20]; int freq; } tWordInline;
+//		static inline int word_cmp( const tWordInline *a, const tWordInline *b) { return strcmp( a->word, b->word); }
+//		DEFINE_DLIST( word, tWordInline, word_cmp)
+//
+//		word_LIST *list = word_createList();
+//		word_addNode( list, &w, increase_freq);
+
+#include <stdlib.h> // malloc, free
+
+#define DEFINE_DLIST(name, T, cmp)																\
+																								\
+typedef struct name##_node																		\
+{																								\
+	T					data;																	\
+	struct name##_node	*llink;																	\
+	struct name##_node	*rlink;																	\
+} name##_NODE;																					\
+																								\
+typedef struct																					\
+{																								\
+	int			count;																			\
+	name##_NODE	*head;																			\
+	name##_NODE	*rear;																			\
+} name##_LIST;																					\
+																								\
+/* external iterator; any addNode/removeNode invalidates it									\
+*/																								\
+typedef struct																					\
+{																								\
+	name##_NODE	*pNext;		/* node after the cursor, NULL if at the end */					\
+} name##_ITER;																					\
+																								\
+/* internal search function																		\
+	return	1 found																				\
+			0 not found (pPre is the logical predecessor)										\
+*/																								\
+static inline int name##__search( name##_LIST *pList, name##_NODE **pPre, name##_NODE **pLoc, const T *pArgu)	\
+{																								\
+	name##_NODE *pre = NULL;																	\
+	name##_NODE *loc = pList->head;																\
+	int result = -1;																			\
+																								\
+	while (loc != NULL && (result = cmp( &loc->data, pArgu)) < 0)								\
+	{																							\
+		pre = loc;																				\
+		loc = loc->rlink;																		\
+	}																							\
+	*pPre = pre;																				\
+	*pLoc = loc;																				\
+	return loc != NULL && result == 0;															\
+}																								\
+																								\
+/* Allocates dynamic memory for a list head node													\
+	return	head node pointer																	\
+			NULL if overflow																	\
+*/																								\
+static inline name##_LIST *name##_createList( void)											\
+{																								\
+	name##_LIST *pList = malloc( sizeof( name##_LIST));										\
+	if (pList == NULL) return NULL;																\
+	pList->count = 0;																			\
+	pList->head = NULL;																			\
+	pList->rear = NULL;																			\
+	return pList;																				\
+}																								\
+																								\
+/* frees all nodes and the head node; callback (may be NULL) releases each element			\
+*/																								\
+static inline void name##_destroyList( name##_LIST *pList, void (*callback)(T *))				\
+{																								\
+	name##_NODE *pNode = pList->head;															\
+	while (pNode != NULL)																		\
+	{																							\
+		name##_NODE *tmp = pNode;																\
+		if (callback) callback( &pNode->data);													\
+		pNode = pNode->rlink;																	\
+		free( tmp);																				\
+	}																							\
+	free( pList);																				\
+}																								\
+																								\
+/* Inserts a copy of *dataInPtr into list														\
+	callback is called with the stored element when the key already exists					\
+	return	0 if overflow																		\
+			1 if successful																		\
+			2 if duplicated key																	\
+*/																								\
+static inline int name##_addNode( name##_LIST *pList, const T *dataInPtr, void (*callback)(T *))	\
+{																								\
+	name##_NODE *pPre, *pLoc;																	\
+																								\
+	if (name##__search( pList, &pPre, &pLoc, dataInPtr))										\
+	{																							\
+		if (callback) callback( &pLoc->data);													\
+		return 2;																				\
+	}																							\
+																								\
+	name##_NODE *newNode = malloc( sizeof( name##_NODE));										\
+	if (newNode == NULL) return 0;																\
+	newNode->data = *dataInPtr;																	\
+	newNode->llink = pPre;																		\
+	newNode->rlink = pLoc;																		\
+																								\
+	if (pPre == NULL) pList->head = newNode;													\
+	else pPre->rlink = newNode;																	\
+	if (pLoc == NULL) pList->rear = newNode;													\
+	else pLoc->llink = newNode;																	\
+																								\
+	pList->count++;																				\
+	return 1;																					\
+}																								\
+																								\
+/* Removes data from list and copies the removed element to *dataOutPtr						\
+	return	0 not found																			\
+			1 deleted																			\
+*/																								\
+static inline int name##_removeNode( name##_LIST *pList, const T *keyPtr, T *dataOutPtr)		\
+{																								\
+	name##_NODE *pPre, *pLoc;																	\
+																								\
+	if (!name##__search( pList, &pPre, &pLoc, keyPtr)) return 0;								\
+																								\
+	if (pPre == NULL) pList->head = pLoc->rlink;												\
+	else pPre->rlink = pLoc->rlink;																\
+	if (pLoc->rlink == NULL) pList->rear = pPre;												\
+	else pLoc->rlink->llink = pPre;																\
+																								\
+	*dataOutPtr = pLoc->data;																	\
+	free( pLoc);																				\
+	pList->count--;																				\
+	return 1;																					\
+}																								\
+																								\
+/* dataOutPtr points to the stored element																\
+	return	1 successful																		\
+			0 not found																			\
+*/																								\
+static inline int name##_searchNode( name##_LIST *pList, const T *pArgu, T **dataOutPtr)		\
+{																								\
+	name##_NODE *pPre, *pLoc;																	\
+																								\
+	if (!name##__search( pList, &pPre, &pLoc, pArgu)) return 0;								\
+	*dataOutPtr = &pLoc->data;																	\
+	return 1;																					\
+}																								\
+																								\
+static inline int name##_countList( name##_LIST *pList)										\
+{																								\
+	return pList->count;																		\
+}																								\
+																								\
+static inline int name##_emptyList( name##_LIST *pList)										\
+{																								\
+	return pList->count == 0;																	\
+}																								\
+																								\
+/* traverses data from list (forward)															\
+*/																								\
+static inline void name##_traverseList( name##_LIST *pList, void (*callback)(const T *))		\
+{																								\
+	for (name##_NODE *pNode = pList->head; pNode != NULL; pNode = pNode->rlink)					\
+		callback( &pNode->data);																\
+}																								\
+																								\
+/* traverses data from list (backward)															\
+*/																								\
+static inline void name##_traverseListR( name##_LIST *pList, void (*callback)(const T *))		\
+{																								\
+	for (name##_NODE *pNode = pList->rear; pNode != NULL; pNode = pNode->llink)					\
+		callback( &pNode->data);																\
+}																								\
+																								\
+/* positions the iterator before the first node whose data is not less than *pArgu			\
+*/																								\
+static inline void name##_seekList( name##_LIST *pList, name##_ITER *pIter, const T *pArgu)	\
+{																								\
+	name##_NODE *pPre, *pLoc;																	\
+	name##__search( pList, &pPre, &pLoc, pArgu);												\
+	pIter->pNext = pLoc;																		\
+}																								\
+																								\
+/* returns data after the cursor and moves the cursor forward									\
+			NULL if at the end																	\
+*/																								\
+static inline T *name##_nextList( name##_ITER *pIter)											\
+{																								\
+	name##_NODE *pNode = pIter->pNext;															\
+	if (pNode == NULL) return NULL;																\
+	pIter->pNext = pNode->rlink;																\
+	return &pNode->data;																		\
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc
+#include <string.h> // strdup, strcmp
+#include <time.h> // clock_gettime
+
+#include "adt_dlist.h"
+#include "adt_dlist_typed.h"
+
+// User structure type definition
+// 단어 구조체
+typedef struct {
+	char	*word;		// 단어
+	int		freq;		// 빈도
+} tWord;
+
+#define WORD_LEN	20 // bytes of a word in the typed list, as in word_count5 -t
+
+// 단어 구조체 of the typed list: the word is held in the node
+typedef struct {
+	char	word[WORD_LEN];	// 단어
+	int		freq;			// 빈도
+} tWordInline;
+
+////////////////////////////////////////////////////////////////////////////////
+// generic list (adt_dlist.c) callbacks, same as word_count5
+int compare_by_word( const void *n1, const void *n2)
+{
+	return strcmp( ((tWord *)n1)->word, ((tWord *)n2)->word);
+}
+
+void increase_freq(const void *dataPtr)
+{
+	((tWord *)dataPtr)->freq++;
+}
+
+tWord *createWord( char *word)
+{
+	tWord *newWord = malloc( sizeof( tWord));
+
+	if (newWord == NULL) return NULL;
+
+	newWord->word = strdup( word);
+	newWord->freq = 1;
+
+	return newWord;
+}
+
+void destroyWord( void *pWord)
+{
+	free( ((tWord *)pWord)->word);
+	free( pWord);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// typed list (adt_dlist_typed.h) with an inlined comparator and inline keys
+static inline int word_cmp( const tWordInline *p1, const tWordInline *p2)
+{
+	return strcmp( p1->word, p2->word);
+}
+
+DEFINE_DLIST( word, tWordInline, word_cmp)
+
+void increase_freq_typed( tWordInline *pWord)
+{
+	pWord->freq++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static double now( void)
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// builds both lists from FILE and searches every token again
+// prints elapsed time of each phase
+int main( int argc, char **argv)
+{
+	char **tokens;
+	int num_tokens = 0, capacity = 1024;
+	char word[100];
+	FILE *fp;
+	double t0, t_build, t_search;
+	long found;
+
+	if (argc != 2) {
+		fprintf( stderr, "usage: %s FILE\n", argv[0]);
+		return 1;
+	}
+
+	fp = fopen( argv[1], "rt");
+	if (!fp)
+	{
+		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
+		return 2;
+	}
+
+	tokens = malloc( sizeof( char *) * capacity);
+	while (fscanf( fp, "%99s", word) != EOF)
+	{
+		if (strlen( word) >= WORD_LEN) continue; // does not fit the typed list
+
+		if (num_tokens == capacity)
+		{
+			capacity *= 2;
+			tokens = realloc( tokens, sizeof( char *) * capacity);
+		}
+		tokens[num_tokens++] = strdup( word);
+	}
+	fclose( fp);
+
+	// generic list
+	LIST *list = createList( compare_by_word);
+
+	t0 = now();
+	for (int i = 0; i < num_tokens; i++)
+	{
+		tWord *pWord = createWord( tokens[i]);
+		int ret = addNode( list, pWord, increase_freq);
+		if (ret == 0 || ret == 2) destroyWord( pWord);
+	}
+	t_build = now() - t0;
+
+	t0 = now();
+	found = 0;
+	for (int i = 0; i < num_tokens; i++)
+	{
+		tWord key = { tokens[i], 0};
+		void *ptr;
+		found += searchNode( list, &key, &ptr);
+	}
+	t_search = now() - t0;
+
+	printf( "generic\tcount=%d\tbuild %.3f s\tsearch %.3f s (%ld found)\n", countList( list), t_build, t_search, found);
+	destroyList( list, destroyWord);
+
+	// typed list
+	word_LIST *tlist = word_createList();
+
+	t0 = now();
+	for (int i = 0; i < num_tokens; i++)
+	{
+		tWordInline w = { "", 1};
+		strcpy( w.word, tokens[i]);
+		word_addNode( tlist, &w, increase_freq_typed);
+	}
+	t_build = now() - t0;
+
+	t0 = now();
+	found = 0;
+	for (int i = 0; i < num_tokens; i++)
+	{
+		tWordInline key = { "", 0}, *ptr;
+		strcpy( key.word, tokens[i]);
+		found += word_searchNode( tlist, &key, &ptr);
+	}
+	t_search = now() - t0;
+
+	printf( "typed\tcount=%d\tbuild %.3f s\tsearch %.3f s (%ld found)\n", word_countList( tlist), t_build, t_search, found);
+	word_destroyList( tlist, NULL);
+
+	for (int i = 0; i < num_tokens; i++)
+		free( tokens[i]);
+	free( tokens);
+
+	return 0;
+}
@@ -4,6 +4,7 @@
 #include <ctype.h> // toupper
 
 #include "adt_dlist.h"
+#include "adt_dlist_typed.h"
 
 #define QUIT			1
 #define FORWARD_PRINT	2
@@ -11,6 +12,9 @@
 #define SEARCH			4
 #define DELETE			5
 #define COUNT			6
+#define RANGE_PRINT		7
+
+#define WORD_LEN		20 // bytes of a word (createWord allocates as many)
 
 // User structure type definition
 // 단어 구조체
@@ -19,6 +23,22 @@ typedef struct {
 	int		freq;		// 빈도
 } tWord;
 
+// 단어 구조체 (-t option): the word is held in the node of the typed list
+typedef struct {
+	char	word[WORD_LEN];	// 단어
+	int		freq;			// 빈도
+} tWordInline;
+
+// compares two words in inline word structures
+// for the typed list (-t option)
+static inline int compare_inline( const tWordInline *p1, const tWordInline *p2)
+{
+	return strcmp( p1->word, p2->word);
+}
+
+// typed list: ilist_createList, ilist_addNode, ...
+DEFINE_DLIST( ilist, tWordInline, compare_inline)
+
 ////////////////////////////////////////////////////////////////////////////////
 // 단어 구조체를 위한 메모리를 할당하고 word, freq 초기화
 // return	할당된 단어 구조체에 대한 pointer
@@ -50,6 +70,8 @@ int get_action()
 			return DELETE;
 		case 'C':
 			return COUNT;
+		case 'R':
+			return RANGE_PRINT;
 	}
 	return 0; // undefined action
 }
@@ -77,6 +99,28 @@ void increase_freq(const void *dataPtr)
 	((tWord *)dataPtr)->freq++;
 }
 
+// for the typed list (-t option)
+void print_word_inline( const tWordInline *pWord)
+{
+	printf( "%s\t%d\n", pWord->word, pWord->freq);
+}
+
+void increase_freq_inline( tWordInline *pWord)
+{
+	pWord->freq++;
+}
+
+// copies word into an inline word structure
+// return	0 if word does not fit (no word of the typed list is that long)
+int set_inline( tWordInline *pWord, const char *word)
+{
+	size_t len = strlen( word);
+	
+	if (len >= WORD_LEN) return 0;
+	memcpy( pWord->word, word, len + 1);
+	return 1;
+}
+
 // gets user's input
 void input_word(char *word)
 {
@@ -84,31 +128,69 @@ void input_word(char *word)
 	fscanf( stdin, "%s", word);
 }
 
+// gets user's input for range print
+void input_range(char *from, char *to)
+{
+	fprintf( stderr, "Input a range of words (from to): ");
+	fscanf( stdin, "%s %s", from, to);
+}
+
+// prints operation counters of the list in one line
+// for -s option
+void print_stats( LIST *list)
+{
+	LIST_STATS st = statsList( list);
+	
+	fprintf( stderr, "[stats] count=%d compares=%ld hops=%ld allocs=%ld peak=%d\n",
+		countList( list), st.compares, st.hops, st.allocs, st.peak);
+}
+
+// the typed list keeps no counters
+void print_stats_inline( ilist_LIST *ilist)
+{
+	fprintf( stderr, "[stats] count=%d (typed list, no counters)\n", ilist_countList( ilist));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 int main( int argc, char **argv)
 {
-	LIST *list;
+	LIST *list = NULL;
+	ilist_LIST *ilist = NULL;
 	
-	char word[100];
+	char word[100], word2[100];
 	tWord *pWord;
+	tWordInline key;
 	int ret;
 	FILE *fp;
+	char *filename = NULL;
+	int show_stats = 0;
+	int typed = 0;
 	
-	if (argc != 2) {
-		fprintf( stderr, "usage: %s FILE\n", argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp( argv[i], "-s") == 0) show_stats = 1;
+		else if (strcmp( argv[i], "-t") == 0) typed = 1;
+		else if (filename == NULL) filename = argv[i];
+		else { filename = NULL; break; } // too many files
+	}
+	
+	if (filename == NULL) {
+		fprintf( stderr, "usage: %s [-s] [-t] FILE\n", argv[0]);
+		fprintf( stderr, "  -t  typed list (adt_dlist_typed.h) with words held in its nodes\n");
 		return 1;
 	}
 	
-	fp = fopen( argv[1], "rt");
+	fp = fopen( filename, "rt");
 	if (!fp)
 	{
-		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
+		fprintf( stderr, "Error: cannot open file [%s]\n", filename);
 		return 2;
 	}
 	
 	// creates an empty list
-	list = createList( compare_by_word);
-	if (!list)
+	if (typed) ilist = ilist_createList();
+	else list = createList( compare_by_word);
+	if (!list && !ilist)
 	{
 		printf( "Cannot create list\n");
 		return 100;
@@ -116,6 +198,20 @@ int main( int argc, char **argv)
 	
 	while(fscanf( fp, "%s", word) != EOF)
 	{
+		if (typed)
+		{
+			if (!set_inline( &key, word))
+			{
+				fprintf( stderr, "Warning: %s is too long, skipped\n", word);
+				continue;
+			}
+			key.freq = 1;
+			
+			// 이미 저장된 단어는 빈도 증가
+			ilist_addNode( ilist, &key, increase_freq_inline);
+			continue;
+		}
+		
 		pWord = createWord( word);
 		
 		// 이미 저장된 단어는 빈도 증가
@@ -129,7 +225,13 @@ int main( int argc, char **argv)
 	
 	fclose( fp);
 	
-	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, S)earch, D)elete, C)ount: ");
+	if (show_stats)
+	{
+		if (typed) print_stats_inline( ilist);
+		else print_stats( list);
+	}
+	
+	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, S)earch, D)elete, C)ount: ");
 	
 	while (1)
 	{
@@ -139,20 +241,38 @@ int main( int argc, char **argv)
 		switch( action)
 		{
 			case QUIT:
+				if (typed)
+				{
+					if (show_stats) print_stats_inline( ilist);
+					ilist_destroyList( ilist, NULL);
+					return 0;
+				}
+				if (show_stats) print_stats( list);
 				destroyList( list, destroyWord);
 				return 0;
 			
 			case FORWARD_PRINT:
-				traverseList( list, print_word);
+				if (typed) ilist_traverseList( ilist, print_word_inline);
+				else traverseList( list, print_word);
 				break;
 			
 			case BACKWARD_PRINT:
-				traverseListR( list, print_word);
+				if (typed) ilist_traverseListR( ilist, print_word_inline);
+				else traverseListR( list, print_word);
 				break;
 			
 			case SEARCH:
 				input_word(word);
 				
+				if (typed)
+				{
+					tWordInline *pFound;
+					
+					if (set_inline( &key, word) && ilist_searchNode( ilist, &key, &pFound)) print_word_inline( pFound);
+					else fprintf( stdout, "%s not found\n", word);
+					break;
+				}
+				
 				pWord = createWord( word);
 
 				if (searchNode( list, pWord, &ptr)) print_word( ptr);
@@ -164,6 +284,16 @@ int main( int argc, char **argv)
 			case DELETE:
 				input_word(word);
 				
+				if (typed)
+				{
+					tWordInline removed;
+					
+					if (set_inline( &key, word) && ilist_removeNode( ilist, &key, &removed))
+						fprintf( stdout, "(%s, %d) deleted\n", removed.word, removed.freq);
+					else fprintf( stdout, "%s not found\n", word);
+					break;
+				}
+				
 				pWord = createWord( word);
 
 				if (removeNode( list, pWord, &ptr))
@@ -176,12 +306,41 @@ int main( int argc, char **argv)
 				destroyWord( (tWord *)pWord);
 				break;
 			
+			case RANGE_PRINT:
+				input_range( word, word2);
+				if (typed)
+				{
+					ilist_ITER it;
+					tWordInline *pData;
+					
+					// the bounds are compared as they are; the seek key is only cut to fit
+					if (!set_inline( &key, word))
+					{
+						memcpy( key.word, word, WORD_LEN - 1);
+						key.word[WORD_LEN - 1] = '\0';
+					}
+					ilist_seekList( ilist, &it, &key);
+					while ((pData = ilist_nextList( &it)) != NULL && strcmp( pData->word, word2) <= 0)
+						if (strcmp( pData->word, word) >= 0)
+							print_word_inline( pData);
+				}
+				else
+				{
+					tWord from = { word, 0}, to = { word2, 0};
+					LIST_ITER it;
+					
+					seekList( list, &it, &from);
+					while ((ptr = nextList( &it)) != NULL && compare_by_word( ptr, &to) <= 0)
+						print_word( ptr);
+				}
+				break;
+			
 			case COUNT:
-				fprintf( stdout, "%d\n", countList( list));
+				fprintf( stdout, "%d\n", typed ? ilist_countList( ilist) : countList( list));
 				break;
 		}
 		
-		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, S)earch, D)elete, C)ount: ");
+		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, S)earch, D)elete, C)ount: ");
 	}
 	return 0;
 }
@@ -0,0 +1,50 @@
+////////////////////////////////////////////////////////////////////////////////
+// fixture shared by the bench_* programs: word records as in word_count6, a clock,
+// random numbers and token input
+
+// User structure type definition
+// 단어 구조체
+typedef struct {
+	char	*word;		// 단어
+	int		freq;		// 빈도
+} tWord;
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototype declarations
+
+/* compares the words of two records (comparator of the trees)
+*/
+int compare_by_word( const void *n1, const void *n2);
+
+/* return	word of the record (key bytes of BST_Freeze)
+*/
+const char *word_key( const void *dataPtr);
+
+/* counts one more occurrence (callback of BST_Insert on a duplicated key)
+*/
+void increase_freq( void *dataPtr);
+
+/* Allocates a record of word with frequency 1
+	return	record pointer
+			NULL if overflow
+*/
+tWord *createWord( char *word);
+
+/* recycles memory of the record and its word
+*/
+void destroyWord( void *pWord);
+
+/* return	seconds of the monotonic clock
+*/
+double now( void);
+
+/* xorshift32 step
+	return	next random number of *seed (never 0 for a seed other than 0)
+*/
+unsigned int next_random( unsigned int *seed);
+
+/* reads all tokens of a file into *tokensOut (each one and the array to be freed)
+	return	number of tokens
+			-1 if the file cannot be opened
+*/
+int load_tokens( char *filename, char ***tokensOut);
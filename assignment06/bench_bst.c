@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, atoi
+#include <string.h> // strcmp, memcmp
+
+#include "bst.h"
+#include "bench.h"
+
+// balancing modes to compare
+static struct {
+	const char	*name;
+	int			mode;
+} modes[] = {
+	{ "plain",	BST_PLAIN},
+	{ "treap",	BST_TREAP},
+	{ "splay",	BST_SPLAY},
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// lookup throughput of BST_SearchBatch by batch size against BST_Search
+// the tree (mode BST_PLAIN or BST_TREAP) holds n random words (larger than the caches
+// for big n); q lookups of random words, half of them in the tree, are answered one at a
+// time and in batches of 1..1024
+// return	1 if a batch answers differently from BST_Search
+static int bench_batch( int n, int q, int mode)
+{
+	unsigned int seed = 2463534242u;
+	char word[32];
+	tWord **queries, **expected, **found;
+	TREE *tree;
+	double t0, single;
+	int failed = 0;
+
+	tree = BST_CreateMode( compare_by_word, mode);
+	while (BST_Count( tree) < n)
+	{
+		tWord *pWord;
+		sprintf( word, "w%09u", next_random( &seed) % (2u * n));
+		pWord = createWord( word);
+		if (BST_Insert( tree, pWord, increase_freq) != 1) destroyWord( pWord);
+	}
+
+	queries = malloc( sizeof( tWord *) * q);
+	expected = malloc( sizeof( tWord *) * q);
+	found = malloc( sizeof( tWord *) * q);
+	for (int i = 0; i < q; i++)
+	{
+		sprintf( word, "w%09u", next_random( &seed) % (2u * n));
+		queries[i] = createWord( word);
+	}
+
+	// the faster of two passes, so the first one's cold start does not count
+	single = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		double elapsed;
+
+		t0 = now();
+		for (int i = 0; i < q; i++)
+			expected[i] = BST_Search( tree, queries[i]);
+		elapsed = now() - t0;
+		if (pass == 0 || elapsed < single) single = elapsed;
+	}
+	printf( "one at a time\t%.2f M lookups/s\n", q / single / 1e6);
+
+	for (int batch = 1; batch <= 1024; batch *= 4)
+	{
+		double elapsed;
+
+		t0 = now();
+		for (int i = 0; i < q; i += batch)
+			BST_SearchBatch( tree, (void **)queries + i, (q - i < batch) ? q - i : batch, (void **)found + i);
+		elapsed = now() - t0;
+
+		if (memcmp( found, expected, sizeof( tWord *) * q) != 0) failed = 1;
+		printf( "batch %d\t%.2f M lookups/s (x%.2f)\n", batch, q / elapsed / 1e6, single / elapsed);
+	}
+
+	for (int i = 0; i < q; i++)
+		destroyWord( queries[i]);
+	free( queries);
+	free( expected);
+	free( found);
+	BST_Destroy( tree, destroyWord);
+
+	if (failed) fprintf( stderr, "Error: batch results differ\n");
+	return failed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// builds a tree of every FILE in each balancing mode and searches every token again,
+// then once more after BST_Freeze
+// prints build/search time and tree height
+// with -b, runs bench_batch on N words, Q lookups and MODE instead
+// exit status 3 if a batch answers differently from BST_Search
+int main( int argc, char **argv)
+{
+	if (argc > 1 && strcmp( argv[1], "-b") == 0)
+	{
+		int n = (argc > 2) ? atoi( argv[2]) : 1000000;
+		int q = (argc > 3) ? atoi( argv[3]) : 1000000;
+		int mode = (argc > 4 && strcmp( argv[4], "treap") == 0) ? BST_TREAP : BST_PLAIN;
+
+		if (n >= 1 && q >= 1) return bench_batch( n, q, mode) ? 3 : 0;
+		argc = 1;
+	}
+	if (argc < 2) {
+		fprintf( stderr, "usage: %s FILE...\n", argv[0]);
+		fprintf( stderr, "       %s -b [N [Q [plain|treap]]]\n", argv[0]);
+		return 1;
+	}
+
+	for (int f = 1; f < argc; f++)
+	{
+		char **tokens;
+		int num_tokens = load_tokens( argv[f], &tokens);
+
+		if (num_tokens < 0)
+		{
+			fprintf( stderr, "Error: cannot open file [%s]\n", argv[f]);
+			return 2;
+		}
+
+		for (size_t m = 0; m < sizeof( modes) / sizeof( modes[0]); m++)
+		{
+			TREE *tree = BST_CreateMode( compare_by_word, modes[m].mode);
+			double t0, t_build, t_search, t_frozen;
+			long found = 0, found_frozen = 0;
+
+			t0 = now();
+			for (int i = 0; i < num_tokens; i++)
+			{
+				tWord *pWord = createWord( tokens[i]);
+				int ret = BST_Insert( tree, pWord, increase_freq);
+				if (ret == 0 || ret == 2) destroyWord( pWord);
+			}
+			t_build = now() - t0;
+
+			t0 = now();
+			for (int i = 0; i < num_tokens; i++)
+			{
+				tWord key = { tokens[i], 0};
+				found += (BST_Search( tree, &key) != NULL);
+			}
+			t_search = now() - t0;
+
+			// same searches on the van Emde Boas copy
+			BST_Freeze( tree, word_key);
+			t0 = now();
+			for (int i = 0; i < num_tokens; i++)
+			{
+				tWord key = { tokens[i], 0};
+				found_frozen += (BST_Search( tree, &key) != NULL);
+			}
+			t_frozen = now() - t0;
+
+			printf( "%s\t%s\tcount=%d\theight=%d\tbuild %.3f s\tsearch %.3f s (%ld found)\tfrozen %.3f s (%ld found)\n",
+				argv[f], modes[m].name, BST_Count( tree), BST_Height( tree), t_build, t_search, found, t_frozen, found_frozen);
+
+			BST_Destroy( tree, destroyWord);
+		}
+
+		for (int i = 0; i < num_tokens; i++)
+			free( tokens[i]);
+		free( tokens);
+	}
+
+	return 0;
+}
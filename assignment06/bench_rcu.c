@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, qsort
+#include <string.h> // strcmp
+#include <time.h> // nanosleep
+#include <pthread.h>
+
+#include "bst.h"
+#include "bench.h"
+
+// shared state of one run
+typedef struct {
+	TREE	*tree;
+	tWord	**words;	// every distinct word
+	char	*present;	// words[i] is in the tree (owned by the writer)
+	int		num_words;
+	int		locked;		// readers and writer go through rwlock (baseline)
+	pthread_rwlock_t	rwlock;
+	int		stop;		// set by main when the time is up
+} tRun;
+
+// per-thread counters
+typedef struct {
+	tRun	*run;
+	unsigned int	seed;
+	long	ops;
+	long	found;
+} tWorker;
+
+////////////////////////////////////////////////////////////////////////////////
+int compare_tokens( const void *t1, const void *t2)
+{
+	return strcmp( *(char **)t1, *(char **)t2);
+}
+
+// reads the distinct tokens of a file in random order
+// return	number of tokens, -1 if the file cannot be opened
+static int load_words( char *filename, char ***wordsOut)
+{
+	char **tokens;
+	int num_tokens = load_tokens( filename, &tokens), num_words = 0;
+	unsigned int seed = 2463534242u;
+
+	if (num_tokens < 0) return -1;
+
+	qsort( tokens, num_tokens, sizeof( char *), compare_tokens);
+	for (int i = 0; i < num_tokens; i++)
+	{
+		if (num_words > 0 && strcmp( tokens[num_words - 1], tokens[i]) == 0) free( tokens[i]);
+		else tokens[num_words++] = tokens[i];
+	}
+
+	// shuffled, so the unbalanced tree stays shallow
+	for (int i = num_words - 1; i > 0; i--)
+	{
+		int j = next_random( &seed) % (i + 1);
+		char *t = tokens[i]; tokens[i] = tokens[j]; tokens[j] = t;
+	}
+
+	*wordsOut = tokens;
+	return num_words;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// searches random words until stopped
+static void *reader( void *arg)
+{
+	tWorker *pWorker = arg;
+	tRun *run = pWorker->run;
+
+	while (!__atomic_load_n( &run->stop, __ATOMIC_RELAXED))
+	{
+		tWord *pWord = run->words[next_random( &pWorker->seed) % run->num_words];
+
+		if (run->locked) pthread_rwlock_rdlock( &run->rwlock);
+		pWorker->found += (BST_Search( run->tree, pWord) != NULL);
+		if (run->locked) pthread_rwlock_unlock( &run->rwlock);
+		pWorker->ops++;
+	}
+	return NULL;
+}
+
+// deletes a random word if it is in the tree, inserts it again otherwise, until stopped
+static void *writer( void *arg)
+{
+	tWorker *pWorker = arg;
+	tRun *run = pWorker->run;
+
+	while (!__atomic_load_n( &run->stop, __ATOMIC_RELAXED))
+	{
+		int i = next_random( &pWorker->seed) % run->num_words;
+
+		if (run->locked) pthread_rwlock_wrlock( &run->rwlock);
+		if (run->present[i]) run->present[i] = (BST_Delete( run->tree, run->words[i]) == NULL);
+		else run->present[i] = (BST_Insert( run->tree, run->words[i], increase_freq) == 1);
+		if (run->locked) pthread_rwlock_unlock( &run->rwlock);
+		pWorker->ops++;
+	}
+	return NULL;
+}
+
+// one writer and num_readers readers on a tree of all words for seconds
+static void bench( const char *name, int mode, int locked, char **tokens, int num_words, int num_readers, double seconds)
+{
+	tRun run;
+	tWorker workers[num_readers + 1];
+	pthread_t threads[num_readers + 1];
+	struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+	long reads = 0, found = 0;
+	double t0, elapsed;
+
+	run.tree = BST_CreateMode( compare_by_word, mode);
+	run.words = malloc( sizeof( tWord *) * num_words);
+	run.present = malloc( num_words);
+	run.num_words = num_words;
+	run.locked = locked;
+	run.stop = 0;
+	pthread_rwlock_init( &run.rwlock, NULL);
+
+	for (int i = 0; i < num_words; i++)
+	{
+		run.words[i] = createWord( tokens[i]);
+		run.present[i] = (BST_Insert( run.tree, run.words[i], increase_freq) == 1);
+	}
+
+	t0 = now();
+	for (int t = 0; t <= num_readers; t++)
+	{
+		workers[t] = (tWorker){ &run, 2463534242u + 7919 * t, 0, 0};
+		pthread_create( &threads[t], NULL, (t == 0) ? writer : reader, &workers[t]);
+	}
+	nanosleep( &ts, NULL);
+	__atomic_store_n( &run.stop, 1, __ATOMIC_RELAXED);
+	for (int t = 0; t <= num_readers; t++)
+		pthread_join( threads[t], NULL);
+	elapsed = now() - t0;
+
+	for (int t = 1; t <= num_readers; t++)
+	{
+		reads += workers[t].ops;
+		found += workers[t].found;
+	}
+	printf( "%s\treaders=%d\tcount=%d\treads %.0f/s (%.1f%% found)\twrites %.0f/s\n",
+		name, num_readers, BST_Count( run.tree), reads / elapsed, reads ? 100.0 * found / reads : 0.0,
+		workers[0].ops / elapsed);
+
+	for (int i = 0; i < num_words; i++)
+		if (!run.present[i]) destroyWord( run.words[i]);
+	BST_Destroy( run.tree, destroyWord);
+	pthread_rwlock_destroy( &run.rwlock);
+	free( run.words);
+	free( run.present);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// mixed read/write throughput: one thread keeps deleting and inserting random words while
+// READERS threads search random words, with lock-free searches (BST_RCU) and with a
+// reader-writer lock around a plain tree
+int main( int argc, char **argv)
+{
+	char **tokens;
+	int num_words, num_readers;
+	double seconds;
+
+	if (argc < 2) {
+		fprintf( stderr, "usage: %s FILE [READERS [SECONDS]]\n", argv[0]);
+		return 1;
+	}
+	num_readers = (argc > 2) ? atoi( argv[2]) : 4;
+	seconds = (argc > 3) ? atof( argv[3]) : 1.0;
+	if (num_readers < 1 || seconds <= 0)
+	{
+		fprintf( stderr, "usage: %s FILE [READERS [SECONDS]]\n", argv[0]);
+		return 1;
+	}
+
+	num_words = load_words( argv[1], &tokens);
+	if (num_words < 0)
+	{
+		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
+		return 2;
+	}
+	if (num_words == 0) return 0;
+
+	bench( "rcu", BST_RCU, 0, tokens, num_words, num_readers, seconds);
+	bench( "rwlock", BST_PLAIN, 1, tokens, num_words, num_readers, seconds);
+
+	for (int i = 0; i < num_words; i++)
+		free( tokens[i]);
+	free( tokens);
+
+	return 0;
+}
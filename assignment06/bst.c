@@ -1,8 +1,24 @@
 #include <stdlib.h> // malloc
 #include <stdio.h>
+#include <string.h> // memcpy, memcmp
+#include <limits.h> // UINT_MAX
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <pthread.h> // BST_ParallelBuild, BST_RCU
+#include <sched.h> // sched_yield
 
 #include "bst.h"
 
+// operation counters (see TREE_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(pTree, field, n)	((pTree)->stats.field += (n))
+#define STAT_PEAK(pTree)			do { if ((pTree)->count > (pTree)->stats.peak) (pTree)->stats.peak = (pTree)->count; } while (0)
+#else
+#define STAT_ADD(pTree, field, n)	((void)(pTree))
+#define STAT_PEAK(pTree)			((void)(pTree))
+#endif
 
 // internal functions (not mandatory)
 // used in BST_Insert
@@ -16,16 +32,509 @@ static NODE *_makeNode( void *dataInPtr){
     newNode->dataPtr = dataInPtr;
     newNode->left = NULL;
     newNode->right = NULL;
+    newNode->priority = 0;
+    newNode->size = 1;
     return newNode;
 }
 
+// internal function
+// recycles memory of a node
+// nodes of the BST_BuildFromSorted array are released with the whole array in BST_Destroy
+static void _freeNode( TREE *pTree, NODE *pNode){
+    if(pNode >= pTree->block && pNode < pTree->block + pTree->blockSize)
+        return;
+    free(pNode);
+}
+
+// internal function
+// xorshift32 step of the tree's random state
+// used for treap priorities
+static unsigned int _random( TREE *pTree){
+    unsigned int x = pTree->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return pTree->seed = x;
+}
+
+// internal function
+// return	number of nodes in the subtree
+static int _size( NODE *root){
+    return (root == NULL) ? 0 : root->size;
+}
+
+// internal function
+// Exchanges pointers to rotate the tree to the right
+// updates subtree sizes of the nodes
+// return	new root
+static NODE *_rotateRight( TREE *pTree, NODE *root){
+    NODE *pNode = root->left;
+    root->left = pNode->right;
+    pNode->right = root;
+    pNode->size = root->size;
+    root->size = _size(root->left) + _size(root->right) + 1;
+    STAT_ADD(pTree, rotations, 1);
+    return pNode;
+}
+
+// internal function
+// Exchanges pointers to rotate the tree to the left
+// updates subtree sizes of the nodes
+// return	new root
+static NODE *_rotateLeft( TREE *pTree, NODE *root){
+    NODE *pNode = root->right;
+    root->right = pNode->left;
+    pNode->left = root;
+    pNode->size = root->size;
+    root->size = _size(root->left) + _size(root->right) + 1;
+    STAT_ADD(pTree, rotations, 1);
+    return pNode;
+}
+
+// used in BST_Insert (BST_TREAP)
+// inserts as in a plain BST, then rotates the new node up while its priority is higher
+// result	1 inserted, 2 duplicated key
+// return	pointer to root
+static NODE *_treapInsert( TREE *pTree, NODE *root, NODE *newPtr, void (*callback)(void *), int *result){
+    if(root == NULL){
+        *result = 1;
+        return newPtr;
+    }
+
+    int cmp = pTree->compare(newPtr->dataPtr, root->dataPtr);
+    STAT_ADD(pTree, compares, 1);
+    if(cmp == 0){
+        callback(root->dataPtr);
+        *result = 2;
+        return root;
+    }
+
+    STAT_ADD(pTree, hops, 1);
+    if(cmp < 0)
+        root->left = _treapInsert(pTree, root->left, newPtr, callback, result);
+    else
+        root->right = _treapInsert(pTree, root->right, newPtr, callback, result);
+    if(*result == 2) return root;
+
+    root->size++;
+    if(cmp < 0 && root->left->priority > root->priority)
+        root = _rotateRight(pTree, root);
+    else if(cmp > 0 && root->right->priority > root->priority)
+        root = _rotateLeft(pTree, root);
+    return root;
+}
+
+// internal function
+// stores pNode at depth of the splay access path
+// return	0 if overflow
+static int _pathSet( TREE *pTree, int depth, NODE *pNode){
+    if(depth == pTree->pathCap){
+        int capacity = pTree->pathCap ? pTree->pathCap * 2 : 64;
+        NODE **path = realloc(pTree->path, sizeof(NODE *) * capacity);
+        if(path == NULL) return 0;
+        pTree->path = path;
+        pTree->pathCap = capacity;
+    }
+    pTree->path[depth] = pNode;
+    return 1;
+}
+
+// internal function
+// return	address of the link pointing to path[depth] (rootLink for depth 0)
+static NODE **_pathLink( TREE *pTree, NODE **rootLink, int depth){
+    if(depth == 0) return rootLink;
+    NODE *parent = pTree->path[depth - 1];
+    return (parent->left == pTree->path[depth]) ? &parent->left : &parent->right;
+}
+
+// internal function
+// adds delta to the subtree sizes of path[0..depth-1]
+static void _pathResize( TREE *pTree, int depth, int delta){
+    for(int i = 0; i < depth; i++)
+        pTree->path[i]->size += delta;
+}
+
+// internal function
+// moves path[depth] up to *rootLink by zig, zig-zig and zig-zag steps (bottom-up splay)
+// path[0..depth] must be the access path from *rootLink
+static void _splay( TREE *pTree, NODE **rootLink, int depth){
+    NODE **path = pTree->path;
+    NODE *x = path[depth];
+
+    while(depth > 0){
+        NODE *p = path[depth - 1];
+        if(depth == 1){ // zig
+            *rootLink = (p->left == x) ? _rotateRight(pTree, p) : _rotateLeft(pTree, p);
+            break;
+        }
+
+        NODE *g = path[depth - 2];
+        NODE **gLink = _pathLink(pTree, rootLink, depth - 2);
+        if((g->left == p) == (p->left == x)){ // zig-zig: rotate grandparent first
+            if(p->left == x){
+                *gLink = _rotateRight(pTree, g);
+                *gLink = _rotateRight(pTree, p);
+            }
+            else{
+                *gLink = _rotateLeft(pTree, g);
+                *gLink = _rotateLeft(pTree, p);
+            }
+        }
+        else{ // zig-zag
+            if(p->left == x){
+                g->right = _rotateRight(pTree, p);
+                *gLink = _rotateLeft(pTree, g);
+            }
+            else{
+                g->left = _rotateLeft(pTree, p);
+                *gLink = _rotateRight(pTree, g);
+            }
+        }
+        depth -= 2;
+        path[depth] = x;
+    }
+}
+
+// used in BST_Insert, BST_Search, BST_Delete (BST_SPLAY)
+// descends from *rootLink toward keyPtr recording the path, then splays the last node reached
+// return	1 key found (now at *rootLink)
+//			0 not found (*rootLink holds the last node on the path)
+//			-1 overflow
+static int _splaySearch( TREE *pTree, NODE **rootLink, void *keyPtr){
+    NODE *pNode = *rootLink;
+    int depth = -1;
+    int cmp = 1;
+
+    while(pNode != NULL){
+        if(!_pathSet(pTree, ++depth, pNode)) return -1;
+        cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0) break;
+        pNode = (cmp < 0) ? pNode->left : pNode->right;
+        STAT_ADD(pTree, hops, 1);
+    }
+    if(depth >= 0) _splay(pTree, rootLink, depth);
+    return cmp == 0;
+}
+
+// used in BST_Insert (BST_SPLAY)
+// an insert hit calls back on the existing data; a new node is linked as a leaf, then splayed to the root
+// return	0 overflow
+//			1 success
+//			2 if duplicated key
+static int _splayInsert( TREE *pTree, NODE *newPtr, void (*callback)(void *)){
+    NODE *pNode = pTree->root;
+    int depth = -1;
+    int cmp = 0;
+
+    while(pNode != NULL){
+        if(!_pathSet(pTree, ++depth, pNode)) return 0;
+        cmp = pTree->compare(newPtr->dataPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0){
+            callback(pNode->dataPtr);
+            _splay(pTree, &pTree->root, depth);
+            return 2;
+        }
+        pNode = (cmp < 0) ? pNode->left : pNode->right;
+        STAT_ADD(pTree, hops, 1);
+    }
+
+    if(!_pathSet(pTree, ++depth, newPtr)) return 0;
+    if(depth == 0) pTree->root = newPtr;
+    else if(cmp < 0) pTree->path[depth - 1]->left = newPtr;
+    else pTree->path[depth - 1]->right = newPtr;
+    _pathResize(pTree, depth, 1);
+    _splay(pTree, &pTree->root, depth);
+    return 1;
+}
+
+// used in BST_Delete (BST_SPLAY)
+// splays the key to the root, then joins its subtrees under the maximum of the left subtree
+// return	address of data of the deleted node
+//			NULL not found
+static void *_splayDelete( TREE *pTree, void *keyPtr){
+    if(_splaySearch(pTree, &pTree->root, keyPtr) != 1)
+        return NULL;
+
+    NODE *pNode = pTree->root;
+    if(pNode->left == NULL)
+        pTree->root = pNode->right;
+    else{
+        // splay the maximum of the left subtree; it has no right child afterwards
+        NODE *left = pNode->left;
+        int depth = 0;
+        if(!_pathSet(pTree, 0, left)) return NULL;
+        while(left->right != NULL){
+            left = left->right;
+            if(!_pathSet(pTree, ++depth, left)) return NULL;
+        }
+        _splay(pTree, &pNode->left, depth);
+        pNode->left->right = pNode->right;
+        pNode->left->size += _size(pNode->right);
+        pTree->root = pNode->left;
+    }
+
+    void *out = pNode->dataPtr;
+    _freeNode(pTree, pNode);
+    pTree->count--;
+    return out;
+}
+
+// used in BST_Delete (BST_TREAP)
+// rotates the node down below its higher-priority child until it has at most one child, then unlinks it
+// return	address of data of the deleted node
+//			NULL not found
+static void *_treapDelete( TREE *pTree, void *keyPtr){
+    NODE **link = &pTree->root;
+    int depth = 0; // ancestors recorded in the path buffer
+
+    while(*link != NULL){
+        int cmp = pTree->compare(keyPtr, (*link)->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0) break;
+        if(!_pathSet(pTree, depth++, *link)) return NULL;
+        link = (cmp < 0) ? &(*link)->left : &(*link)->right;
+        STAT_ADD(pTree, hops, 1);
+    }
+    if(*link == NULL) return NULL;
+
+    NODE *pNode = *link;
+    while(pNode->left != NULL && pNode->right != NULL){
+        if(pNode->left->priority > pNode->right->priority){
+            *link = _rotateRight(pTree, pNode);
+            if(!_pathSet(pTree, depth++, *link)) return NULL;
+            link = &(*link)->right;
+        }
+        else{
+            *link = _rotateLeft(pTree, pNode);
+            if(!_pathSet(pTree, depth++, *link)) return NULL;
+            link = &(*link)->left;
+        }
+    }
+    *link = (pNode->left != NULL) ? pNode->left : pNode->right;
+    _pathResize(pTree, depth, -1);
+
+    void *out = pNode->dataPtr;
+    _freeNode(pTree, pNode);
+    pTree->count--;
+    return out;
+}
+
+// read-side registry of BST_RCU, shared by all trees
+// a searching thread publishes the epoch it started in (0: not searching); a writer that
+// moves the epoch forward and then sees no slot behind it knows every older search is over
+#define RCU_READERS	128	// threads with a slot; searches of further threads take the write lock
+#define RCU_BATCH	64	// deleted nodes collected before one grace period frees them all
+
+typedef struct
+{
+    unsigned long epoch;
+    int used;
+    char pad[64 - sizeof(unsigned long) - sizeof(int)]; // one cache line per reader
+} RCU_SLOT;
+
+static RCU_SLOT _rcuSlots[RCU_READERS];
+static unsigned long _rcuEpoch = 1;
+static __thread int _rcuSlot = -1; // slot of the calling thread
+static pthread_once_t _rcuOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _rcuKey; // gives the slot back when its thread exits
+
+// internal function
+// destructor of _rcuKey
+static void _rcuRelease( void *arg){
+    __atomic_store_n(&_rcuSlots[(intptr_t)arg - 1].used, 0, __ATOMIC_RELEASE);
+}
+
+// internal function
+static void _rcuInit( void){
+    pthread_key_create(&_rcuKey, _rcuRelease);
+}
+
+// used in BST_Search (BST_RCU)
+// return	slot of the calling thread
+//			-1 if all slots are taken
+static int _rcuRegister( void){
+    pthread_once(&_rcuOnce, _rcuInit);
+    for(int i = 0; i < RCU_READERS; i++){
+        int expected = 0;
+        if(__atomic_compare_exchange_n(&_rcuSlots[i].used, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+            pthread_setspecific(_rcuKey, (void *)(intptr_t)(i + 1));
+            return _rcuSlot = i;
+        }
+    }
+    return -1;
+}
+
+// used in BST_Delete, BST_Synchronize (BST_RCU)
+// waits for a grace period: every search that started before the call has returned
+// nodes unlinked before the call are unreachable afterwards
+static void _rcuWait( void){
+    unsigned long epoch = __atomic_add_fetch(&_rcuEpoch, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // unlinks and the new epoch come before the scan
+    for(int i = 0; i < RCU_READERS; i++){
+        unsigned long seen;
+        while((seen = __atomic_load_n(&_rcuSlots[i].epoch, __ATOMIC_ACQUIRE)) != 0 && seen < epoch)
+            sched_yield();
+    }
+}
+
+// used in BST_Delete, BST_Synchronize (BST_RCU)
+// frees the limbo nodes after a grace period
+static void _rcuReclaim( TREE *pTree){
+    _rcuWait();
+    for(int i = 0; i < pTree->limboCount; i++)
+        _freeNode(pTree, pTree->limbo[i]);
+    pTree->limboCount = 0;
+}
+
+// used in BST_Delete (BST_RCU)
+// puts an unlinked node in limbo; a full batch is reclaimed at once
+static void _rcuRetire( TREE *pTree, NODE *pNode){
+    if(pTree->limboCount == pTree->limboCap){
+        int capacity = pTree->limboCap ? pTree->limboCap * 2 : RCU_BATCH;
+        NODE **limbo = realloc(pTree->limbo, sizeof(NODE *) * capacity);
+        if(limbo == NULL){ // no room: wait for the searches right now
+            _rcuWait();
+            _freeNode(pTree, pNode);
+            return;
+        }
+        pTree->limbo = limbo;
+        pTree->limboCap = capacity;
+    }
+    pTree->limbo[pTree->limboCount++] = pNode;
+    if(pTree->limboCount >= RCU_BATCH)
+        _rcuReclaim(pTree);
+}
+
+// used in BST_Insert (BST_RCU), called with the write lock held
+// the new node is complete before one release store links it in
+// return	1 inserted, 2 duplicated key, 0 overflow
+static int _rcuInsert( TREE *pTree, NODE *newPtr, void (*callback)(void *)){
+    NODE **link = &pTree->root;
+    int depth = 0; // ancestors recorded in the path buffer
+
+    while(*link != NULL){
+        int cmp = pTree->compare(newPtr->dataPtr, (*link)->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0){
+            callback((*link)->dataPtr);
+            return 2;
+        }
+        if(!_pathSet(pTree, depth++, *link)) return 0;
+        link = (cmp < 0) ? &(*link)->left : &(*link)->right;
+        STAT_ADD(pTree, hops, 1);
+    }
+    __atomic_store_n(link, newPtr, __ATOMIC_RELEASE);
+    _pathResize(pTree, depth, 1); // searches never read the sizes
+    return 1;
+}
+
+// used in BST_Delete (BST_RCU), called with the write lock held
+// no node a search may stand on is changed in place: a node with two children is replaced
+// by a copy holding its successor's data, and the successor is unlinked only after a grace
+// period, so a search that passed the old node on its way to the successor still finds it
+// return	address of data of the deleted node
+//			NULL not found (or overflow)
+static void *_rcuDelete( TREE *pTree, void *keyPtr){
+    NODE **link = &pTree->root;
+    int depth = 0; // ancestors recorded in the path buffer
+
+    while(*link != NULL){
+        int cmp = pTree->compare(keyPtr, (*link)->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0) break;
+        if(!_pathSet(pTree, depth++, *link)) return NULL;
+        link = (cmp < 0) ? &(*link)->left : &(*link)->right;
+        STAT_ADD(pTree, hops, 1);
+    }
+    NODE *pNode = *link;
+    if(pNode == NULL) return NULL;
+    void *out = pNode->dataPtr;
+
+    if(pNode->left == NULL || pNode->right == NULL){
+        __atomic_store_n(link, (pNode->left != NULL) ? pNode->left : pNode->right, __ATOMIC_RELEASE);
+        _pathResize(pTree, depth, -1);
+        _rcuRetire(pTree, pNode);
+        pTree->count--;
+        return out;
+    }
+
+    NODE **minLink = &pNode->right;
+    while((*minLink)->left != NULL){
+        minLink = &(*minLink)->left;
+        STAT_ADD(pTree, hops, 1);
+    }
+    NODE *min = *minLink;
+    NODE *copy = _makeNode(min->dataPtr);
+    if(copy == NULL) return NULL;
+    STAT_ADD(pTree, allocs, 1);
+    copy->left = pNode->left;
+    copy->right = pNode->right;
+    copy->size = pNode->size - 1;
+    for(NODE *p = pNode->right; p != min; p = p->left)
+        p->size--;
+    _pathResize(pTree, depth, -1);
+
+    __atomic_store_n(link, copy, __ATOMIC_RELEASE);
+    _rcuWait(); // no search is left in pNode
+    if(minLink == &pNode->right)
+        minLink = &copy->right;
+    __atomic_store_n(minLink, min->right, __ATOMIC_RELEASE);
+
+    _rcuRetire(pTree, pNode);
+    _rcuRetire(pTree, min);
+    pTree->count--;
+    return out;
+}
+
+// used in BST_Search (BST_RCU)
+// follows the links with acquire loads while the thread's slot holds the current epoch
+// operation counters are not updated (they are not thread-safe)
+static void *_rcuSearch( TREE *pTree, void *keyPtr){
+    int slot = (_rcuSlot >= 0) ? _rcuSlot : _rcuRegister();
+    if(slot >= 0){
+        __atomic_store_n(&_rcuSlots[slot].epoch, __atomic_load_n(&_rcuEpoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); // the slot is visible before any link is read
+    }
+    else
+        pthread_mutex_lock(&pTree->writeLock); // no slot left: keep the writers out instead
+
+    void *out = NULL;
+    NODE *pNode = __atomic_load_n(&pTree->root, __ATOMIC_ACQUIRE);
+    while(pNode != NULL){
+        int cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        if(cmp == 0){
+            out = pNode->dataPtr;
+            break;
+        }
+        pNode = __atomic_load_n((cmp < 0) ? &pNode->left : &pNode->right, __ATOMIC_ACQUIRE);
+    }
+
+    if(slot >= 0)
+        __atomic_store_n(&_rcuSlots[slot].epoch, 0, __ATOMIC_RELEASE);
+    else
+        pthread_mutex_unlock(&pTree->writeLock);
+    return out;
+}
+
 // used in BST_Destroy
-static void _destroy( NODE *root, void (*callback)(void *)){
-    if(root == NULL) return;
-    _destroy(root->left, callback);
-    callback(root->dataPtr);
-    _destroy(root->right, callback);
-    free(root);
+// flattens the tree by right rotations while freeing it, so no stack is needed at any depth
+static void _destroy( TREE *pTree, NODE *root, void (*callback)(void *)){
+    while(root != NULL){
+        if(root->left != NULL){
+            NODE *pNode = root->left;
+            root->left = pNode->right;
+            pNode->right = root;
+            root = pNode;
+        }
+        else{
+            NODE *next = root->right;
+            callback(root->dataPtr);
+            _freeNode(pTree, root);
+            root = next;
+        }
+    }
 }
 
 
@@ -39,33 +548,98 @@ static NODE *_delete( NODE *root, void *keyPtr, void **dataOutPtr, int (*compare
 //			NULL not found
 static NODE *_search( NODE *root, void *keyPtr, int (*compare)(const void *, const void *));
 
+#define WALK_STACK	64	// nodes a walk keeps in its own frame before its stack moves to the heap
+
+// internal function
+// doubles the stack of a walk; the first stack is an array in the walking function's
+// frame (local), the larger ones are on the heap and freed here when outgrown
+// return	new stack
+//			NULL if overflow (a heap stack is freed, local is left)
+static NODE **_walkGrow( NODE **stack, NODE **local, int *capacity){
+    NODE **grown = malloc(sizeof(NODE *) * *capacity * 2);
+    if(grown != NULL) memcpy(grown, stack, sizeof(NODE *) * *capacity);
+    if(stack != local) free(stack);
+    *capacity *= 2;
+    return grown;
+}
+
 // used in BST_Traverse
-static void _traverse( NODE *root, void (*callback)(const void *)){ // check it!
-    if(root == NULL) return;
-    _traverse(root->left, callback);
-    callback(root->dataPtr);
-    _traverse(root->right, callback);
+// in-order walk with the pending ancestors on a stack of its own instead of the call stack
+// or the tree's access path buffer, so walks may nest and run in several threads at once
+// return	0 if overflow (the callback has seen only the data before the failure)
+static int _traverse( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = local;
+    NODE *pNode = pTree->root;
+    int capacity = WALK_STACK, depth = 0;
+
+    while(1){
+        while(pNode != NULL){
+            if(depth == capacity && (stack = _walkGrow(stack, local, &capacity)) == NULL) return 0;
+            stack[depth++] = pNode;
+            pNode = pNode->left;
+        }
+        if(depth == 0) break;
+        pNode = stack[--depth];
+        callback(pNode->dataPtr);
+        pNode = pNode->right;
+    }
+    if(stack != local) free(stack);
+    return 1;
 }
 
 // used in BST_TraverseR
-static void _traverseR( NODE *root, void (*callback)(const void *)){
-    if(root == NULL) return;
-    _traverseR(root->right, callback);
-    callback(root->dataPtr);
-    _traverseR(root->left, callback);
+// mirror of _traverse
+static int _traverseR( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = local;
+    NODE *pNode = pTree->root;
+    int capacity = WALK_STACK, depth = 0;
+
+    while(1){
+        while(pNode != NULL){
+            if(depth == capacity && (stack = _walkGrow(stack, local, &capacity)) == NULL) return 0;
+            stack[depth++] = pNode;
+            pNode = pNode->right;
+        }
+        if(depth == 0) break;
+        pNode = stack[--depth];
+        callback(pNode->dataPtr);
+        pNode = pNode->left;
+    }
+    if(stack != local) free(stack);
+    return 1;
 }
 
 // used in printTree
-static void _inorder_print( NODE *root, int level, void (*callback)(const void *)){
-    if(root == NULL) return;
-    level++;
+// right-to-left walk keeping the whole root path on its own stack; its length is the level
+// return	0 if overflow (as _traverse)
+static int _inorder_print( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = local;
+    NODE *pNode = pTree->root;
+    int capacity = WALK_STACK, depth = 0;
 
-    _inorder_print(root->right, level, callback);
-    for(int i = 0; i<level; i++){
-        printf("\t");
+    while(1){
+        while(pNode != NULL){
+            if(depth == capacity && (stack = _walkGrow(stack, local, &capacity)) == NULL) return 0;
+            stack[depth++] = pNode;
+            pNode = pNode->right;
+        }
+        if(depth == 0) break;
+        pNode = stack[depth - 1];
+        for(int i = 0; i<depth; i++){
+            printf("\t");
+        }
+        callback(pNode->dataPtr);
+        if(pNode->left != NULL){
+            pNode = pNode->left;
+            continue;
+        }
+        // climb while coming up from a left child
+        depth--;
+        while(depth > 0 && stack[depth - 1]->left == stack[depth]) depth--;
+        pNode = NULL;
     }
-    callback(root->dataPtr);
-    _inorder_print(root->left, level, callback);
+    if(stack != local) free(stack);
+    return 1;
 }
 
 
@@ -76,22 +650,566 @@ static void _inorder_print( NODE *root, int level, void (*callback)(const void *
 			NULL if overflow
 */
 TREE *BST_Create( int (*compare)(const void *, const void *)){
+    return BST_CreateMode(compare, BST_PLAIN);
+}
+
+/* same as BST_Create with a balancing mode (BST_PLAIN, BST_TREAP, BST_SPLAY, BST_RCU)
+	return	head node pointer
+			NULL if overflow or unknown mode
+*/
+TREE *BST_CreateMode( int (*compare)(const void *, const void *), int mode){
+    if(mode != BST_PLAIN && mode != BST_TREAP && mode != BST_SPLAY && mode != BST_RCU)
+        return NULL;
     TREE *newtree = malloc(sizeof(TREE));
     if(newtree == NULL)
         return NULL;
     newtree->count = 0;
     newtree->root = NULL;
     newtree->compare = compare;
+    newtree->mode = mode;
+    newtree->seed = 2463534242u;
+    newtree->block = NULL;
+    newtree->blockSize = 0;
+    newtree->path = NULL;
+    newtree->pathCap = 0;
+    newtree->frozen = NULL;
+    newtree->getKey = NULL;
+    newtree->image = NULL;
+    newtree->imageSize = 0;
+    pthread_mutex_init(&newtree->writeLock, NULL);
+    newtree->limbo = NULL;
+    newtree->limboCount = 0;
+    newtree->limboCap = 0;
+#ifdef ADT_STATS
+    newtree->stats = (TREE_STATS){0};
+#endif
     return newtree;
 }
 
 /* Deletes all data in tree and recycles memory
 */
 void BST_Destroy( TREE *pTree, void (*callback)(void *)){
-    _destroy(pTree->root, callback);
+    if(pTree->image != NULL)
+        munmap(pTree->image, pTree->imageSize); // the records belong to the file
+    _destroy(pTree, pTree->root, callback);
+    for(int i = 0; i < pTree->limboCount; i++)
+        _freeNode(pTree, pTree->limbo[i]);
+    free(pTree->limbo);
+    pthread_mutex_destroy(&pTree->writeLock);
+    free(pTree->block);
+    free(pTree->path);
+    free(pTree->frozen);
     free(pTree);
 }
 
+// used in BST_BuildFromSorted
+// links block[lo..hi) into a balanced subtree; the nodes already hold the data in order
+// return	subtree root
+static NODE *_linkSorted( NODE *block, int lo, int hi){
+    if(lo >= hi) return NULL;
+    int mid = lo + (hi - lo) / 2;
+    block[mid].size = hi - lo;
+    block[mid].left = _linkSorted(block, lo, mid);
+    block[mid].right = _linkSorted(block, mid + 1, hi);
+    return &block[mid];
+}
+
+/* Builds a height-optimal tree from n data sorted in ascending order without duplicates
+	all nodes are allocated at once as a contiguous array
+	return	head node pointer
+			NULL if overflow or dataArr is not strictly ascending
+*/
+TREE *BST_BuildFromSorted( int (*compare)(const void *, const void *), void *dataArr[], int n){
+    for(int i = 1; i < n; i++)
+        if(compare(dataArr[i - 1], dataArr[i]) >= 0)
+            return NULL;
+
+    TREE *pTree = BST_Create(compare);
+    if(pTree == NULL) return NULL;
+    if(n <= 0) return pTree;
+
+    pTree->block = malloc(sizeof(NODE) * n);
+    if(pTree->block == NULL){
+        free(pTree);
+        return NULL;
+    }
+    pTree->blockSize = n;
+    STAT_ADD(pTree, allocs, 1);
+
+    // in-order position == array position, so ordered scans walk memory sequentially
+    for(int i = 0; i < n; i++){
+        pTree->block[i].dataPtr = dataArr[i];
+        pTree->block[i].priority = 0;
+    }
+    pTree->root = _linkSorted(pTree->block, 0, n);
+    pTree->count = n;
+    STAT_PEAK(pTree);
+    return pTree;
+}
+
+// used in BST_Freeze and BST_Search
+// first 8 bytes of key as a big-endian number, zero padded after the end of the string
+// (so the numbers compare like strcmp on those bytes)
+static uint64_t _keyPrefix( const char *key){
+    uint64_t prefix = 0;
+    for(int i = 0; i < 8; i++){
+        unsigned char c = (unsigned char)*key;
+        prefix = (prefix << 8) | c;
+        if(c != '\0') key++;
+    }
+    return prefix;
+}
+
+static void _vebBottom( int lo, int hi, int depth, int height, uint32_t *order, uint32_t *next);
+
+// used in BST_Freeze
+// numbers the top height levels of the balanced tree over sorted positions [lo, hi)
+// in van Emde Boas order: the upper half of the levels first, then every subtree below it
+// order[pos] receives the array index of sorted position pos
+static void _vebOrder( int lo, int hi, int height, uint32_t *order, uint32_t *next){
+    if(lo >= hi || height <= 0) return;
+    if(height == 1){
+        order[lo + (hi - lo) / 2] = (*next)++;
+        return;
+    }
+    int top = height / 2;
+    _vebOrder(lo, hi, top, order, next);
+    _vebBottom(lo, hi, top, height - top, order, next);
+}
+
+// used in _vebOrder
+// descends depth levels from [lo, hi) and numbers each subtree found there (height levels)
+static void _vebBottom( int lo, int hi, int depth, int height, uint32_t *order, uint32_t *next){
+    if(lo >= hi) return;
+    if(depth == 0){
+        _vebOrder(lo, hi, height, order, next);
+        return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    _vebBottom(lo, mid, depth - 1, height, order, next);
+    _vebBottom(mid + 1, hi, depth - 1, height, order, next);
+}
+
+// used in BST_Freeze and BST_Save
+// return	array of the data in ascending order (count entries)
+//			NULL if overflow
+static void **_sortedData( TREE *pTree){
+    void **sorted = malloc(sizeof(void *) * (pTree->count ? pTree->count : 1));
+    BST_ITER *pIter = BST_IterCreate(pTree);
+    if(sorted == NULL || pIter == NULL){
+        free(sorted);
+        if(pIter != NULL) BST_IterDestroy(pIter);
+        return NULL;
+    }
+    for(int i = 0; i < pTree->count; i++)
+        sorted[i] = BST_IterNext(pIter);
+    if(pIter->failed){
+        free(sorted);
+        sorted = NULL;
+    }
+    BST_IterDestroy(pIter);
+    return sorted;
+}
+
+// used in BST_Freeze and BST_Save
+// numbers the nodes of the balanced tree over n sorted positions in van Emde Boas order
+// return	array of the index of each sorted position (root is 0)
+//			NULL if overflow
+static uint32_t *_vebNumber( int n){
+    uint32_t *order = malloc(sizeof(uint32_t) * (n ? n : 1));
+    if(order == NULL) return NULL;
+
+    // height of the balanced tree over n nodes
+    int height = 0;
+    while(height < 31 && (1 << height) - 1 < n) height++;
+
+    uint32_t next = 0;
+    _vebOrder(0, n, height, order, &next);
+    return order;
+}
+
+// used in BST_Freeze
+// fills the frozen nodes of the balanced tree over sorted[lo..hi), same shape as _linkSorted
+// return	index of the subtree root, 0 if empty
+static uint32_t _vebLink( TREE *pTree, void **sorted, uint32_t *order, int lo, int hi){
+    if(lo >= hi) return 0;
+    int mid = lo + (hi - lo) / 2;
+    FROZEN_NODE *pNode = &pTree->frozen[order[mid]];
+    pNode->dataPtr = sorted[mid];
+    pNode->prefix = pTree->getKey ? _keyPrefix(pTree->getKey(sorted[mid])) : 0;
+    pNode->left = _vebLink(pTree, sorted, order, lo, mid);
+    pNode->right = _vebLink(pTree, sorted, order, mid + 1, hi);
+    return order[mid];
+}
+
+// used in BST_Search
+// compares the inline prefixes first and calls compare only when they are equal
+static void *_frozenSearch( TREE *pTree, void *keyPtr){
+    FROZEN_NODE *frozen = pTree->frozen;
+    uint64_t prefix = pTree->getKey ? _keyPrefix(pTree->getKey(keyPtr)) : 0;
+    uint32_t i = 0;
+    while(1){
+        FROZEN_NODE *pNode = &frozen[i];
+        int cmp;
+        if(prefix != pNode->prefix)
+            cmp = (prefix < pNode->prefix) ? -1 : 1;
+        else{
+            cmp = pTree->compare(keyPtr, pNode->dataPtr);
+            STAT_ADD(pTree, compares, 1);
+        }
+        if(cmp == 0)
+            return pNode->dataPtr;
+        i = (cmp < 0) ? pNode->left : pNode->right;
+        if(i == 0)
+            return NULL;
+        STAT_ADD(pTree, hops, 1);
+    }
+}
+
+/* Copies the tree into one contiguous array in van Emde Boas order for BST_Search
+	return	1 success
+			0 overflow (the tree stays mutable)
+*/
+int BST_Freeze( TREE *pTree, const char *(*getKey)(const void *)){
+    int n = pTree->count;
+    if(pTree->image != NULL) return 0;
+    if(pTree->mode == BST_RCU) return 0; // BST_Insert would free it under the searches
+    BST_Thaw(pTree);
+    if(n == 0) return 1; // nothing to search
+
+    void **sorted = _sortedData(pTree);
+    uint32_t *order = _vebNumber(n);
+    FROZEN_NODE *frozen = malloc(sizeof(FROZEN_NODE) * n);
+    if(sorted == NULL || order == NULL || frozen == NULL){
+        free(sorted);
+        free(order);
+        free(frozen);
+        return 0;
+    }
+
+    pTree->frozen = frozen;
+    pTree->getKey = getKey;
+    _vebLink(pTree, sorted, order, 0, n);
+    STAT_ADD(pTree, allocs, 1);
+
+    free(sorted);
+    free(order);
+    return 1;
+}
+
+/* Releases the frozen copy; BST_Search uses the pointer tree again
+*/
+void BST_Thaw( TREE *pTree){
+    if(pTree->frozen == NULL) return; // no store, BST_RCU searches read the field
+    free(pTree->frozen);
+    pTree->frozen = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// binary image (BST_Save, BST_Load)
+
+#define IMAGE_MAGIC	"BSTIMG1" // 8 bytes with the terminating NUL
+#define IMAGE_DEPTH	64	// levels of an image (a balanced tree of 2^32 nodes has 33)
+
+// file header; every offset is from the start of the file
+typedef struct
+{
+    char		magic[8];
+    uint32_t	count;		// number of nodes
+    uint32_t	nodeOff;	// IMAGE_NODE[count], van Emde Boas order, root at index 0
+    uint32_t	poolOff;	// records packed by the caller, each aligned to 8 bytes
+    uint32_t	poolSize;
+} IMAGE_HEADER;
+
+// node of the image; 0 means no child (index 0 is the root)
+typedef struct
+{
+    uint32_t	left;
+    uint32_t	right;
+    uint32_t	rec;	// offset of the record in the pool
+} IMAGE_NODE;
+
+#define IMAGE_NODES(h)	((IMAGE_NODE *)((char *)(h) + (h)->nodeOff))
+#define IMAGE_POOL(h)	((char *)(h) + (h)->poolOff)
+
+// used in BST_Save
+// fills the image nodes of the balanced tree over sorted positions [lo, hi)
+// return	index of the subtree root, 0 if empty
+static uint32_t _imageLink( IMAGE_NODE *nodes, uint32_t *order, uint32_t *recOff, int lo, int hi){
+    if(lo >= hi) return 0;
+    int mid = lo + (hi - lo) / 2;
+    IMAGE_NODE *pNode = &nodes[order[mid]];
+    pNode->rec = recOff[mid];
+    pNode->left = _imageLink(nodes, order, recOff, lo, mid);
+    pNode->right = _imageLink(nodes, order, recOff, mid + 1, hi);
+    return order[mid];
+}
+
+// used in BST_Load
+// return	1 if the mapped file is an image whose offsets all stay inside it, whose pool ends
+//			in NUL (records compared as strings stop inside it) and whose nodes form a tree
+//			of at most IMAGE_DEPTH levels (so every walk and search ends)
+static int _imageValid( const void *image, size_t size){
+    const IMAGE_HEADER *h = image;
+    if(size < sizeof(IMAGE_HEADER) || memcmp(h->magic, IMAGE_MAGIC, 8) != 0)
+        return 0;
+    if(h->nodeOff % 8 != 0 || h->poolOff % 8 != 0
+        || (uint64_t)h->nodeOff + (uint64_t)h->count * sizeof(IMAGE_NODE) > h->poolOff
+        || (uint64_t)h->poolOff + h->poolSize > size)
+        return 0;
+    if(h->count == 0) return 1;
+    if(h->poolSize == 0 || IMAGE_POOL(h)[h->poolSize - 1] != '\0')
+        return 0;
+
+    // both layouts place a child after its parent, so no link leads back up
+    const IMAGE_NODE *nodes = IMAGE_NODES(h);
+    for(uint32_t i = 0; i < h->count; i++){
+        if(nodes[i].left >= h->count || nodes[i].right >= h->count || nodes[i].rec >= h->poolSize)
+            return 0;
+        if((nodes[i].left != 0 && nodes[i].left <= i) || (nodes[i].right != 0 && nodes[i].right <= i))
+            return 0;
+    }
+
+    // preorder walk from the root; a pending right child waits on the level of its parent,
+    // so the stack never holds more than the depth
+    uint32_t stack[IMAGE_DEPTH];
+    int levels[IMAGE_DEPTH];
+    int top = 0, level = 1;
+    uint32_t i = 0, visited = 0;
+    while(1){
+        if(level > IMAGE_DEPTH || ++visited > h->count) return 0;
+        if(nodes[i].right != 0){
+            stack[top] = nodes[i].right;
+            levels[top++] = level + 1;
+        }
+        if(nodes[i].left != 0){
+            i = nodes[i].left;
+            level++;
+        }
+        else if(top > 0){
+            i = stack[--top];
+            level = levels[top];
+        }
+        else break;
+    }
+    return 1;
+}
+
+// used in BST_Search
+static void *_imageSearch( TREE *pTree, void *keyPtr){
+    IMAGE_HEADER *h = pTree->image;
+    IMAGE_NODE *nodes = IMAGE_NODES(h);
+    uint32_t i = 0;
+    if(h->count == 0) return NULL;
+    while(1){
+        void *rec = IMAGE_POOL(h) + nodes[i].rec;
+        int cmp = pTree->compare(keyPtr, rec);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0)
+            return rec;
+        i = (cmp < 0) ? nodes[i].left : nodes[i].right;
+        if(i == 0)
+            return NULL;
+        STAT_ADD(pTree, hops, 1);
+    }
+}
+
+// used in BST_Traverse, BST_TraverseR and printTree
+// in-order walk over the image with a fixed stack (the saved tree is balanced)
+// toRight 0: left-to-right, 1: right-to-left; withLevel prints a tab per level first
+static void _imageWalk( TREE *pTree, int toRight, int withLevel, void (*callback)(const void *)){
+    IMAGE_HEADER *h = pTree->image;
+    IMAGE_NODE *nodes = IMAGE_NODES(h);
+    uint32_t stack[IMAGE_DEPTH];
+    int levels[IMAGE_DEPTH];
+    int depth = 0;
+    int level = 1;
+    uint32_t i = 0;
+    int has = h->count > 0;
+
+    while(1){
+        while(has){
+            if(depth == IMAGE_DEPTH) return; // not an image _imageValid accepts
+            stack[depth] = i;
+            levels[depth++] = level++;
+            i = toRight ? nodes[i].right : nodes[i].left;
+            has = i != 0;
+        }
+        if(depth == 0) break;
+        i = stack[--depth];
+        level = levels[depth];
+        if(withLevel)
+            for(int j = 0; j < level; j++)
+                printf("\t");
+        callback(IMAGE_POOL(h) + nodes[i].rec);
+        i = toRight ? nodes[i].left : nodes[i].right;
+        has = i != 0;
+        level++;
+    }
+}
+
+// used in BST_Save
+// lays out header, nodes and the packed records of sorted[0..n) in one buffer
+// return	image (size in *sizeOut)
+//			NULL if overflow or the image exceeds 4 GB
+static char *_imageBuild( void **sorted, uint32_t *order, uint32_t *recOff, int n,
+    size_t (*pack)(const void *, void *), uint64_t *sizeOut){
+    // records first, so the size of the whole image is known
+    uint64_t poolSize = 0;
+    for(int i = 0; i < n; i++){
+        recOff[i] = (uint32_t)poolSize;
+        // 8-byte aligned; at least one NUL follows the last record, which _imageValid checks
+        poolSize += (pack(sorted[i], NULL) + (i == n - 1 ? 8 : 7)) & ~(size_t)7;
+        if(poolSize > UINT32_MAX) return NULL;
+    }
+    uint64_t nodeOff = sizeof(IMAGE_HEADER);
+    uint64_t poolOff = (nodeOff + sizeof(IMAGE_NODE) * (uint64_t)n + 7) & ~(uint64_t)7;
+    if(poolOff + poolSize > UINT32_MAX) return NULL;
+
+    char *image = calloc(1, poolOff + poolSize);
+    if(image == NULL) return NULL;
+
+    IMAGE_HEADER *h = (IMAGE_HEADER *)image;
+    memcpy(h->magic, IMAGE_MAGIC, 8);
+    h->count = n;
+    h->nodeOff = nodeOff;
+    h->poolOff = poolOff;
+    h->poolSize = poolSize;
+    _imageLink(IMAGE_NODES(h), order, recOff, 0, n);
+    for(int i = 0; i < n; i++)
+        pack(sorted[i], IMAGE_POOL(h) + recOff[i]);
+
+    *sizeOut = poolOff + poolSize;
+    return image;
+}
+
+/* Writes the tree to a binary image file that BST_Load maps back without deserialization
+	return	1 success
+			0 overflow or write error
+*/
+int BST_Save( TREE *pTree, const char *path, size_t (*pack)(const void *dataPtr, void *buf)){
+    int n = pTree->count;
+    if(pTree->image != NULL) return 0;
+
+    void **sorted = _sortedData(pTree);
+    uint32_t *order = _vebNumber(n);
+    uint32_t *recOff = malloc(sizeof(uint32_t) * (n ? n : 1));
+    char *image = NULL;
+    uint64_t size = 0;
+    if(sorted != NULL && order != NULL && recOff != NULL)
+        image = _imageBuild(sorted, order, recOff, n, pack, &size);
+    free(sorted);
+    free(order);
+    free(recOff);
+    if(image == NULL) return 0;
+
+    FILE *fp = fopen(path, "wb");
+    int ok = 0;
+    if(fp != NULL){
+        ok = fwrite(image, 1, size, fp) == size;
+        if(fclose(fp) != 0) ok = 0;
+    }
+    free(image);
+    return ok;
+}
+
+/* Maps an image written by BST_Save read-only into memory
+	return	head node pointer
+			NULL if the file cannot be mapped or is not an image
+*/
+TREE *BST_Load( const char *path, int (*compareRec)(const void *, const void *)){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0) return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(IMAGE_HEADER)){
+        close(fd);
+        return NULL;
+    }
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) return NULL;
+
+    TREE *pTree = NULL;
+    if(_imageValid(image, st.st_size))
+        pTree = BST_Create(compareRec);
+    if(pTree == NULL){
+        munmap(image, st.st_size);
+        return NULL;
+    }
+    pTree->image = image;
+    pTree->imageSize = st.st_size;
+    return pTree;
+}
+
+// used in BST_Rebalance
+// rotates the right spine of pseudo root into a vine (every left link NULL)
+static void _treeToVine( TREE *pTree, NODE *pseudo){
+    NODE *tail = pseudo;
+    NODE *rest = tail->right;
+    while(rest != NULL){
+        if(rest->left == NULL){
+            tail = rest;
+            rest = rest->right;
+        }
+        else{
+            rest = _rotateRight(pTree, rest);
+            tail->right = rest;
+        }
+    }
+}
+
+// used in BST_Rebalance
+// left-rotates every second node of the vine, count times
+static void _compress( TREE *pTree, NODE *pseudo, int count){
+    NODE *scanner = pseudo;
+    for(int i = 0; i < count; i++){
+        scanner->right = _rotateLeft(pTree, scanner->right);
+        scanner = scanner->right;
+    }
+}
+
+// used in BST_Rebalance (BST_TREAP)
+// gives every node a random priority from a band of its subtree size, where a random
+// treap would have the root of such a subtree: the bands of larger subtrees lie higher,
+// so every parent outranks its children and the heap order fits the new shape
+static void _reprioritize( TREE *pTree){
+    NODE *stack[2 * 32]; // the shape is height-optimal: at most one pending node per level
+    int depth = 0;
+    if(pTree->root != NULL) stack[depth++] = pTree->root;
+    while(depth > 0){
+        NODE *pNode = stack[--depth];
+        unsigned int lo = UINT_MAX - UINT_MAX / pNode->size;
+        unsigned int width = UINT_MAX / pNode->size - UINT_MAX / (pNode->size + 1);
+        pNode->priority = lo + (width ? _random(pTree) % width : 0);
+        if(pNode->right != NULL) stack[depth++] = pNode->right;
+        if(pNode->left != NULL) stack[depth++] = pNode->left;
+    }
+}
+
+/* Rebuilds the tree into a height-optimal shape in linear time without extra memory
+	(Day-Stout-Warren: flattens the tree into a right vine, then compresses it)
+*/
+void BST_Rebalance( TREE *pTree){
+    if(pTree->image != NULL) return;
+    BST_Thaw(pTree);
+    NODE pseudo;
+    int size = pTree->count;
+
+    pseudo.left = NULL;
+    pseudo.right = pTree->root;
+    _treeToVine(pTree, &pseudo);
+
+    // bottom level first, so the remaining vine is 2^k - 1 long
+    int full = 1;
+    while(full * 2 <= size + 1) full *= 2;
+    _compress(pTree, &pseudo, size + 1 - full);
+    for(size = full - 1; size > 1; size /= 2)
+        _compress(pTree, &pseudo, size / 2);
+
+    pTree->root = pseudo.right;
+    if(pTree->mode == BST_TREAP) _reprioritize(pTree);
+}
+
 /* Inserts new data into the tree
 	callback은 이미 트리에 존재하는 데이터를 발견했을 때 호출하는 함수
 	return	0 overflow
@@ -99,8 +1217,45 @@ void BST_Destroy( TREE *pTree, void (*callback)(void *)){
 			2 if duplicated key
 */
 int BST_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
+    if(pTree->image != NULL) return 0; // read-only
+    BST_Thaw(pTree);
     NODE * newNode = _makeNode(dataInPtr);
     if(newNode == NULL) return 0;
+    STAT_ADD(pTree, allocs, 1);
+
+    if(pTree->mode == BST_RCU){
+        pthread_mutex_lock(&pTree->writeLock);
+        int result = _rcuInsert(pTree, newNode, callback);
+        if(result == 1){
+            pTree->count++;
+            STAT_PEAK(pTree);
+        }
+        pthread_mutex_unlock(&pTree->writeLock);
+        if(result != 1) free(newNode);
+        return result;
+    }
+    if(pTree->mode == BST_SPLAY){
+        int result = _splayInsert(pTree, newNode, callback);
+        if(result != 1){
+            free(newNode);
+            return result;
+        }
+        pTree->count++;
+        STAT_PEAK(pTree);
+        return 1;
+    }
+    if(pTree->mode == BST_TREAP){
+        int result;
+        newNode->priority = _random(pTree);
+        pTree->root = _treapInsert(pTree, pTree->root, newNode, callback, &result);
+        if(result == 2){
+            free(newNode);
+            return 2;
+        }
+        pTree->count++;
+        STAT_PEAK(pTree);
+        return 1;
+    }
 
     NODE* pNode = pTree->root;
 
@@ -108,25 +1263,39 @@ int BST_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
     if(pTree->root == NULL){
         pTree->root = newNode;
         pTree->count++;
+        STAT_PEAK(pTree);
         return 1;
     }
     // non-empty tree
+    // the path is recorded so subtree sizes grow only when a node is really added
     int cmp;
+    int depth = 0;
     while(1){ // check free!
+        if(!_pathSet(pTree, depth++, pNode)){
+            free(newNode);
+            return 0;
+        }
         cmp = pTree->compare(newNode->dataPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
         if(cmp > 0){
             if(pNode->right == NULL){
                 pNode->right = newNode;
+                _pathResize(pTree, depth, 1);
                 pTree->count++;
+                STAT_PEAK(pTree);
                 return 1;
             } else pNode = pNode->right;
+            STAT_ADD(pTree, hops, 1);
         }
         else if(cmp < 0){
             if(pNode->left == NULL){
                 pNode->left = newNode;
+                _pathResize(pTree, depth, 1);
                 pTree->count++;
+                STAT_PEAK(pTree);
                 return 1;
             } else pNode = pNode->left;
+            STAT_ADD(pTree, hops, 1);
         }
         else{
             callback(pNode->dataPtr);
@@ -141,29 +1310,48 @@ int BST_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
 			NULL not found
 */
 void *BST_Delete( TREE *pTree, void *keyPtr){ // check free when you delete it.
+    if(pTree->image != NULL) return NULL; // read-only
+    BST_Thaw(pTree);
+    if(pTree->mode == BST_TREAP)
+        return _treapDelete(pTree, keyPtr);
+    if(pTree->mode == BST_SPLAY)
+        return _splayDelete(pTree, keyPtr);
+    if(pTree->mode == BST_RCU){
+        pthread_mutex_lock(&pTree->writeLock);
+        void *out = _rcuDelete(pTree, keyPtr);
+        pthread_mutex_unlock(&pTree->writeLock);
+        return out;
+    }
+
     NODE* pPre = NULL;
     NODE* pNode = pTree->root;
     NODE* out = NULL;
     int cmp;
+    int depth = 0; // ancestors recorded in the path buffer
     while(pNode != NULL){
         cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
 
         if(cmp == 0) {
             out = pNode->dataPtr;
+            _pathResize(pTree, depth, -1);
 
             if(pNode->left != NULL && pNode->right != NULL){ // case1. both r and l have a child.
                 NODE* min= pNode->right;
                 NODE* minPre = pNode;
+                pNode->size--;
                 while(min->left != NULL){
+                    min->size--;
                     minPre = min;
                     min = min->left;
+                    STAT_ADD(pTree, hops, 1);
                 }
                 pNode->dataPtr = min->dataPtr;
                 if(minPre->left == min)
                     minPre->left = min->right;
                 else
                     minPre->right = min->right;
-                free(min);
+                _freeNode(pTree, min);
             }
             else if (pNode->left == NULL && pNode->right == NULL) { // case2. leaf node
                 if (pPre == NULL) {
@@ -173,7 +1361,7 @@ void *BST_Delete( TREE *pTree, void *keyPtr){ // check free when you delete it.
                 } else {
                     pPre->right = NULL;
                 }
-                free(pNode);
+                _freeNode(pTree, pNode);
             } else { // case3. one child
                 NODE *child = (pNode->left != NULL) ? pNode->left : pNode->right;
                 if (pPre == NULL) {
@@ -183,12 +1371,13 @@ void *BST_Delete( TREE *pTree, void *keyPtr){ // check free when you delete it.
                 } else {
                     pPre->right = child;
                 }
-                free(pNode);
+                _freeNode(pTree, pNode);
             }
             pTree->count--;
             return out;
         }
-        else if(cmp > 0){
+        if(!_pathSet(pTree, depth++, pNode)) return NULL;
+        if(cmp > 0){
             pPre = pNode;
             pNode = pNode->right;
         }
@@ -196,50 +1385,658 @@ void *BST_Delete( TREE *pTree, void *keyPtr){ // check free when you delete it.
             pPre = pNode;
             pNode = pNode->left;
         }
+        STAT_ADD(pTree, hops, 1);
     }
     return NULL;
 }
 
+/* Waits until every BST_Search started before the call has returned (BST_RCU)
+	then frees the nodes deleted so far
+*/
+void BST_Synchronize( TREE *pTree){
+    if(pTree->mode != BST_RCU) return;
+    pthread_mutex_lock(&pTree->writeLock);
+    _rcuReclaim(pTree);
+    pthread_mutex_unlock(&pTree->writeLock);
+}
+
 /* Retrieve tree for the node containing the requested key (keyPtr)
 	return	address of data of the node containing the key
 			NULL not found
 */
 void *BST_Search( TREE *pTree, void *keyPtr){
+    if(pTree->image != NULL)
+        return _imageSearch(pTree, keyPtr);
+    if(pTree->mode == BST_RCU)
+        return _rcuSearch(pTree, keyPtr);
+    if(pTree->frozen != NULL)
+        return _frozenSearch(pTree, keyPtr);
+    if(pTree->mode == BST_SPLAY)
+        return (_splaySearch(pTree, &pTree->root, keyPtr) == 1) ? pTree->root->dataPtr : NULL;
+
     NODE* pNode = pTree->root;
     int cmp;
     while(pNode != NULL){
         cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
         if(cmp == 0){
             return pNode->dataPtr;
         }
         else if(cmp > 0) pNode = pNode->right;
         else pNode = pNode->left;
+        STAT_ADD(pTree, hops, 1);
     }
     return NULL;
 }
 
 /* prints tree using inorder traversal
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void BST_Traverse( TREE *pTree, void (*callback)(const void *)){
-    _traverse(pTree->root, callback);
+int BST_Traverse( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL){
+        _imageWalk(pTree, 0, 0, callback);
+        return 1;
+    }
+    return _traverse(pTree, callback);
 }
 
 /* prints tree using right-to-left inorder traversal
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void BST_TraverseR( TREE *pTree, void (*callback)(const void *)){
-    _traverseR(pTree->root, callback);
+int BST_TraverseR( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL){
+        _imageWalk(pTree, 1, 0, callback);
+        return 1;
+    }
+    return _traverseR(pTree, callback);
 }
 
 /* Print tree using right-to-left inorder traversal with level
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void printTree( TREE *pTree, void (*callback)(const void *)){
-    int level = 0;
-    _inorder_print(pTree->root, level, callback);
+int printTree( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL){
+        _imageWalk(pTree, 1, 1, callback);
+        return 1;
+    }
+    return _inorder_print(pTree, callback);
 }
 
 /* returns number of nodes in tree
 */
 int BST_Count( TREE *pTree){
+    if(pTree->image != NULL)
+        return ((IMAGE_HEADER *)pTree->image)->count;
     return pTree->count;
 }
 
+/* returns height of the tree
+			-1 if overflow
+*/
+int BST_Height( TREE *pTree){
+    // every node is on top of the iterator path once; its path length is its depth
+    BST_ITER *pIter = BST_IterCreate(pTree);
+    int height = 0;
+    if(pIter == NULL) return -1;
+    while(pIter->depth > 0 && !pIter->failed){
+        if(pIter->depth > height) height = pIter->depth;
+        BST_IterNext(pIter);
+    }
+    if(pIter->failed) height = -1;
+    BST_IterDestroy(pIter);
+    return height;
+}
+
+/* returns operation counters of the tree
+	all zero if not compiled with -DADT_STATS
+*/
+TREE_STATS BST_Stats( TREE *pTree){
+#ifdef ADT_STATS
+    return pTree->stats;
+#else
+    (void)pTree;
+    return (TREE_STATS){0};
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// iterator
+
+#define prefetch(p)	__builtin_prefetch(p)
+
+// internal function
+// appends node to the iterator path
+// return	0 if overflow
+static int _iterPush( BST_ITER *pIter, NODE *pNode){
+    if(pIter->depth == pIter->capacity){
+        int capacity = pIter->capacity * 2;
+        NODE **path = realloc(pIter->path, sizeof(NODE *) * capacity);
+        if(path == NULL) return 0;
+        pIter->path = path;
+        pIter->capacity = capacity;
+    }
+    pIter->path[pIter->depth++] = pNode;
+    return 1;
+}
+
+// internal function
+// prefetches what the consumer touches next: the data of the node after the cursor
+// and the subtree the following step descends into
+static void _iterPrefetch( BST_ITER *pIter){
+    if(pIter->depth == 0) return;
+    NODE *pNode = pIter->path[pIter->depth - 1];
+    prefetch(pNode->dataPtr);
+    if(pNode->right != NULL) prefetch(pNode->right);
+    if(pNode->left != NULL) prefetch(pNode->left);
+}
+
+// internal function
+// pushes root and its left (or right) spine; sets failed if the path cannot grow
+static void _iterSpine( BST_ITER *pIter, NODE *root, int toRight){
+    while(root != NULL){
+        if(!_iterPush(pIter, root)){
+            pIter->failed = 1;
+            return;
+        }
+        NODE *child = toRight ? root->right : root->left;
+        if(child != NULL) prefetch(child);
+        root = child;
+    }
+}
+
+/* Allocates an iterator positioned before the first node
+	return	iterator pointer
+			NULL if overflow
+*/
+BST_ITER *BST_IterCreate( TREE *pTree){
+    BST_ITER *pIter = malloc(sizeof(BST_ITER));
+    if(pIter == NULL) return NULL;
+    pIter->capacity = 32;
+    pIter->path = malloc(sizeof(NODE *) * pIter->capacity);
+    if(pIter->path == NULL){
+        free(pIter);
+        return NULL;
+    }
+    pIter->pTree = pTree;
+    BST_IterBegin(pIter);
+    return pIter;
+}
+
+/* recycles memory of the iterator
+*/
+void BST_IterDestroy( BST_ITER *pIter){
+    free(pIter->path);
+    free(pIter);
+}
+
+/* positions the iterator before the first node
+*/
+void BST_IterBegin( BST_ITER *pIter){
+    pIter->depth = 0;
+    pIter->failed = 0;
+    _iterSpine(pIter, pIter->pTree->root, 0);
+    _iterPrefetch(pIter);
+}
+
+/* positions the iterator after the last node (for BST_IterPrev)
+*/
+void BST_IterEnd( BST_ITER *pIter){
+    pIter->depth = 0;
+    pIter->failed = 0;
+}
+
+/* positions the iterator before the first node whose data is not less than keyPtr
+	sets pIter->failed if overflow
+*/
+void BST_IterSeek( BST_ITER *pIter, void *keyPtr){
+    NODE *pNode = pIter->pTree->root;
+    int found = 0; // path length up to the smallest node not less than key
+
+    pIter->depth = 0;
+    pIter->failed = 0;
+    while(pNode != NULL){
+        if(!_iterPush(pIter, pNode)){
+            pIter->failed = 1;
+            break;
+        }
+        int cmp = pIter->pTree->compare(keyPtr, pNode->dataPtr);
+        if(cmp == 0){
+            found = pIter->depth;
+            break;
+        }
+        if(cmp < 0){
+            found = pIter->depth;
+            pNode = pNode->left;
+        }
+        else pNode = pNode->right;
+    }
+    pIter->depth = found;
+    _iterPrefetch(pIter);
+}
+
+/* returns data after the cursor and moves the cursor forward
+			NULL if at the end or pIter->failed (overflow)
+*/
+void *BST_IterNext( BST_ITER *pIter){
+    if(pIter->depth == 0 || pIter->failed) return NULL;
+
+    NODE *pNode = pIter->path[pIter->depth - 1];
+    if(pNode->right != NULL)
+        _iterSpine(pIter, pNode->right, 0);
+    else{
+        // climb while coming up from a right child
+        int i = pIter->depth - 1;
+        while(i > 0 && pIter->path[i - 1]->right == pIter->path[i]) i--;
+        pIter->depth = i;
+    }
+    _iterPrefetch(pIter);
+    return pNode->dataPtr;
+}
+
+/* returns data before the cursor and moves the cursor backward
+			NULL if at the beginning or pIter->failed (overflow)
+*/
+void *BST_IterPrev( BST_ITER *pIter){
+    if(pIter->failed) return NULL;
+    if(pIter->depth == 0)
+        _iterSpine(pIter, pIter->pTree->root, 1);
+    else{
+        NODE *pNode = pIter->path[pIter->depth - 1];
+        if(pNode->left != NULL)
+            _iterSpine(pIter, pNode->left, 1);
+        else{
+            // climb while coming up from a left child
+            int i = pIter->depth - 1;
+            while(i > 0 && pIter->path[i - 1]->left == pIter->path[i]) i--;
+            if(i == 0) return NULL; // already at the beginning
+            pIter->depth = i;
+        }
+    }
+    if(pIter->depth == 0 || pIter->failed) return NULL; // empty tree or overflow
+
+    _iterPrefetch(pIter);
+    return pIter->path[pIter->depth - 1]->dataPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// batch search
+
+#define BATCH_LANES	16	// lookups in flight at once
+
+/* Searches keys[0..n-1] and stores the data found (NULL if none) in out[0..n-1]
+*/
+void BST_SearchBatch( TREE *pTree, void *keys[], int n, void *out[]){
+    if(pTree->image != NULL || pTree->mode == BST_RCU || pTree->frozen != NULL
+        || pTree->mode == BST_SPLAY || pTree->root == NULL){
+        for(int i = 0; i < n; i++)
+            out[i] = BST_Search(pTree, keys[i]);
+        return;
+    }
+
+    // each lane walks down for one key in two steps per level: the node has been
+    // prefetched, so read it and prefetch its data; the data has been prefetched, so
+    // compare and prefetch the child; a lane whose key is done takes the next key
+    NODE *node[BATCH_LANES];
+    int key[BATCH_LANES], hasData[BATCH_LANES];
+    int lanes = (n < BATCH_LANES) ? n : BATCH_LANES, next = lanes, active = lanes;
+    for(int l = 0; l < lanes; l++){
+        node[l] = pTree->root;
+        key[l] = l;
+        hasData[l] = 0;
+    }
+
+    while(active > 0){
+        for(int l = 0; l < lanes; l++){
+            if(key[l] < 0) continue;
+            NODE *pNode = node[l];
+            if(!hasData[l]){
+                prefetch(pNode->dataPtr);
+                hasData[l] = 1;
+                continue;
+            }
+            int cmp = pTree->compare(keys[key[l]], pNode->dataPtr);
+            STAT_ADD(pTree, compares, 1);
+            NODE *child = (cmp > 0) ? pNode->right : pNode->left;
+            hasData[l] = 0;
+            if(cmp != 0 && child != NULL){
+                STAT_ADD(pTree, hops, 1);
+                prefetch(child);
+                node[l] = child;
+                continue;
+            }
+            out[key[l]] = (cmp == 0) ? pNode->dataPtr : NULL;
+            if(next < n){
+                key[l] = next++;
+                node[l] = pTree->root;
+            }
+            else{
+                key[l] = -1;
+                active--;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// order statistics
+
+/* returns the k-th smallest data (1 <= k <= count) in O(height)
+			NULL if k is out of range
+*/
+void *BST_Select( TREE *pTree, int k){
+    NODE *pNode = pTree->root;
+    if(k < 1 || k > pTree->count) return NULL;
+
+    while(pNode != NULL){
+        int leftSize = _size(pNode->left);
+        if(k == leftSize + 1) return pNode->dataPtr;
+        if(k <= leftSize) pNode = pNode->left;
+        else{
+            k -= leftSize + 1;
+            pNode = pNode->right;
+        }
+        STAT_ADD(pTree, hops, 1);
+    }
+    return NULL;
+}
+
+// internal function
+// return	number of data less than keyPtr (less than or equal if inclusive)
+static int _countLess( TREE *pTree, void *keyPtr, int inclusive){
+    NODE *pNode = pTree->root;
+    int count = 0;
+
+    while(pNode != NULL){
+        int cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp > 0 || (cmp == 0 && inclusive)){
+            count += _size(pNode->left) + 1;
+            if(cmp == 0) break;
+            pNode = pNode->right;
+        }
+        else if(cmp == 0){
+            count += _size(pNode->left);
+            break;
+        }
+        else pNode = pNode->left;
+        STAT_ADD(pTree, hops, 1);
+    }
+    return count;
+}
+
+/* returns rank (1-based position in sorted order) of keyPtr in O(height)
+	if the key is not in the tree, the position it would get when inserted
+*/
+int BST_Rank( TREE *pTree, void *keyPtr){
+    return _countLess(pTree, keyPtr, 0) + 1;
+}
+
+/* returns number of data in [loPtr, hiPtr] in O(height)
+*/
+int BST_RangeCount( TREE *pTree, void *loPtr, void *hiPtr){
+    if(pTree->compare(loPtr, hiPtr) > 0) return 0;
+    return _countLess(pTree, hiPtr, 1) - _countLess(pTree, loPtr, 0);
+}
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+	visits only the nodes in range (plus one root-to-leaf path)
+*/
+void BST_RangeTraverse( TREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    BST_ITER *pIter = BST_IterCreate(pTree);
+    void *dataPtr;
+    if(pIter == NULL) return;
+
+    BST_IterSeek(pIter, loPtr);
+    while((dataPtr = BST_IterNext(pIter)) != NULL && pTree->compare(dataPtr, hiPtr) <= 0)
+        callback(dataPtr);
+    BST_IterDestroy(pIter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// parallel build
+
+#define MAX_THREADS		64
+#define SAMPLES_PER_PART	32
+
+// work of one thread in BST_ParallelBuild
+typedef struct
+{
+    int		id;
+    int		nThreads;
+    void	**dataArr;
+    int		n;
+    unsigned char	*part;	// partition of each data (read-only while building)
+    unsigned char	*inserted;	// 1 once the data is in a subtree (written by its owner only)
+    void	**splitters;	// nThreads - 1 ascending keys
+    TREE	*pTree;	// subtree of partition id
+    void	(*callback)(void *);
+    int		ok;
+    int		*bucket;	// indices of dataArr grouped by partition, in input order within each
+    int		slot[MAX_THREADS];	// data of this slice per partition, then their first place in bucket
+    int		lo, hi;	// bucket[lo..hi) is partition id (nThreads 1: all of dataArr)
+} BUILD_TASK;
+
+// used in BST_ParallelBuild
+// destroy callback that leaves the data to the caller
+static void _keepData( void *dataPtr){
+    (void)dataPtr;
+}
+
+// used in _routeWorker
+// return	partition of data: number of splitters not greater than it
+static int _route( BUILD_TASK *pTask, void *dataPtr){
+    int lo = 0, hi = pTask->nThreads - 1;
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(pTask->pTree->compare(dataPtr, pTask->splitters[mid]) < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// used in BST_ParallelBuild (first phase)
+// routes the id-th slice of dataArr to partitions and counts the data of each
+static void *_routeWorker( void *arg){
+    BUILD_TASK *pTask = arg;
+    int lo = (int)((long long)pTask->n * pTask->id / pTask->nThreads);
+    int hi = (int)((long long)pTask->n * (pTask->id + 1) / pTask->nThreads);
+    for(int i = lo; i < hi; i++){
+        pTask->part[i] = _route(pTask, pTask->dataArr[i]);
+        pTask->slot[pTask->part[i]]++;
+    }
+    return NULL;
+}
+
+// used in BST_ParallelBuild (second phase)
+// places the indices of the id-th slice in the buckets of their partitions
+static void *_scatterWorker( void *arg){
+    BUILD_TASK *pTask = arg;
+    int lo = (int)((long long)pTask->n * pTask->id / pTask->nThreads);
+    int hi = (int)((long long)pTask->n * (pTask->id + 1) / pTask->nThreads);
+    for(int i = lo; i < hi; i++)
+        pTask->bucket[pTask->slot[pTask->part[i]]++] = i;
+    return NULL;
+}
+
+// used in BST_ParallelBuild (third phase)
+// inserts every data of partition id into the subtree owned by this thread
+static void *_buildWorker( void *arg){
+    BUILD_TASK *pTask = arg;
+    pTask->ok = 1;
+    for(int k = pTask->lo; k < pTask->hi; k++){
+        int i = (pTask->nThreads > 1) ? pTask->bucket[k] : k;
+        int result = BST_Insert(pTask->pTree, pTask->dataArr[i], pTask->callback);
+        if(result == 0){
+            pTask->ok = 0;
+            return NULL;
+        }
+        if(result == 1) pTask->inserted[i] = 1;
+    }
+    return NULL;
+}
+
+// used in _join
+// merges two treaps where every key of a is less than every key of b
+// return	pointer to root
+static NODE *_treapMerge( NODE *a, NODE *b){
+    if(a == NULL) return b;
+    if(b == NULL) return a;
+    if(a->priority > b->priority){
+        a->right = _treapMerge(a->right, b);
+        a->size = _size(a->left) + _size(a->right) + 1;
+        return a;
+    }
+    b->left = _treapMerge(a, b->left);
+    b->size = _size(b->left) + _size(b->right) + 1;
+    return b;
+}
+
+// used in _stitch
+// joins two trees where every key of a is less than every key of b
+// the maximum of a becomes the new root (treaps are merged by priority instead)
+// return	pointer to root
+static NODE *_join( int mode, NODE *a, NODE *b){
+    if(a == NULL) return b;
+    if(b == NULL) return a;
+    if(mode == BST_TREAP) return _treapMerge(a, b);
+
+    NODE **link = &a;
+    while((*link)->right != NULL){
+        (*link)->size--;
+        link = &(*link)->right;
+    }
+    NODE *pivot = *link;
+    *link = pivot->left;
+    pivot->left = a;
+    pivot->right = b;
+    pivot->size = _size(a) + _size(b) + 1;
+    return pivot;
+}
+
+// used in BST_ParallelBuild
+// joins the subtrees of partitions [lo, hi) pairwise, so stitching adds O(log P) levels
+// return	pointer to root
+static NODE *_stitch( BUILD_TASK *tasks, int lo, int hi){
+    if(hi - lo == 1) return tasks[lo].pTree->root;
+    int mid = (lo + hi) / 2;
+    NODE *left = _stitch(tasks, lo, mid);
+    NODE *right = _stitch(tasks, mid, hi);
+    return _join(tasks[lo].pTree->mode, left, right);
+}
+
+// used in BST_ParallelBuild
+// sorts the samples by insertion (there are only a few hundred)
+static void _sortSamples( void **samples, int n, int (*compare)(const void *, const void *)){
+    for(int i = 1; i < n; i++){
+        void *key = samples[i];
+        int j = i - 1;
+        while(j >= 0 && compare(samples[j], key) > 0){
+            samples[j + 1] = samples[j];
+            j--;
+        }
+        samples[j + 1] = key;
+    }
+}
+
+/* Builds a tree from n data in any order with nThreads threads
+	return	head node pointer
+			NULL if overflow
+*/
+TREE *BST_ParallelBuild( int (*compare)(const void *, const void *), int mode, void *dataArr[], int n,
+    int nThreads, void (*callback)(void *)){
+    if(nThreads < 1) nThreads = 1;
+    if(nThreads > MAX_THREADS) nThreads = MAX_THREADS;
+    if(n < nThreads * SAMPLES_PER_PART) nThreads = 1; // not worth the threads
+
+    TREE *pTree = BST_CreateMode(compare, mode);
+    unsigned char *part = calloc(2, n ? n : 1);
+    int *bucket = (nThreads > 1) ? malloc(sizeof(int) * n) : NULL;
+    if(pTree == NULL || part == NULL || (nThreads > 1 && bucket == NULL)){
+        free(part);
+        free(bucket);
+        if(pTree != NULL) BST_Destroy(pTree, _keepData);
+        return NULL;
+    }
+
+    // splitters from an evenly spaced sample, so partitions get about the same number of tokens
+    void *samples[MAX_THREADS * SAMPLES_PER_PART];
+    void *splitters[MAX_THREADS];
+    int numSamples = nThreads * SAMPLES_PER_PART;
+    if(nThreads > 1){
+        for(int i = 0; i < numSamples; i++)
+            samples[i] = dataArr[(long long)n * i / numSamples];
+        _sortSamples(samples, numSamples, compare);
+        for(int i = 0; i < nThreads - 1; i++)
+            splitters[i] = samples[(i + 1) * SAMPLES_PER_PART];
+    }
+
+    BUILD_TASK tasks[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int ok = 1;
+    for(int t = 0; t < nThreads; t++){
+        tasks[t] = (BUILD_TASK){t, nThreads, dataArr, n, part, part + n, splitters, NULL, callback, 0, bucket, {0}, 0, 0};
+        tasks[t].pTree = BST_CreateMode(compare, mode);
+        if(tasks[t].pTree == NULL) ok = 0;
+        else tasks[t].pTree->seed ^= (t + 1) * 2654435761u; // independent treap priorities
+    }
+
+    tasks[0].hi = n; // everything in partition 0 unless routed
+
+    // phase 1: route slices of the input in parallel
+    // phase 2: scatter the indices of each slice into per-partition buckets (counting sort)
+    // phase 3: each thread inserts its own bucket into its own subtree
+    void *(*phases[3])(void *) = { _routeWorker, _scatterWorker, _buildWorker};
+    for(int phase = 0; phase < 3 && ok; phase++){
+        if(nThreads == 1 && phase < 2) continue;
+        if(phase == 1){
+            // prefix sum over partitions, then slices, so each bucket keeps the input order
+            int next = 0;
+            for(int p = 0; p < nThreads; p++){
+                tasks[p].lo = next;
+                for(int t = 0; t < nThreads; t++){
+                    int size = tasks[t].slot[p];
+                    tasks[t].slot[p] = next;
+                    next += size;
+                }
+                tasks[p].hi = next;
+            }
+        }
+        int started = 0;
+        for(; started < nThreads; started++)
+            if(pthread_create(&threads[started], NULL, phases[phase], &tasks[started]) != 0) break;
+        for(int t = 0; t < started; t++)
+            pthread_join(threads[t], NULL);
+        if(started < nThreads) ok = 0;
+        for(int t = 0; phase == 2 && t < nThreads; t++)
+            if(!tasks[t].ok) ok = 0;
+    }
+
+    if(ok){
+        pTree->root = _stitch(tasks, 0, nThreads);
+        for(int t = 0; t < nThreads; t++){
+            pTree->count += tasks[t].pTree->count;
+#ifdef ADT_STATS
+            pTree->stats.compares += tasks[t].pTree->stats.compares;
+            pTree->stats.hops += tasks[t].pTree->stats.hops;
+            pTree->stats.rotations += tasks[t].pTree->stats.rotations;
+            pTree->stats.allocs += tasks[t].pTree->stats.allocs;
+#endif
+            tasks[t].pTree->root = NULL; // the nodes now belong to pTree
+        }
+        STAT_PEAK(pTree);
+        for(int i = 0; i < n; i++)
+            if(part[n + i]) dataArr[i] = NULL;
+    }
+    for(int t = 0; t < nThreads; t++)
+        if(tasks[t].pTree != NULL) BST_Destroy(tasks[t].pTree, _keepData);
+    free(part);
+    free(bucket);
+    if(!ok){
+        BST_Destroy(pTree, _keepData);
+        return NULL;
+    }
+    return pTree;
+}
@@ -1,3 +1,7 @@
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t
+#include <pthread.h> // pthread_mutex_t
+
 ////////////////////////////////////////////////////////////////////////////////
 // TREE type definition
 typedef struct node
@@ -5,15 +9,72 @@ typedef struct node
 	void *dataPtr;
 	struct node	*left;
 	struct node	*right;
+	unsigned int	priority; // random heap priority (BST_TREAP)
+	int		size;	// number of nodes in the subtree rooted here
 } NODE;
 
+// balancing modes (see BST_CreateMode)
+#define BST_PLAIN	0 // unbalanced insertion
+#define BST_TREAP	1 // randomized treap, expected depth O(log n) for any input order
+#define BST_SPLAY	2 // splay tree, insert hits and searches move the node to the root
+#define BST_RCU		3 // unbalanced, BST_Search runs lock-free in any thread beside the writers
+
+// node of the read-only copy made by BST_Freeze (24 bytes)
+// nodes are stored in van Emde Boas order; index 0 is the root, so 0 also means no child
+typedef struct
+{
+	uint64_t	prefix;		// first 8 bytes of the key, big-endian, zero padded
+	uint32_t	left;		// array index of the left child, 0 if none
+	uint32_t	right;
+	void		*dataPtr;
+} FROZEN_NODE;
+
+// operation counters (compiled in only with -DADT_STATS)
+typedef struct
+{
+	long	compares;	// comparator calls
+	long	hops;		// pointer hops (child links followed)
+	long	rotations;	// rotations
+	long	allocs;		// node allocations
+	int		peak;		// peak node count
+} TREE_STATS;
+
 typedef struct
 {
 	int		count;
 	NODE	*root;
 	int		(*compare)(const void *, const void *); 
+	int		mode;	// BST_PLAIN, BST_TREAP, BST_SPLAY, BST_RCU
+	unsigned int	seed;	// random state for node priorities
+	NODE	*block;	// contiguous node array from BST_BuildFromSorted (freed in BST_Destroy)
+	int		blockSize;
+	NODE	**path;	// access path buffer
+	int		pathCap;
+	FROZEN_NODE	*frozen;	// read-only copy used by BST_Search, NULL if not frozen
+	const char	*(*getKey)(const void *);	// key bytes of data for the frozen prefixes
+	void	*image;	// file mapped by BST_Load (read-only tree), NULL otherwise
+	size_t	imageSize;
+	pthread_mutex_t	writeLock;	// serializes BST_Insert and BST_Delete (BST_RCU)
+	NODE	**limbo;	// nodes deleted but maybe still read by searches (BST_RCU)
+	int		limboCount;
+	int		limboCap;
+#ifdef ADT_STATS
+	TREE_STATS	stats;
+#endif
 } TREE;
 
+// external iterator (in-order cursor)
+// the cursor sits between two nodes; BST_IterNext/BST_IterPrev return the data after/before it
+// any insertion or deletion invalidates the iterator
+typedef struct
+{
+	TREE	*pTree;
+	NODE	**path;		// path from root to the node after the cursor
+	int		depth;		// length of path, 0 if the cursor is at the end
+	int		capacity;
+	int		failed;		// 1 if path could not grow; cleared by Begin, End and Seek
+} BST_ITER;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Prototype declarations
 
@@ -23,6 +84,81 @@ typedef struct
 */
 TREE *BST_Create( int (*compare)(const void *, const void *));
 
+/* same as BST_Create with a balancing mode (BST_PLAIN, BST_TREAP, BST_SPLAY, BST_RCU)
+	in BST_RCU mode BST_Search may run in any number of threads while other threads call
+	BST_Insert and BST_Delete: searches take no lock and writers publish each change with a
+	single atomic pointer store; deleted nodes are freed only after every search that could
+	still see them has returned (see BST_Synchronize)
+	every other function needs the tree to be quiet, and BST_Freeze fails in this mode
+	return	head node pointer
+			NULL if overflow or unknown mode
+*/
+TREE *BST_CreateMode( int (*compare)(const void *, const void *), int mode);
+
+/* Builds a height-optimal tree from n data sorted in ascending order without duplicates
+	all nodes are allocated at once as a contiguous array
+	return	head node pointer
+			NULL if overflow or dataArr is not strictly ascending
+*/
+TREE *BST_BuildFromSorted( int (*compare)(const void *, const void *), void *dataArr[], int n);
+
+/* Rebuilds the tree into a height-optimal shape in linear time without extra memory
+	(Day-Stout-Warren: flattens the tree into a right vine, then compresses it)
+	a treap gets new priorities in heap order for the new shape
+*/
+void BST_Rebalance( TREE *pTree);
+
+/* Builds a tree from n data in any order with nThreads threads (BST_PLAIN, BST_TREAP, BST_SPLAY)
+	the data are routed by splitters sampled from dataArr to nThreads key ranges; each
+	thread inserts its range into a subtree of its own, and the subtrees are then joined
+	in key order, so the result is one ordinary tree (traversal and search as usual)
+	callback is called with the stored data on a duplicated key, by the thread owning its
+	range (so it never runs concurrently for the same data)
+	inserted data are set to NULL in dataArr; what is left (duplicates) belongs to the caller
+	return	head node pointer
+			NULL if overflow (dataArr is unchanged, callback may have been called)
+*/
+TREE *BST_ParallelBuild( int (*compare)(const void *, const void *), int mode, void *dataArr[], int n,
+	int nThreads, void (*callback)(void *));
+
+/* Copies the tree into one contiguous array in van Emde Boas order for BST_Search
+	each node keeps the first 8 bytes of getKey(data) inline, so most comparisons on the
+	search path need neither the data nor the comparator; compare must order data like
+	strcmp on getKey (getKey may be NULL: no prefixes, every step calls compare)
+	the pointer tree stays as it is for the other functions; BST_Insert, BST_Delete and
+	BST_Rebalance thaw the tree first, and splay mode does not restructure frozen searches
+	return	1 success
+			0 overflow (the tree stays mutable)
+*/
+int BST_Freeze( TREE *pTree, const char *(*getKey)(const void *));
+
+/* Releases the frozen copy; BST_Search uses the pointer tree again
+*/
+void BST_Thaw( TREE *pTree);
+
+/* Writes the tree to a binary image file that BST_Load maps back without deserialization
+	pack copies data into a pointer-free record at buf and returns its size in bytes
+	(with buf NULL it only returns the size); records are stored in sorted order in a
+	pool, and the nodes of a balanced tree over them (van Emde Boas order) link to each
+	other and to the records by 32-bit offsets, so the file works at any address
+	the image keeps the records, not the shape of the tree: printTree of a loaded image
+	shows the balanced tree
+	return	1 success
+			0 overflow, write error or the image exceeds 4 GB
+*/
+int BST_Save( TREE *pTree, const char *path, size_t (*pack)(const void *dataPtr, void *buf));
+
+/* Maps an image written by BST_Save read-only into memory
+	compareRec compares a search key (as passed to BST_Search) with a stored record
+	the tree serves BST_Search, BST_Traverse, BST_TraverseR, printTree and BST_Count straight
+	from the mapping, and their results are pointers to the records; BST_Insert returns 0,
+	BST_Delete NULL, the other functions see an empty tree
+	BST_Destroy unmaps the file without calling its callback on the records
+	return	head node pointer
+			NULL if the file cannot be mapped or is not an image
+*/
+TREE *BST_Load( const char *path, int (*compareRec)(const void *, const void *));
+
 /* Deletes all data in tree and recycles memory
 */
 void BST_Destroy( TREE *pTree, void (*callback)(void *));
@@ -41,25 +177,109 @@ int BST_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *));
 */
 void *BST_Delete( TREE *pTree, void *keyPtr);
 
+/* Waits until every BST_Search started before the call has returned (BST_RCU)
+	then frees the nodes deleted so far (BST_Delete frees them in batches anyway)
+	data returned by BST_Delete may be read by concurrent searches until this returns
+*/
+void BST_Synchronize( TREE *pTree);
+
 /* Retrieve tree for the node containing the requested key (keyPtr)
+	in BST_SPLAY mode the search restructures the tree (and invalidates iterators)
 	return	address of data of the node containing the key
 			NULL not found
 */
 void *BST_Search( TREE *pTree, void *keyPtr);
 
+/* Searches keys[0..n-1] like BST_Search and stores the results in out[0..n-1]
+	up to 16 lookups advance in turns, each prefetching its next node and that node's
+	data a turn before using them, so their cache misses overlap instead of stalling one
+	after another; splay and RCU modes, frozen trees and mapped images search one key
+	at a time
+*/
+void BST_SearchBatch( TREE *pTree, void *keys[], int n, void *out[]);
+
 /* prints tree using inorder traversal
+	the walk keeps its own stack, so walks may nest in callbacks and run in several threads
+	at once; the tree must not change while it is walked
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void BST_Traverse( TREE *pTree, void (*callback)(const void *));
+int BST_Traverse( TREE *pTree, void (*callback)(const void *));
 
 /* prints tree using right-to-left inorder traversal
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void BST_TraverseR( TREE *pTree, void (*callback)(const void *));
+int BST_TraverseR( TREE *pTree, void (*callback)(const void *));
 
 /* Print tree using right-to-left inorder traversal with level
+	return	1 success
+			0 overflow (the callback has seen only part of the data)
 */
-void printTree( TREE *pTree, void (*callback)(const void *));
+int printTree( TREE *pTree, void (*callback)(const void *));
 
 /* returns number of nodes in tree
 */
 int BST_Count( TREE *pTree);
 
+/* returns height of the tree
+			-1 if overflow
+*/
+int BST_Height( TREE *pTree);
+
+/* returns the k-th smallest data (1 <= k <= count) in O(height)
+			NULL if k is out of range
+*/
+void *BST_Select( TREE *pTree, int k);
+
+/* returns rank (1-based position in sorted order) of keyPtr in O(height)
+	if the key is not in the tree, the position it would get when inserted
+*/
+int BST_Rank( TREE *pTree, void *keyPtr);
+
+/* returns number of data in [loPtr, hiPtr] in O(height)
+*/
+int BST_RangeCount( TREE *pTree, void *loPtr, void *hiPtr);
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+	visits only the nodes in range (plus one root-to-leaf path)
+*/
+void BST_RangeTraverse( TREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *));
+
+/* returns operation counters of the tree
+	all zero if not compiled with -DADT_STATS
+*/
+TREE_STATS BST_Stats( TREE *pTree);
+
+/* Allocates an iterator positioned before the first node
+	return	iterator pointer
+			NULL if overflow
+*/
+BST_ITER *BST_IterCreate( TREE *pTree);
+
+/* recycles memory of the iterator
+*/
+void BST_IterDestroy( BST_ITER *pIter);
+
+/* positions the iterator before the first node
+*/
+void BST_IterBegin( BST_ITER *pIter);
+
+/* positions the iterator after the last node (for BST_IterPrev)
+*/
+void BST_IterEnd( BST_ITER *pIter);
+
+/* positions the iterator before the first node whose data is not less than keyPtr
+	sets pIter->failed if overflow
+*/
+void BST_IterSeek( BST_ITER *pIter, void *keyPtr);
+
+/* returns data after the cursor and moves the cursor forward
+			NULL if at the end or pIter->failed (overflow)
+*/
+void *BST_IterNext( BST_ITER *pIter);
+
+/* returns data before the cursor and moves the cursor backward
+			NULL if at the beginning or pIter->failed (overflow)
+*/
+void *BST_IterPrev( BST_ITER *pIter);
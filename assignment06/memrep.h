@@ -0,0 +1,33 @@
+#include <stdio.h> // FILE
+
+////////////////////////////////////////////////////////////////////////////////
+// allocation profile of the --mem-report option
+// the program is linked with MEM_WRAP (see Makefile), so its calls of malloc, calloc,
+// realloc, posix_memalign, strdup and free go through this module; libc's own
+// allocations (stdio buffers) do not
+
+// kinds of allocations told apart by MEM_Report
+#define MEM_TREE	0	// made by the tree library: nodes, paths, images (default)
+#define MEM_RECORD	1	// tWord records
+#define MEM_STRING	2	// strings of the records
+#define MEM_OTHER	3	// arrays of the driver
+#define MEM_KINDS	4
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototype declarations
+
+/* Starts tracking the blocks allocated from now on
+	blocks allocated before are freed untracked
+*/
+void MEM_Start( void);
+
+/* Sets the kind of the following allocations of the calling thread
+	return	previous kind
+*/
+int MEM_Kind( int kind);
+
+/* Prints per kind allocations, frees, live blocks, bytes asked for and slack (bytes the
+	allocator gave beyond them), then the peak of live bytes and the peak RSS, which
+	includes the tracking table of this module
+*/
+void MEM_Report( FILE *fp);
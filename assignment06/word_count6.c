@@ -4,6 +4,7 @@
 #include <ctype.h> // toupper
 
 #include "bst.h"
+#include "memrep.h"
 
 #define QUIT			1
 #define FORWARD_PRINT	2
@@ -12,6 +13,7 @@
 #define SEARCH			5
 #define DELETE			6
 #define COUNT			7
+#define RANGE_PRINT		8
 
 // User structure type definition
 // 단어 구조체
@@ -20,6 +22,12 @@ typedef struct {
 	int		freq;		// 빈도
 } tWord;
 
+// record of a word in the binary image (BST_Save, BST_Load)
+typedef struct {
+	int		freq;		// 빈도
+	char	word[];		// 단어
+} tRecord;
+
 ////////////////////////////////////////////////////////////////////////////////
 // 단어 구조체를 위한 메모리를 할당하고 word, freq 초기화
 // return	할당된 단어 구조체에 대한 pointer
@@ -53,6 +61,8 @@ int get_action()
 			return DELETE;
 		case 'C':
 			return COUNT;
+		case 'R':
+			return RANGE_PRINT;
 	}
 	return 0; // undefined action
 }
@@ -68,6 +78,35 @@ int compare_by_word( const void *n1, const void *n2)
 	return strcmp( p1->word, p2->word);
 }
 
+// returns word of word structure as the key bytes
+// for BST_Freeze function
+const char *word_key( const void *dataPtr)
+{
+	return ((tWord *)dataPtr)->word;
+}
+
+// copies word structure into a record of the binary image
+// for BST_Save function
+// return	size of the record
+size_t pack_word( const void *dataPtr, void *buf)
+{
+	tWord *pWord = (tWord *)dataPtr;
+	
+	if (buf)
+	{
+		((tRecord *)buf)->freq = pWord->freq;
+		strcpy( ((tRecord *)buf)->word, pWord->word);
+	}
+	return sizeof( tRecord) + strlen( pWord->word) + 1;
+}
+
+// compares a word in word structure with the word of a record
+// for BST_Load function
+int compare_to_record( const void *n1, const void *n2)
+{
+	return strcmp( ((tWord *)n1)->word, ((tRecord *)n2)->word);
+}
+
 // prints contents of word structure
 // for BST_Traverse and BST_TraverseR functions
 void print_word(const void *dataPtr)
@@ -87,6 +126,20 @@ void increase_freq(void *dataPtr)
 	((tWord *)dataPtr)->freq++;
 }
 
+// prints contents of record
+// for BST_Traverse and BST_TraverseR functions on a loaded image
+void print_record(const void *dataPtr)
+{
+	printf( "%s\t%d\n", ((tRecord *)dataPtr)->word, ((tRecord *)dataPtr)->freq);
+}
+
+// prints word of record
+// for printTree function on a loaded image
+void print_record_only(const void *dataPtr)
+{
+	printf( "%s\n", ((tRecord *)dataPtr)->word);
+}
+
 // gets user's input
 void input_word(char *word)
 {
@@ -94,51 +147,197 @@ void input_word(char *word)
 	fscanf( stdin, "%s", word);
 }
 
+// gets user's input for range print
+void input_range(char *from, char *to)
+{
+	fprintf( stderr, "Input a range of words (from to): ");
+	fscanf( stdin, "%s %s", from, to);
+}
+
+// prints operation counters of the tree in one line
+// for -s option
+void print_stats( TREE *tree)
+{
+	TREE_STATS st = BST_Stats( tree);
+	
+	fprintf( stderr, "[stats] count=%d compares=%ld hops=%ld rotations=%ld allocs=%ld peak=%d\n",
+		BST_Count( tree), st.compares, st.hops, st.rotations, st.allocs, st.peak);
+}
+
+// builds a balanced tree at once from (word, freq) lines sorted by word
+// for -b option
+// return	NULL if overflow or the file is not sorted
+TREE *build_sorted( FILE *fp)
+{
+	char word[100];
+	int freq;
+	int num_words = 0, capacity = 1024;
+	int kind = MEM_Kind( MEM_OTHER);
+	void **words = malloc( sizeof( void *) * capacity);
+	TREE *tree;
+	
+	while (fscanf( fp, "%s\t%d", word, &freq) == 2)
+	{
+		if (num_words == capacity)
+		{
+			capacity *= 2;
+			words = realloc( words, sizeof( void *) * capacity);
+		}
+		words[num_words] = createWord( word);
+		((tWord *)words[num_words++])->freq = freq;
+	}
+	MEM_Kind( kind);
+	
+	tree = BST_BuildFromSorted( compare_by_word, words, num_words);
+	if (!tree)
+	{
+		for (int i = 0; i < num_words; i++)
+			destroyWord( words[i]);
+	}
+	free( words);
+	return tree;
+}
+
+// builds the tree from all words of the file with threads
+// for -p option
+// return	NULL if overflow
+TREE *build_parallel( FILE *fp, int mode, int threads)
+{
+	char word[100];
+	int num_words = 0, capacity = 1024;
+	int kind = MEM_Kind( MEM_OTHER);
+	void **words = malloc( sizeof( void *) * capacity);
+	TREE *tree;
+	
+	while (fscanf( fp, "%s", word) != EOF)
+	{
+		if (num_words == capacity)
+		{
+			capacity *= 2;
+			words = realloc( words, sizeof( void *) * capacity);
+		}
+		words[num_words++] = createWord( word);
+	}
+	MEM_Kind( kind);
+	
+	tree = BST_ParallelBuild( compare_by_word, mode, words, num_words, threads, increase_freq);
+	
+	// duplicated words (or all of them on failure) are left in the array
+	for (int i = 0; i < num_words; i++)
+		if (words[i]) destroyWord( words[i]);
+	free( words);
+	return tree;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 int main( int argc, char **argv)
 {
 	TREE *tree;
 	
-	char word[100];
+	char word[100], word2[100];
 	tWord *pWord;
 	int ret;
 	FILE *fp;
+	char *filename = NULL;
+	int show_stats = 0;
+	int mem_report = 0;
+	int mode = BST_PLAIN;
+	int sorted_input = 0;
+	int freeze = 0;
+	int threads = 0;
+	int image_input = 0;
+	char *image_file = NULL;
+	void (*print)(const void *) = print_word;
+	void (*print_only)(const void *) = print_word_only;
 	
-	if (argc != 2) {
-		fprintf( stderr, "usage: %s FILE\n", argv[0]);
-		return 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp( argv[i], "-s") == 0) show_stats = 1;
+		else if (strcmp( argv[i], "--mem-report") == 0) mem_report = 1;
+		else if (strcmp( argv[i], "-b") == 0) sorted_input = 1;
+		else if (strcmp( argv[i], "-f") == 0) freeze = 1;
+		else if (strcmp( argv[i], "-l") == 0) image_input = 1;
+		else if (strcmp( argv[i], "-w") == 0 && i + 1 < argc) image_file = argv[++i];
+		else if (strcmp( argv[i], "-p") == 0 && i + 1 < argc) threads = atoi( argv[++i]);
+		else if (strcmp( argv[i], "-m") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp( argv[i], "plain") == 0) mode = BST_PLAIN;
+			else if (strcmp( argv[i], "treap") == 0) mode = BST_TREAP;
+			else if (strcmp( argv[i], "splay") == 0) mode = BST_SPLAY;
+			else if (strcmp( argv[i], "rcu") == 0) mode = BST_RCU;
+			else { filename = NULL; break; } // unknown mode
+		}
+		else if (filename == NULL) filename = argv[i];
+		else { filename = NULL; break; } // too many files
 	}
 	
-	fp = fopen( argv[1], "rt");
-	if (!fp)
-	{
-		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
-		return 2;
+	if (filename == NULL) {
+		fprintf( stderr, "usage: %s [-s] [--mem-report] [-f] [-w IMAGE] [-m plain|treap|splay|rcu] [-p THREADS] FILE\n", argv[0]);
+		fprintf( stderr, "       %s [-s] [--mem-report] [-f] [-w IMAGE] -b SORTED_FREQ_FILE\n", argv[0]);
+		fprintf( stderr, "       %s [-s] [--mem-report] -l IMAGE\n", argv[0]);
+		return 1;
 	}
 	
-	// creates an empty tree
-	tree = BST_Create(compare_by_word);
-	if (!tree)
+	// allocations of nodes, records and strings from here on (printed on quit)
+	if (mem_report) MEM_Start();
+	
+	if (image_input)
 	{
-		printf( "Cannot create a tree\n");
-		return 100;
+		// read-only tree served straight from the file
+		tree = BST_Load( filename, compare_to_record);
+		if (!tree)
+		{
+			fprintf( stderr, "Error: cannot load image [%s]\n", filename);
+			return 2;
+		}
+		print = print_record;
+		print_only = print_record_only;
 	}
-	
-	while(fscanf( fp, "%s", word) != EOF)
+	else
 	{
-		pWord = createWord( word);
+		fp = fopen( filename, "rt");
+		if (!fp)
+		{
+			fprintf( stderr, "Error: cannot open file [%s]\n", filename);
+			return 2;
+		}
 		
-		ret = BST_Insert( tree, pWord, increase_freq);
+		// creates an empty tree (or the whole tree at once for -b and -p)
+		if (sorted_input) tree = build_sorted( fp);
+		else if (threads > 0) tree = build_parallel( fp, mode, threads);
+		else tree = BST_CreateMode(compare_by_word, mode);
+		if (!tree)
+		{
+			printf( "Cannot create a tree\n");
+			return 100;
+		}
 		
-		if (ret == 0 || ret == 2) // failure or duplicated
+		while(!sorted_input && threads == 0 && fscanf( fp, "%s", word) != EOF)
 		{
-			destroyWord( pWord);
+			pWord = createWord( word);
+			
+			ret = BST_Insert( tree, pWord, increase_freq);
+			
+			if (ret == 0 || ret == 2) // failure or duplicated
+			{
+				destroyWord( pWord);
+			}
 		}
+		
+		fclose( fp);
 	}
 	
-	fclose( fp);
+	if (image_file && !BST_Save( tree, image_file, pack_word))
+		fprintf( stderr, "Error: cannot write image [%s]\n", image_file);
 	
-	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, T)ree print, S)earch, D)elete, C)ount: ");
+	// read-only layout for searches (a deletion thaws the tree again)
+	if (freeze && !BST_Freeze( tree, word_key))
+		fprintf( stderr, "Cannot freeze the tree\n");
+	
+	if (show_stats) print_stats( tree);
+	
+	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, T)ree print, S)earch, D)elete, C)ount: ");
 	
 	while (1)
 	{
@@ -148,19 +347,21 @@ int main( int argc, char **argv)
 		switch( action)
 		{
 			case QUIT:
+				if (show_stats) print_stats( tree);
+				if (mem_report) MEM_Report( stderr);
 				BST_Destroy( tree, destroyWord);
 				return 0;
 			
 			case FORWARD_PRINT:
-				BST_Traverse( tree, print_word);
+				if (!BST_Traverse( tree, print)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 			
 			case BACKWARD_PRINT:
-				BST_TraverseR( tree, print_word);
+				if (!BST_TraverseR( tree, print)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 			
 			case TREE_PRINT:
-				printTree( tree, print_word_only);
+				if (!printTree( tree, print_only)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 				
 			case SEARCH:
@@ -168,7 +369,7 @@ int main( int argc, char **argv)
 				
 				pWord = createWord( word);
 
-				if ((ptr = BST_Search( tree, pWord)) != NULL) print_word( ptr);
+				if ((ptr = BST_Search( tree, pWord)) != NULL) print( ptr);
 				else fprintf( stdout, "%s not found\n", word);
 				
 				destroyWord( pWord);
@@ -176,12 +377,18 @@ int main( int argc, char **argv)
 				
 			case DELETE:
 				input_word(word);
+				if (image_input)
+				{
+					fprintf( stdout, "%s: read-only image\n", word);
+					break;
+				}
 				
 				pWord = createWord( word);
 
 				if ((ptr = BST_Delete( tree, pWord)) != NULL)
 				{
 					fprintf( stdout, "(%s, %d) deleted\n", ((tWord *)ptr)->word, ((tWord *)ptr)->freq);
+					BST_Synchronize( tree); // no search may still read it (BST_RCU)
 					destroyWord( ptr);
 				}
 				else fprintf( stdout, "%s not found\n", word);
@@ -189,12 +396,37 @@ int main( int argc, char **argv)
 				destroyWord( pWord);
 				break;
 			
+			case RANGE_PRINT:
+				input_range( word, word2);
+				if (image_input)
+				{
+					fprintf( stdout, "range print: read-only image\n");
+					break;
+				}
+				{
+					tWord from = { word, 0}, to = { word2, 0};
+					BST_ITER *it = BST_IterCreate( tree);
+					
+					if (it == NULL)
+					{
+						fprintf( stderr, "Error: cannot create an iterator\n");
+						break;
+					}
+					BST_IterSeek( it, &from);
+					while ((ptr = BST_IterNext( it)) != NULL && compare_by_word( ptr, &to) <= 0)
+						print_word( ptr);
+					if (it->failed)
+						fprintf( stderr, "Error: cannot extend the iterator path\n");
+					BST_IterDestroy( it);
+				}
+				break;
+			
 			case COUNT:
 				fprintf( stdout, "%d\n", BST_Count(tree));
 				break;
 		}
 		
-		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, T)ree print, S)earch, D)elete, C)ount: ");
+		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, T)ree print, S)earch, D)elete, C)ount: ");
 	}
 	return 0;
 }
@@ -203,10 +435,15 @@ int main( int argc, char **argv)
 // return	할당된 단어 구조체에 대한 pointer
 //			NULL if overflow
 tWord *createWord( char *word){
+    int kind = MEM_Kind(MEM_RECORD); // for --mem-report
     tWord * newWord = malloc(sizeof(tWord));
-    if(newWord == NULL)
+    MEM_Kind(MEM_STRING);
+    if(newWord == NULL){
+        MEM_Kind(kind);
         return NULL;
+    }
     newWord->word = malloc(sizeof(char)*20);
+    MEM_Kind(kind);
     strcpy(newWord->word, word);
     newWord->freq = 1;
     return newWord;
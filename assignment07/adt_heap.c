@@ -4,6 +4,15 @@
 
 #include "adt_heap.h"
 
+// operation counters (see HEAP_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(heap, field, n)	((heap)->stats.field += (n))
+#define STAT_PEAK(heap)			do { if ((heap)->last + 1 > (heap)->stats.peak) (heap)->stats.peak = (heap)->last + 1; } while (0)
+#else
+#define STAT_ADD(heap, field, n)	((void)(heap))
+#define STAT_PEAK(heap)			((void)(heap))
+#endif
+
 /* Reestablishes heap by moving data in child up to correct location heap array
    for heap_Insert function
 */
@@ -11,7 +20,9 @@ static void _reheapUp( HEAP *heap, int index){
     if(index != 0){
         int parent = (index-1)/2;
         int cmp = heap->compare(heap->heapArr[index], heap->heapArr[parent]);
+        STAT_ADD(heap, compares, 1);
         if(cmp > 0){
+            STAT_ADD(heap, swaps, 1);
             // index랑 parent랑 값 바꾸기
             void* tmp = heap->heapArr[index];
             heap->heapArr[index] = heap->heapArr[parent];
@@ -32,7 +43,9 @@ static void _reheapDown( HEAP *heap, int index){
 
     if(child == heap->last){
         int compare = heap->compare(heap->heapArr[index], heap->heapArr[child]);
+        STAT_ADD(heap, compares, 1);
         if(compare < 0){
+            STAT_ADD(heap, swaps, 1);
             void* tmp = heap->heapArr[index];
             heap->heapArr[index] = heap->heapArr[child];
             heap->heapArr[child] = tmp;
@@ -43,7 +56,9 @@ static void _reheapDown( HEAP *heap, int index){
     int cmp = heap->compare(heap->heapArr[child], heap->heapArr[child+1]);
     if(cmp < 0) child++;
     int compare = heap->compare(heap->heapArr[index], heap->heapArr[child]);
+    STAT_ADD(heap, compares, 2);
     if(compare < 0){
+        STAT_ADD(heap, swaps, 1);
         void* tmp = heap->heapArr[index];
         heap->heapArr[index] = heap->heapArr[child];
         heap->heapArr[child] = tmp;
@@ -65,6 +80,10 @@ HEAP *heap_Create( int (*compare) (const void *arg1, const void *arg2)){
     new->last = -1;
     new->heapArr = malloc(sizeof(void*) * new->capacity);
     if(new->heapArr == NULL) return NULL;
+#ifdef ADT_STATS
+    new->stats = (HEAP_STATS){0};
+    new->stats.allocs = 1;
+#endif
     return new;
 }
 
@@ -91,10 +110,12 @@ int heap_Insert( HEAP *heap, void *dataPtr){
             return 0;
         }
         heap->heapArr = newarr;
+        STAT_ADD(heap, allocs, 1);
     }
 
 
     heap->heapArr[heap->last] = dataPtr;
+    STAT_PEAK(heap);
     _reheapUp(heap, heap->last);
 
     return 1;
@@ -135,5 +156,14 @@ void heap_Print( HEAP *heap, void (*print_func) (const void *data)){
     printf("\n");
 }
 
-
-
+/* returns operation counters of the heap
+all zero if not compiled with -DADT_STATS
+*/
+HEAP_STATS heap_Stats( HEAP *heap){
+#ifdef ADT_STATS
+    return heap->stats;
+#else
+    (void)heap;
+    return (HEAP_STATS){0};
+#endif
+}
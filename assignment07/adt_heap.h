@@ -1,9 +1,21 @@
+// operation counters (compiled in only with -DADT_STATS)
+typedef struct
+{
+	long	compares;	// comparator calls
+	long	swaps;		// reheap swaps
+	long	allocs;		// array allocations (including growth)
+	int		peak;		// peak element count
+} HEAP_STATS;
+
 typedef struct
 {
 	int	last;
 	int	capacity;
 	void **heapArr;
 	int (*compare) (const void *, const void *);
+#ifdef ADT_STATS
+	HEAP_STATS stats;
+#endif
 } HEAP;
 
 /* Allocates memory for heap and returns address of heap head structure
@@ -34,3 +46,7 @@ int heap_Empty(  HEAP *heap);
 /* Print heap array */
 void heap_Print( HEAP *heap, void (*print_func) (const void *data));
 
+/* returns operation counters of the heap
+all zero if not compiled with -DADT_STATS
+*/
+HEAP_STATS heap_Stats( HEAP *heap);
@@ -59,6 +59,17 @@ void print_word_only(const void *dataPtr)
 	printf( "%s\n", ((tWord *)dataPtr)->word);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// prints operation counters of the heap in one line
+// for -s option
+void print_stats( HEAP *heap)
+{
+	HEAP_STATS st = heap_Stats( heap);
+	
+	fprintf( stderr, "[stats] compares=%ld swaps=%ld allocs=%ld peak=%d\n",
+		st.compares, st.swaps, st.allocs, st.peak);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 int main( int argc, char **argv)
 {
@@ -69,16 +80,25 @@ int main( int argc, char **argv)
 	int freq;
 	tWord *pWord;
 	FILE *fp;
+	char *filename = NULL;
+	int show_stats = 0;
 	
-	if (argc != 2)
+	for (int i = 1; i < argc; i++)
 	{
-		fprintf(stderr, "usage: %s FILE\n", argv[0]);
+		if (strcmp( argv[i], "-s") == 0) show_stats = 1;
+		else if (filename == NULL) filename = argv[i];
+		else { filename = NULL; break; } // too many files
+	}
+	
+	if (filename == NULL)
+	{
+		fprintf(stderr, "usage: %s [-s] FILE\n", argv[0]);
 		return 1;
 	}
 		
-	if ((fp = fopen(argv[1], "rt")) == NULL)
+	if ((fp = fopen(filename, "rt")) == NULL)
 	{
-		fprintf( stderr, "file open error: %s\n", argv[1]);
+		fprintf( stderr, "file open error: %s\n", filename);
 		return 2;
 	}
 	
@@ -116,6 +136,8 @@ int main( int argc, char **argv)
  	}
 	printf("\n");
 	
+	if (show_stats) print_stats( heap);
+	
 	heap_Destroy(heap, destroyWord);
 	
 	return 0;
@@ -2,15 +2,75 @@
 
 #include <stdlib.h> // malloc
 #include <stdio.h>
+#include <string.h> // memcpy, memcmp
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <pthread.h> // AVLT_Union
 
 #include "avlt.h"
+#include "bptree.h"
+#include "cavl.h"
+#include "ocavl.h"
 
 #define max(x, y)	(((x) > (y)) ? (x) : (y))
 
+// operation counters (see TREE_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(pTree, field, n)	((pTree)->stats.field += (n))
+#define STAT_PEAK(pTree)			do { if ((pTree)->count > (pTree)->stats.peak) (pTree)->stats.peak = (pTree)->count; } while (0)
+#else
+#define STAT_ADD(pTree, field, n)	((void)(pTree))
+#define STAT_PEAK(pTree)			((void)(pTree))
+#endif
+
+// binary image (AVLT_Save, AVLT_Load)
+#define IMAGE_MAGIC	"AVLIMG1" // 8 bytes with the terminating NUL
+#define IMAGE_DEPTH	64	// levels of an image (a balanced tree of 2^32 nodes has 33)
+
+// file header; every offset is from the start of the file
+typedef struct
+{
+    char		magic[8];
+    uint32_t	count;		// number of nodes
+    uint32_t	nodeOff;	// IMAGE_NODE[count], preorder, root at index 0
+    uint32_t	poolOff;	// records packed by the caller, each aligned to 8 bytes
+    uint32_t	poolSize;
+} IMAGE_HEADER;
+
+// node of the image; 0 means no child (index 0 is the root)
+typedef struct
+{
+    uint32_t	left;
+    uint32_t	right;
+    uint32_t	rec;	// offset of the record in the pool
+} IMAGE_NODE;
+
+#define IMAGE_NODES(h)	((IMAGE_NODE *)((char *)(h) + (h)->nodeOff))
+#define IMAGE_POOL(h)	((char *)(h) + (h)->poolOff)
+
+// front cache of AVLT_Search (AVLT_EnableCache)
+#define CACHE_WAYS	4	// entries of a set: one cache line
+
+typedef struct
+{
+    uint32_t	hash;
+    void		*dataPtr;	// NULL if empty (empty entries come last in a set)
+} CACHE_ENTRY;
+
+struct avlt_cache
+{
+    CACHE_ENTRY	*sets;	// CACHE_WAYS entries per set, most recently used first
+    uint32_t	mask;	// number of sets - 1
+    uint32_t	(*hash)(const void *);
+    AVLT_CACHE_STATS	stats;
+};
+
 // internal functions (not mandatory)
 // used in AVLT_Insert
-// return 	pointer to root
-static NODE *_insert( NODE *root, NODE *newPtr, int (*compare)(const void *, const void *), void (*callback)(void *), int *duplicated);
+// return	1 success, 0 overflow, 2 duplicated key
+static int _insert( TREE *pTree, void *dataInPtr, void (*callback)(void *));
 
 // used in AVLT_Insert
 static NODE *_makeNode( void *dataInPtr);
@@ -18,187 +78,524 @@ static NODE *_makeNode( void *dataInPtr);
 // used in AVLT_Destroy
 static void _destroy( NODE *root, void (*callback)(void *));
 
+// used in AVLT_Destroy (persistent mode)
+static void _release( TREE *pTree, void (*callback)(void *));
+
+// internal function
+// return	node the caller may change (a copy if the node is shared)
+//			NULL if overflow
+static NODE *_own( TREE *pTree, NODE *pNode);
+
+// internal function
+// stores pNode at depth of the access path buffer
+// return	0 if overflow
+static int _pathSet( TREE *pTree, int depth, NODE *pNode);
+
 // used in AVLT_Delete
 // return 	pointer to root
-static NODE *_delete( NODE *root, void *keyPtr, void **dataOutPtr, int (*compare)(const void *, const void *));
+static NODE *_delete( TREE *pTree, NODE *root, void *keyPtr, void **dataOutPtr);
+
+// used in _delete
+// return 	pointer to root
+static NODE *_deleteMin( TREE *pTree, NODE *root, void **dataOutPtr);
+
+// used in _delete, _deleteMin (persistent mode)
+// return	0 if overflow
+static int _ownRotation( TREE *pTree, NODE *root, int toRight);
+
+// used in _delete, _deleteMin
+// return 	pointer to root
+static NODE *_rebalance( TREE *pTree, NODE *root);
+
+// used in AVLT_Check
+// return	height of the subtree
+//			-1 if an invariant is broken
+static int _check( TREE *pTree, NODE *root, void *loPtr, void *hiPtr, int depth);
 
 // used in AVLT_Search
 // Retrieve node containing the requested key
 // return	address of the node containing the key
 //			NULL not found
-static NODE *_search( NODE *root, void *keyPtr, int (*compare)(const void *, const void *));
+static NODE *_search( TREE *pTree, NODE *root, void *keyPtr);
 
 // used in AVLT_Traverse
-static void _traverse( NODE *root, void (*callback)(const void *));
+// return	0 if overflow
+static int _traverse( TREE *pTree, void (*callback)(const void *));
 
 // used in AVLT_TraverseR
-static void _traverseR( NODE *root, void (*callback)(const void *));
+// return	0 if overflow
+static int _traverseR( TREE *pTree, void (*callback)(const void *));
 
 // used in printTree
-static void _inorder_print( NODE *root, int level, void (*callback)(const void *));
+// return	0 if overflow
+static int _inorder_print( TREE *pTree, void (*callback)(const void *));
+
+// used in AVLT_Search
+static void *_imageSearch( TREE *pTree, void *keyPtr);
+
+// used in AVLT_Search
+// return	data found by the tree (or image) itself, NULL if none
+static void *_find( TREE *pTree, void *keyPtr);
+
+// used in AVLT_Search
+// return	data from the cache, or from _find (then kept in the cache)
+static void *_cacheSearch( TREE *pTree, void *keyPtr);
+
+// used in AVLT_Delete
+// drops the entries for the hash of keyPtr
+static void _cacheDrop( TREE *pTree, void *keyPtr);
+
+// used in AVLT_Split, AVLT_Join, AVLT_Union
+static void _cacheClear( TREE *pTree);
+
+// used in AVLT_Traverse, AVLT_TraverseR and printTree
+// toRight 0: left-to-right, 1: right-to-left; withLevel prints a tab per level first
+static void _imageWalk( TREE *pTree, int toRight, int withLevel, void (*callback)(const void *));
 
 // internal function
 // return	height of the (sub)tree from the node (root)
 static int getHeight( NODE *root);
 
+// internal function
+// return	number of nodes in the (sub)tree from the node (root)
+static int getSize( NODE *root);
+
 // internal function
 // Exchanges pointers to rotate the tree to the right
-// updates heights of the nodes
+// updates heights and sizes of the nodes
 // return	new root
-static NODE *rotateRight( NODE *root);
+static NODE *rotateRight( TREE *pTree, NODE *root);
 
 // internal function
 // Exchanges pointers to rotate the tree to the left
-// updates heights of the nodes
+// updates heights and sizes of the nodes
 // return	new root
-static NODE *rotateLeft( NODE *root);
+static NODE *rotateLeft( TREE *pTree, NODE *root);
 
-static NODE *_insert( NODE *root, NODE *newPtr, int (*compare)(const void *, const void *), void (*callback)(void *), int *duplicated){
-    if(root == NULL)
-        return newPtr;
+// used in AVLT_Insert
+// descends once, recording the path and the direction taken at each level (bit i: right),
+// links the new node, then walks back up: sizes grow along the whole path, heights only
+// until one stays the same, and at most one single or double rotation restores the balance
+// a duplicated key allocates nothing
+// return	1 success, 0 overflow, 2 duplicated key
+static int _insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
+    NODE **link = &pTree->root;
+    uint64_t dirs = 0;
+    int depth = 0;
 
-    int cmp = compare(newPtr->dataPtr, root->dataPtr);
+    while(*link != NULL){
+        NODE *pNode = _own(pTree, *link);
+        if(pNode == NULL) return 0;
+        *link = pNode;
 
-    if(cmp == 0){
-        callback(root->dataPtr);
-        *duplicated = 2;
-        return root;
-    }
-    if(cmp < 0){
-        root->left = _insert(root->left, newPtr, compare, callback, duplicated);
-    }
-    else{
-        root->right = _insert(root->right, newPtr, compare, callback, duplicated);
+        int cmp = pTree->compare(dataInPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0){
+            callback(pNode->dataPtr);
+            return 2;
+        }
+        // an AVL tree below 2^43 nodes is not 64 levels high
+        if(depth == 64 || !_pathSet(pTree, depth, pNode)) return 0;
+        if(cmp > 0){
+            dirs |= (uint64_t)1 << depth;
+            link = &pNode->right;
+        }
+        else
+            link = &pNode->left;
+        depth++;
+        STAT_ADD(pTree, hops, 1);
     }
 
-    // Update height
-    root->height = max(getHeight(root->left), getHeight(root->right)) + 1;
+    NODE *newNode = _makeNode(dataInPtr);
+    if(newNode == NULL) return 0;
+    STAT_ADD(pTree, allocs, 1);
+    *link = newNode;
 
-    // Rebalance
-    int balance = getHeight(root->left) - getHeight(root->right);
+    int growing = 1;
+    for(int i = depth - 1; i >= 0; i--){
+        NODE *pNode = pTree->path[i];
+        pNode->size++;
+        if(!growing) continue;
 
-    if(balance > 1 && compare(newPtr->dataPtr, root->left->dataPtr) < 0)
-        return rotateRight(root);
-    if(balance < -1 && compare(newPtr->dataPtr, root->right->dataPtr) > 0)
-        return rotateLeft(root);
-    if(balance > 1 && compare(newPtr->dataPtr, root->left->dataPtr) > 0){
-        root->left = rotateLeft(root->left);
-        return rotateRight(root);
-    }
-    if(balance < -1 && compare(newPtr->dataPtr, root->right->dataPtr) < 0){
-        root->right = rotateRight(root->right);
-        return rotateLeft(root);
-    }
+        int height = max(getHeight(pNode->left), getHeight(pNode->right)) + 1;
+        if(height == pNode->height){
+            growing = 0;
+            continue;
+        }
+        pNode->height = height;
 
-    return root;
+        int balance = getHeight(pNode->left) - getHeight(pNode->right);
+        if(balance < 2 && balance > -2) continue;
+
+        // the side taken at i grew; the direction taken below it picks single or double
+        NODE *sub;
+        if(((dirs >> i) & 1) == 0){
+            if((dirs >> (i + 1)) & 1)
+                pNode->left = rotateLeft(pTree, pNode->left);
+            sub = rotateRight(pTree, pNode);
+        }
+        else{
+            if(((dirs >> (i + 1)) & 1) == 0)
+                pNode->right = rotateRight(pTree, pNode->right);
+            sub = rotateLeft(pTree, pNode);
+        }
+        if(i == 0)
+            pTree->root = sub;
+        else if((dirs >> (i - 1)) & 1)
+            pTree->path[i - 1]->right = sub;
+        else
+            pTree->path[i - 1]->left = sub;
+        growing = 0; // the subtree is back to its old height
+    }
+    return 1;
 }
 
 // used in AVLT_Insert
 static NODE *_makeNode( void *dataInPtr){
     NODE *newNode = malloc(sizeof(NODE));
+    if(newNode == NULL) return NULL;
     newNode->dataPtr = dataInPtr;
     newNode->right = NULL;
     newNode->left = NULL;
     newNode->height = 1;
+    newNode->size = 1;
+    newNode->refs = 1;
     return newNode;
 }
 
+// internal function
+// return	node the caller may change
+//			NULL if overflow
+// a node shared with another version (persistent mode) is replaced by a copy holding a clone
+// of its data; the copy takes over one reference, and its children gain one
+static NODE *_own( TREE *pTree, NODE *pNode){
+    if(pNode->refs == 1) return pNode;
+    NODE *copy = malloc(sizeof(NODE));
+    void *dataPtr = (copy != NULL) ? pTree->clone(pNode->dataPtr) : NULL;
+    if(dataPtr == NULL){
+        free(copy);
+        return NULL;
+    }
+    *copy = *pNode;
+    copy->dataPtr = dataPtr;
+    copy->refs = 1;
+    if(copy->left != NULL) copy->left->refs++;
+    if(copy->right != NULL) copy->right->refs++;
+    pNode->refs--;
+    STAT_ADD(pTree, allocs, 1);
+    return copy;
+}
+
 // used in AVLT_Destroy
+// flattens the tree by right rotations while freeing it, so no stack is needed at any depth
 static void _destroy( NODE *root, void (*callback)(void *)){
-    if(root == NULL) return;
+    while(root != NULL){
+        if(root->left != NULL){
+            NODE *pNode = root->left;
+            root->left = pNode->right;
+            pNode->right = root;
+            root = pNode;
+        }
+        else{
+            NODE *next = root->right;
+            callback(root->dataPtr);
+            free(root);
+            root = next;
+        }
+    }
+}
+
+// used in AVLT_Destroy (persistent mode)
+// drops the tree's reference to its root; a node whose last reference goes is freed with its
+// data and drops its references to the children (pending nodes wait on the path buffer)
+static void _release( TREE *pTree, void (*callback)(void *)){
+    int depth = 0;
 
-    _destroy(root->left, callback);
-    callback(root->dataPtr);
-    _destroy(root->right, callback);
-    free(root);
+    if(pTree->root != NULL && !_pathSet(pTree, depth++, pTree->root)) return;
+    while(depth > 0){
+        NODE *pNode = pTree->path[--depth];
+        if(--pNode->refs > 0) continue; // still used by another version
+        if(pNode->left != NULL && !_pathSet(pTree, depth++, pNode->left)) return;
+        if(pNode->right != NULL && !_pathSet(pTree, depth++, pNode->right)) return;
+        callback(pNode->dataPtr);
+        free(pNode);
+    }
+}
+
+// internal function
+// stores pNode at depth of the access path buffer
+// return	0 if overflow
+static int _pathSet( TREE *pTree, int depth, NODE *pNode){
+    if(depth == pTree->pathCap){
+        int capacity = pTree->pathCap ? pTree->pathCap * 2 : 64;
+        NODE **path = realloc(pTree->path, sizeof(NODE *) * capacity);
+        if(path == NULL) return 0;
+        pTree->path = path;
+        pTree->pathCap = capacity;
+    }
+    pTree->path[depth] = pNode;
+    return 1;
 }
 
 
 // used in AVLT_Delete
 // return 	pointer to root
-static NODE *_delete( NODE *root, void *keyPtr, void **dataOutPtr, int (*compare)(const void *, const void *)){
+static NODE *_delete( TREE *pTree, NODE *root, void *keyPtr, void **dataOutPtr){
     if (root == NULL)
         return NULL;
 
-    int cmp = compare(keyPtr, root->dataPtr);
+    NODE *own = _own(pTree, root);
+    if (own == NULL)
+        return root; // overflow, nothing is deleted
+    root = own;
+
+    int cmp = pTree->compare(keyPtr, root->dataPtr);
+    STAT_ADD(pTree, compares, 1);
+    if (cmp != 0)
+        STAT_ADD(pTree, hops, 1);
+    // the successor of a node with two children is deleted from its right subtree
+    int toRight = cmp > 0 || (cmp == 0 && root->left != NULL && root->right != NULL);
+    if ((cmp != 0 || toRight) && !_ownRotation(pTree, root, toRight))
+        return root; // overflow, nothing is deleted
     if (cmp > 0)
-        root->right = _delete(root->right, keyPtr, dataOutPtr, compare);
+        root->right = _delete(pTree, root->right, keyPtr, dataOutPtr);
     else if (cmp < 0)
-        root->left = _delete(root->left, keyPtr, dataOutPtr, compare);
+        root->left = _delete(pTree, root->left, keyPtr, dataOutPtr);
     else {
-        *dataOutPtr = root->dataPtr;
         if (root->left == NULL) {
             NODE *tmp = root->right;
+            *dataOutPtr = root->dataPtr;
             free(root);
             return tmp;
         } else if (root->right == NULL) {
             NODE *tmp = root->left;
+            *dataOutPtr = root->dataPtr;
             free(root);
             return tmp;
         } else {
-            NODE *sml = root->right;
-            while (sml->left != NULL) {
-                sml = sml->left;
+            // the successor's data moves up, its node is unlinked
+            void *sml = NULL;
+            root->right = _deleteMin(pTree, root->right, &sml);
+            if (sml != NULL) {
+                *dataOutPtr = root->dataPtr;
+                root->dataPtr = sml;
             }
-            root->dataPtr = sml->dataPtr;
-            void *datainout;
-            root->right = _delete(root->right, sml->dataPtr, &datainout, compare);
         }
     }
 
-    // Update height of the current node
+    return _rebalance(pTree, root);
+}
+
+// used in _delete
+// unlinks the smallest node of the subtree and moves its data to *dataOutPtr
+// return 	pointer to root
+static NODE *_deleteMin( TREE *pTree, NODE *root, void **dataOutPtr){
+    NODE *own = _own(pTree, root);
+    if (own == NULL)
+        return root; // overflow, nothing is unlinked
+    root = own;
+
+    if (root->left == NULL) {
+        NODE *tmp = root->right;
+        *dataOutPtr = root->dataPtr;
+        free(root);
+        return tmp;
+    }
+    if (!_ownRotation(pTree, root, 0))
+        return root; // overflow, nothing is unlinked
+    STAT_ADD(pTree, hops, 1);
+    root->left = _deleteMin(pTree, root->left, dataOutPtr);
+
+    return _rebalance(pTree, root);
+}
+
+// used in _delete, _deleteMin (persistent mode)
+// makes own, before anything is unlinked, the nodes _rebalance may rotate at root once the
+// subtree on side toRight has lost a level: the other child if it is the taller one, and its
+// inner child if that is taller than its outer one (a double rotation); the other side is
+// not touched by the deletion, so these are all the nodes the rotation can need
+// return	0 if overflow (the tree is unchanged apart from copies)
+static int _ownRotation( TREE *pTree, NODE *root, int toRight){
+    if(pTree->clone == NULL) return 1; // every node is own
+    NODE **link = toRight ? &root->left : &root->right;
+    NODE *side = toRight ? root->right : root->left;
+    if(*link == NULL || getHeight(*link) <= getHeight(side)) return 1;
+    NODE *child = _own(pTree, *link);
+    if(child == NULL) return 0;
+    *link = child;
+
+    NODE **inner = toRight ? &child->right : &child->left;
+    NODE *outer = toRight ? child->left : child->right;
+    if(*inner == NULL || getHeight(*inner) <= getHeight(outer)) return 1;
+    NODE *grand = _own(pTree, *inner);
+    if(grand == NULL) return 0;
+    *inner = grand;
+    return 1;
+}
+
+// used in _delete, _deleteMin
+// updates height and size of the node, then rotates if its subtrees differ in height by 2
+// (the taller child's balance picks single or double rotation, as a deletion needs)
+// the nodes a rotation moves were made own by _ownRotation on the way down (join and
+// split refuse persistent trees), so _own cannot fail here
+// return 	pointer to root
+static NODE *_rebalance( TREE *pTree, NODE *root){
     root->height = max(getHeight(root->left), getHeight(root->right)) + 1;
+    root->size = getSize(root->left) + getSize(root->right) + 1;
 
+    int balance = getHeight(root->left) - getHeight(root->right);
+    if (balance > 1) {
+        NODE *child = _own(pTree, root->left);
+        if (child == NULL) return root;
+        root->left = child;
+        if (getHeight(child->left) < getHeight(child->right)) {
+            NODE *grand = _own(pTree, child->right);
+            if (grand == NULL) return root;
+            child->right = grand;
+            root->left = rotateLeft(pTree, child);
+        }
+        return rotateRight(pTree, root);
+    }
+    if (balance < -1) {
+        NODE *child = _own(pTree, root->right);
+        if (child == NULL) return root;
+        root->right = child;
+        if (getHeight(child->right) < getHeight(child->left)) {
+            NODE *grand = _own(pTree, child->left);
+            if (grand == NULL) return root;
+            child->left = grand;
+            root->right = rotateRight(pTree, child);
+        }
+        return rotateLeft(pTree, root);
+    }
     return root;
 }
 
+// used in AVLT_Check
+// checks the subtree against (loPtr, hiPtr) (NULL: unbounded) and its stored fields
+// deeper than any AVL tree can be counts as broken, so the recursion stays shallow
+// return	height of the subtree
+//			-1 if an invariant is broken
+static int _check( TREE *pTree, NODE *root, void *loPtr, void *hiPtr, int depth){
+    if (root == NULL) return 0;
+    if (depth > 64 || root->refs < 1) return -1;
+    if (loPtr != NULL && pTree->compare(loPtr, root->dataPtr) >= 0) return -1;
+    if (hiPtr != NULL && pTree->compare(root->dataPtr, hiPtr) >= 0) return -1;
+
+    int lh = _check(pTree, root->left, loPtr, root->dataPtr, depth + 1);
+    if (lh < 0) return -1;
+    int rh = _check(pTree, root->right, root->dataPtr, hiPtr, depth + 1);
+    if (rh < 0) return -1;
+
+    if (lh - rh > 1 || rh - lh > 1) return -1;
+    if (root->height != max(lh, rh) + 1) return -1;
+    if (root->size != getSize(root->left) + getSize(root->right) + 1) return -1;
+    return root->height;
+}
 
 // used in AVLT_Search
 // Retrieve node containing the requested key
 // return	address of the node containing the key
 //			NULL not found
-static NODE *_search( NODE *root, void *keyPtr, int (*compare)(const void *, const void *)){
-    if(root == NULL)
-        return NULL;
+static NODE *_search( TREE *pTree, NODE *root, void *keyPtr){
+    while(root != NULL){
+        int cmp = pTree->compare(keyPtr, root->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0)
+            return root;
 
-    int cmp = compare(keyPtr, root->dataPtr);
-    if(cmp == 0)
-        return root;
+        STAT_ADD(pTree, hops, 1);
+        root = (cmp > 0) ? root->right : root->left;
+    }
+    return NULL;
+}
 
-    if(cmp > 0)
-        return _search(root->right, keyPtr, compare);
-    else
-        return _search(root->left, keyPtr, compare);
+#define WALK_STACK	64	// nodes a walk keeps in its own frame (AVL trees of any int count fit)
+
+// internal function
+// stack of a walk: the caller's local array, or one from the heap if the tree is higher
+// the height bounds the depth, so a walk never has to grow its stack
+// return	stack for getHeight(root) nodes
+//			NULL if overflow
+static NODE **_walkStack( NODE *root, NODE **local){
+    int height = getHeight(root);
+    return (height <= WALK_STACK) ? local : malloc(sizeof(NODE *) * height);
 }
 
 // used in AVLT_Traverse
-static void _traverse( NODE *root, void (*callback)(const void *)){
-    if(root == NULL) return;
+// in-order walk with the pending ancestors on a stack of its own instead of the call stack
+// or the tree's access path buffer, so walks may nest and run in several threads at once
+static int _traverse( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = _walkStack(pTree->root, local);
+    NODE *pNode = pTree->root;
+    int depth = 0;
+    if(stack == NULL) return 0;
 
-    _traverse(root->left, callback);
-    callback(root->dataPtr);
-    _traverse(root->right, callback);
+    while(1){
+        while(pNode != NULL){
+            stack[depth++] = pNode;
+            pNode = pNode->left;
+        }
+        if(depth == 0) break;
+        pNode = stack[--depth];
+        callback(pNode->dataPtr);
+        pNode = pNode->right;
+    }
+    if(stack != local) free(stack);
+    return 1;
 }
 
 // used in AVLT_TraverseR
-static void _traverseR( NODE *root, void (*callback)(const void *)){
-    if(root == NULL) return;
+// mirror of _traverse
+static int _traverseR( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = _walkStack(pTree->root, local);
+    NODE *pNode = pTree->root;
+    int depth = 0;
+    if(stack == NULL) return 0;
 
-    _traverseR(root->right, callback);
-    callback(root->dataPtr);
-    _traverseR(root->left, callback);
+    while(1){
+        while(pNode != NULL){
+            stack[depth++] = pNode;
+            pNode = pNode->right;
+        }
+        if(depth == 0) break;
+        pNode = stack[--depth];
+        callback(pNode->dataPtr);
+        pNode = pNode->left;
+    }
+    if(stack != local) free(stack);
+    return 1;
 }
 
 // used in printTree
-static void _inorder_print( NODE *root, int level, void (*callback)(const void *)){
-    if(root == NULL) return;
-    level++;
+// right-to-left walk keeping the whole root path on its own stack; its length is the level
+static int _inorder_print( TREE *pTree, void (*callback)(const void *)){
+    NODE *local[WALK_STACK], **stack = _walkStack(pTree->root, local);
+    NODE *pNode = pTree->root;
+    int depth = 0;
+    if(stack == NULL) return 0;
 
-    _inorder_print(root->right, level, callback);
-    for(int i = 0; i < level; i++)
-        printf("\t");
-    callback(root->dataPtr);
-    _inorder_print(root->left, level, callback);
+    while(1){
+        while(pNode != NULL){
+            stack[depth++] = pNode;
+            pNode = pNode->right;
+        }
+        if(depth == 0) break;
+        pNode = stack[depth - 1];
+        for(int i = 0; i < depth; i++)
+            printf("\t");
+        callback(pNode->dataPtr);
+        if(pNode->left != NULL){
+            pNode = pNode->left;
+            continue;
+        }
+        // climb while coming up from a left child
+        depth--;
+        while(depth > 0 && stack[depth - 1]->left == stack[depth]) depth--;
+        pNode = NULL;
+    }
+    if(stack != local) free(stack);
+    return 1;
 }
 
 // internal function
@@ -209,32 +606,45 @@ static int getHeight( NODE *root){
     return root->height;
 }
 
+// internal function
+// return	number of nodes in the (sub)tree from the node (root)
+static int getSize( NODE *root){
+    if(root == NULL) return 0;
+    return root->size;
+}
+
 // internal function
 // Exchanges pointers to rotate the tree to the right
-// updates heights of the nodes
+// updates heights and sizes of the nodes
 // return	new root
-static NODE *rotateRight( NODE *root){
+static NODE *rotateRight( TREE *pTree, NODE *root){
+    STAT_ADD(pTree, rotations, 1);
     NODE *pNode = root->left;
     root->left = pNode->right;
     pNode->right = root;
 
     root->height = max(getHeight(root->left), getHeight(root->right)) + 1;
     pNode->height = max(getHeight(pNode->left), getHeight(pNode->right)) + 1;
+    pNode->size = root->size;
+    root->size = getSize(root->left) + getSize(root->right) + 1;
 
     return pNode;
 }
 
 // internal function
 // Exchanges pointers to rotate the tree to the left
-// updates heights of the nodes
+// updates heights and sizes of the nodes
 // return	new root
-static NODE *rotateLeft( NODE *root){
+static NODE *rotateLeft( TREE *pTree, NODE *root){
+    STAT_ADD(pTree, rotations, 1);
     NODE *pNode = root->right;
     root->right = pNode->left;
     pNode->left = root;
 
     root->height = max(getHeight(root->left), getHeight(root->right)) + 1;
     pNode->height = max(getHeight(pNode->left), getHeight(pNode->right)) + 1;
+    pNode->size = root->size;
+    root->size = getSize(root->left) + getSize(root->right) + 1;
 
     return pNode;
 }
@@ -253,13 +663,103 @@ TREE *AVLT_Create( int (*compare)(const void *, const void *)){
     new->compare = compare;
     new->root = NULL;
     new->count = 0;
+    new->path = NULL;
+    new->pathCap = 0;
+    new->image = NULL;
+    new->imageSize = 0;
+    new->clone = NULL;
+    new->bplus = NULL;
+    new->compact = NULL;
+    new->concurrent = NULL;
+    new->cache = NULL;
+#ifdef ADT_STATS
+    new->stats = (TREE_STATS){0};
+#endif
+    return new;
+}
+
+/* Allocates a tree head on the given engine (AVLT_AVL, AVLT_BPLUS, AVLT_COMPACT, AVLT_CONCURRENT)
+	return	head node pointer
+			NULL if overflow or unknown engine
+*/
+TREE *AVLT_CreateEngine( int (*compare)(const void *, const void *), int engine, const char *(*getKey)(const void *)){
+    if(engine != AVLT_AVL && engine != AVLT_BPLUS && engine != AVLT_COMPACT && engine != AVLT_CONCURRENT) return NULL;
+    TREE *new = AVLT_Create(compare);
+    if(new == NULL || engine == AVLT_AVL)
+        return new;
+    if(engine == AVLT_BPLUS)
+        new->bplus = BPT_Create(compare, getKey);
+    else if(engine == AVLT_COMPACT)
+        new->compact = CAVL_Create(compare, getKey);
+    else
+        new->concurrent = OCAVL_Create(compare);
+    if(new->bplus == NULL && new->compact == NULL && new->concurrent == NULL){
+        free(new);
+        return NULL;
+    }
+#ifdef ADT_STATS
+    // the engine counts into the block of the head
+    if(new->bplus != NULL) new->bplus->stats = &new->stats;
+    if(new->compact != NULL) new->compact->stats = &new->stats;
+    if(new->concurrent != NULL) new->concurrent->stats = &new->stats;
+#endif
     return new;
 }
 
+/* Gives a concurrent tree the callback that frees data AVLT_Delete returns
+	return	1 success
+			0 the tree is not concurrent
+*/
+int AVLT_SetRelease( TREE *pTree, void (*callback)(void *)){
+    if(pTree->concurrent == NULL) return 0;
+    OCAVL_SetRelease(pTree->concurrent, callback);
+    return 1;
+}
+
+/* Turns on persistent mode: the tree and its snapshots (AVLT_Snapshot) share nodes
+	return	1 success
+			0 the tree is a mapped image
+*/
+int AVLT_SetPersistent( TREE *pTree, void *(*clone)(const void *)){
+    if(pTree->image != NULL || pTree->bplus != NULL || pTree->compact != NULL || pTree->concurrent != NULL) return 0;
+    // path copies give data of this version new addresses, which the cache would miss
+    if(pTree->cache != NULL) return 0;
+    pTree->clone = clone;
+    return 1;
+}
+
+/* Returns a tree head sharing all nodes with pTree in O(1) (persistent mode)
+	return	head node pointer
+			NULL if overflow or the tree is not persistent
+*/
+TREE *AVLT_Snapshot( TREE *pTree){
+    if(pTree->clone == NULL) return NULL;
+    TREE *snap = AVLT_Create(pTree->compare);
+    if(snap == NULL) return NULL;
+    snap->root = pTree->root;
+    snap->count = pTree->count;
+    snap->clone = pTree->clone;
+    if(snap->root != NULL) snap->root->refs++;
+    return snap;
+}
+
 /* Deletes all data in tree and recycles memory
 */
 void AVLT_Destroy( TREE *pTree, void (*callback)(void *)){
-    _destroy(pTree->root, callback);
+    if(pTree->image != NULL)
+        munmap(pTree->image, pTree->imageSize); // the records belong to the file
+    if(pTree->bplus != NULL)
+        BPT_Destroy(pTree->bplus, callback);
+    else if(pTree->compact != NULL)
+        CAVL_Destroy(pTree->compact, callback);
+    else if(pTree->concurrent != NULL)
+        OCAVL_Destroy(pTree->concurrent, callback);
+    else if(pTree->clone != NULL)
+        _release(pTree, callback);
+    else
+        _destroy(pTree->root, callback);
+    AVLT_EnableCache(pTree, 0, NULL);
+    free(pTree->path);
     free(pTree);
 }
 
@@ -270,27 +770,26 @@ void AVLT_Destroy( TREE *pTree, void (*callback)(void *)){
 			2 if duplicated key
 */
 int AVLT_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
-    NODE *new = _makeNode(dataInPtr);
-    if(new == NULL)
-        return 0;
-
-    if(pTree->root == NULL){
-        pTree->root = new;
-        pTree->count++;
-        return 1;
+    if(pTree->image != NULL) return 0; // read-only
+    int result = pTree->bplus ? BPT_Insert(pTree->bplus, dataInPtr, callback)
+               : pTree->compact ? CAVL_Insert(pTree->compact, dataInPtr, callback)
+               : pTree->concurrent ? OCAVL_Insert(pTree->concurrent, dataInPtr, callback)
+               : _insert(pTree, dataInPtr, callback);
+    if(result == 1 && pTree->concurrent != NULL){
+        int count = __atomic_add_fetch(&pTree->count, 1, __ATOMIC_RELAXED);
+#ifdef ADT_STATS
+        int peak = __atomic_load_n(&pTree->stats.peak, __ATOMIC_RELAXED);
+        while(count > peak && !__atomic_compare_exchange_n(&pTree->stats.peak, &peak, count, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+#else
+        (void)count;
+#endif
     }
-
-    int duplicated = 0;
-    pTree->root = _insert(pTree->root, new, pTree->compare, callback, &duplicated);
-
-    if(duplicated == 2){
-        free(new);
-        return 2;
-    }
-    else {
+    else if(result == 1){
         pTree->count++;
-        return 1;
+        STAT_PEAK(pTree);
     }
+    return result;
 }
 
 /* Deletes a node with keyPtr from the tree
@@ -298,8 +797,23 @@ int AVLT_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *)){
 			NULL not found
 */
 void *AVLT_Delete( TREE *pTree, void *keyPtr){
-    void *dataOut;
-    pTree->root = _delete(pTree->root, keyPtr, &dataOut, pTree->compare);
+    void *dataOut = NULL;
+    if(pTree->image != NULL) return NULL; // read-only
+    if(pTree->cache != NULL)
+        _cacheDrop(pTree, keyPtr);
+    if(pTree->bplus != NULL || pTree->compact != NULL){
+        dataOut = pTree->bplus ? BPT_Delete(pTree->bplus, keyPtr) : CAVL_Delete(pTree->compact, keyPtr);
+        if(dataOut != NULL) pTree->count--;
+        return dataOut;
+    }
+    if(pTree->concurrent != NULL){
+        dataOut = OCAVL_Delete(pTree->concurrent, keyPtr);
+        if(dataOut != NULL) __atomic_fetch_sub(&pTree->count, 1, __ATOMIC_RELAXED);
+        return dataOut;
+    }
+    if(pTree->clone != NULL && _search(pTree, pTree->root, keyPtr) == NULL)
+        return NULL; // no path copies for a missing key
+    pTree->root = _delete(pTree, pTree->root, keyPtr, &dataOut);
     if (dataOut != NULL) {
         pTree->count--;
     }
@@ -311,39 +825,908 @@ void *AVLT_Delete( TREE *pTree, void *keyPtr){
 			NULL not found
 */
 void *AVLT_Search( TREE *pTree, void *keyPtr){
-    NODE *searched = _search(pTree->root, keyPtr, pTree->compare);
+    if(pTree->cache != NULL)
+        return _cacheSearch(pTree, keyPtr);
+    return _find(pTree, keyPtr);
+}
+
+// used in AVLT_Search
+static void *_find( TREE *pTree, void *keyPtr){
+    if(pTree->image != NULL)
+        return _imageSearch(pTree, keyPtr);
+    if(pTree->bplus != NULL)
+        return BPT_Search(pTree->bplus, keyPtr);
+    if(pTree->compact != NULL)
+        return CAVL_Search(pTree->compact, keyPtr);
+    if(pTree->concurrent != NULL)
+        return OCAVL_Search(pTree->concurrent, keyPtr);
+    NODE *searched = _search(pTree, pTree->root, keyPtr);
     return searched ? searched->dataPtr : NULL;
 }
 
 /* prints tree using inorder traversal
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void AVLT_Traverse( TREE *pTree, void (*callback)(const void *)){
-    _traverse(pTree->root, callback);
+int AVLT_Traverse( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL)
+        _imageWalk(pTree, 0, 0, callback);
+    else if(pTree->bplus != NULL)
+        BPT_Traverse(pTree->bplus, 0, callback);
+    else if(pTree->compact != NULL)
+        CAVL_Traverse(pTree->compact, 0, callback);
+    else if(pTree->concurrent != NULL)
+        OCAVL_Traverse(pTree->concurrent, 0, callback);
+    else
+        return _traverse(pTree, callback);
+    return 1;
 }
 
 /* prints tree using right-to-left inorder traversal
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void AVLT_TraverseR( TREE *pTree, void (*callback)(const void *)){
-    _traverseR(pTree->root, callback);
+int AVLT_TraverseR( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL)
+        _imageWalk(pTree, 1, 0, callback);
+    else if(pTree->bplus != NULL)
+        BPT_Traverse(pTree->bplus, 1, callback);
+    else if(pTree->compact != NULL)
+        CAVL_Traverse(pTree->compact, 1, callback);
+    else if(pTree->concurrent != NULL)
+        OCAVL_Traverse(pTree->concurrent, 1, callback);
+    else
+        return _traverseR(pTree, callback);
+    return 1;
 }
 
 /* Print tree using right-to-left inorder traversal with level
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void printTree( TREE *pTree, void (*callback)(const void *)){
-    int level = 0;
-    _inorder_print(pTree->root, level, callback);
+int printTree( TREE *pTree, void (*callback)(const void *)){
+    if(pTree->image != NULL)
+        _imageWalk(pTree, 1, 1, callback);
+    else if(pTree->bplus != NULL)
+        BPT_Print(pTree->bplus, callback);
+    else if(pTree->compact != NULL)
+        CAVL_Print(pTree->compact, callback);
+    else if(pTree->concurrent != NULL)
+        OCAVL_Print(pTree->concurrent, callback);
+    else
+        return _inorder_print(pTree, callback);
+    return 1;
 }
 
 /* returns number of nodes in tree
 */
 int AVLT_Count( TREE *pTree){
+    if(pTree->image != NULL)
+        return ((IMAGE_HEADER *)pTree->image)->count;
     return pTree->count;
 }
 
 /* returns height of the tree
 */
 int AVLT_Height( TREE *pTree){
+    if(pTree->image != NULL){
+        // the image holds a balanced tree
+        int height = 0;
+        while(height < 32 && (1ull << height) - 1 < ((IMAGE_HEADER *)pTree->image)->count) height++;
+        return height;
+    }
+    if(pTree->bplus != NULL)
+        return pTree->bplus->height;
+    if(pTree->compact != NULL)
+        return CAVL_Height(pTree->compact);
+    if(pTree->concurrent != NULL)
+        return OCAVL_Height(pTree->concurrent);
     return getHeight(pTree->root);
 }
 
+/* checks the AVL invariants: keys strictly ascending in order, stored heights and
+	subtree sizes right, subtree heights of every node differ by at most 1, count matches
+	return	1 valid (a mapped image is always valid)
+			0 broken
+*/
+int AVLT_Check( TREE *pTree){
+    if(pTree->image != NULL) return 1;
+    if(pTree->bplus != NULL) return BPT_Check(pTree->bplus, pTree->count);
+    if(pTree->compact != NULL) return CAVL_Check(pTree->compact, pTree->count);
+    if(pTree->concurrent != NULL) return OCAVL_Check(pTree->concurrent, pTree->count);
+    if(_check(pTree, pTree->root, NULL, NULL, 0) < 0) return 0;
+    return getSize(pTree->root) == pTree->count;
+}
+
+/* returns operation counters of the tree
+	all zero if not compiled with -DADT_STATS
+*/
+TREE_STATS AVLT_Stats( TREE *pTree){
+#ifdef ADT_STATS
+    return pTree->stats;
+#else
+    (void)pTree;
+    return (TREE_STATS){0};
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// iterator
 
+#define prefetch(p)	__builtin_prefetch(p)
+
+// internal function
+// prefetches what the consumer touches next: the data of the node after the cursor
+// and the subtree the following step descends into
+static void _iterPrefetch( AVLT_ITER *pIter){
+    if(pIter->depth == 0) return;
+    NODE *pNode = pIter->path[pIter->depth - 1];
+    prefetch(pNode->dataPtr);
+    if(pNode->right != NULL) prefetch(pNode->right);
+    if(pNode->left != NULL) prefetch(pNode->left);
+}
+
+// internal function
+// pushes root and its left (or right) spine
+static void _iterSpine( AVLT_ITER *pIter, NODE *root, int toRight){
+    while(root != NULL){
+        pIter->path[pIter->depth++] = root;
+        NODE *child = toRight ? root->right : root->left;
+        if(child != NULL) prefetch(child);
+        root = child;
+    }
+}
+
+/* Allocates an iterator positioned before the first node
+	return	iterator pointer
+			NULL if overflow
+*/
+AVLT_ITER *AVLT_IterCreate( TREE *pTree){
+    AVLT_ITER *pIter = malloc(sizeof(AVLT_ITER));
+    if(pIter == NULL) return NULL;
+    // no path from the root is longer than the height, so the path never grows
+    pIter->path = malloc(sizeof(NODE *) * WALK_STACK);
+    if(pIter->path == NULL){
+        free(pIter);
+        return NULL;
+    }
+    pIter->pTree = pTree;
+    AVLT_IterBegin(pIter);
+    return pIter;
+}
+
+/* recycles memory of the iterator
+*/
+void AVLT_IterDestroy( AVLT_ITER *pIter){
+    free(pIter->path);
+    free(pIter);
+}
+
+/* positions the iterator before the first node
+*/
+void AVLT_IterBegin( AVLT_ITER *pIter){
+    pIter->depth = 0;
+    _iterSpine(pIter, pIter->pTree->root, 0);
+    _iterPrefetch(pIter);
+}
+
+/* positions the iterator after the last node (for AVLT_IterPrev)
+*/
+void AVLT_IterEnd( AVLT_ITER *pIter){
+    pIter->depth = 0;
+}
+
+/* positions the iterator before the first node whose data is not less than keyPtr
+*/
+void AVLT_IterSeek( AVLT_ITER *pIter, void *keyPtr){
+    NODE *pNode = pIter->pTree->root;
+    int found = 0; // path length up to the smallest node not less than key
+
+    pIter->depth = 0;
+    while(pNode != NULL){
+        pIter->path[pIter->depth++] = pNode;
+        int cmp = pIter->pTree->compare(keyPtr, pNode->dataPtr);
+        if(cmp == 0){
+            found = pIter->depth;
+            break;
+        }
+        if(cmp < 0){
+            found = pIter->depth;
+            pNode = pNode->left;
+        }
+        else pNode = pNode->right;
+    }
+    pIter->depth = found;
+    _iterPrefetch(pIter);
+}
+
+/* returns data after the cursor and moves the cursor forward
+			NULL if at the end
+*/
+void *AVLT_IterNext( AVLT_ITER *pIter){
+    if(pIter->depth == 0) return NULL;
+
+    NODE *pNode = pIter->path[pIter->depth - 1];
+    if(pNode->right != NULL)
+        _iterSpine(pIter, pNode->right, 0);
+    else{
+        // climb while coming up from a right child
+        int i = pIter->depth - 1;
+        while(i > 0 && pIter->path[i - 1]->right == pIter->path[i]) i--;
+        pIter->depth = i;
+    }
+    _iterPrefetch(pIter);
+    return pNode->dataPtr;
+}
+
+/* returns data before the cursor and moves the cursor backward
+			NULL if at the beginning
+*/
+void *AVLT_IterPrev( AVLT_ITER *pIter){
+    if(pIter->depth == 0)
+        _iterSpine(pIter, pIter->pTree->root, 1);
+    else{
+        NODE *pNode = pIter->path[pIter->depth - 1];
+        if(pNode->left != NULL)
+            _iterSpine(pIter, pNode->left, 1);
+        else{
+            // climb while coming up from a left child
+            int i = pIter->depth - 1;
+            while(i > 0 && pIter->path[i - 1]->left == pIter->path[i]) i--;
+            if(i == 0) return NULL; // already at the beginning
+            pIter->depth = i;
+        }
+    }
+    if(pIter->depth == 0) return NULL; // empty tree
+
+    _iterPrefetch(pIter);
+    return pIter->path[pIter->depth - 1]->dataPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// front cache
+
+// used in AVLT_Search
+// a hit moves to the front of its set; a miss found in the tree pushes the least
+// recently used entry of the set out
+static void *_cacheSearch( TREE *pTree, void *keyPtr){
+    struct avlt_cache *pCache = pTree->cache;
+    uint32_t hash = pCache->hash(keyPtr);
+    CACHE_ENTRY *set = pCache->sets + (size_t)(hash & pCache->mask) * CACHE_WAYS;
+
+    for(int i = 0; i < CACHE_WAYS && set[i].dataPtr != NULL; i++){
+        if(set[i].hash != hash || pTree->compare(keyPtr, set[i].dataPtr) != 0) continue;
+        CACHE_ENTRY hit = set[i];
+        memmove(set + 1, set, sizeof(CACHE_ENTRY) * i);
+        set[0] = hit;
+        pCache->stats.hits++;
+        return hit.dataPtr;
+    }
+
+    pCache->stats.misses++;
+    void *dataPtr = _find(pTree, keyPtr);
+    if(dataPtr != NULL){
+        memmove(set + 1, set, sizeof(CACHE_ENTRY) * (CACHE_WAYS - 1));
+        set[0].hash = hash;
+        set[0].dataPtr = dataPtr;
+    }
+    return dataPtr;
+}
+
+// used in AVLT_Delete
+// every entry of the hash goes, so no compare runs on data about to be freed
+static void _cacheDrop( TREE *pTree, void *keyPtr){
+    struct avlt_cache *pCache = pTree->cache;
+    uint32_t hash = pCache->hash(keyPtr);
+    CACHE_ENTRY *set = pCache->sets + (size_t)(hash & pCache->mask) * CACHE_WAYS;
+    int kept = 0;
+
+    for(int i = 0; i < CACHE_WAYS; i++)
+        if(set[i].dataPtr != NULL && set[i].hash != hash)
+            set[kept++] = set[i];
+    for(; kept < CACHE_WAYS; kept++)
+        set[kept].dataPtr = NULL;
+}
+
+// used in AVLT_Split, AVLT_Join, AVLT_Union
+static void _cacheClear( TREE *pTree){
+    if(pTree->cache != NULL)
+        memset(pTree->cache->sets, 0, sizeof(CACHE_ENTRY) * CACHE_WAYS * ((size_t)pTree->cache->mask + 1));
+}
+
+/* Puts a set-associative cache of about entries data in front of AVLT_Search (0: none)
+	return	1 success
+			0 overflow, or the tree is persistent or concurrent
+*/
+int AVLT_EnableCache( TREE *pTree, int entries, uint32_t (*hash)(const void *)){
+    if(pTree->cache != NULL){
+        free(pTree->cache->sets);
+        free(pTree->cache);
+        pTree->cache = NULL;
+    }
+    if(entries <= 0) return 1;
+    if(pTree->clone != NULL || pTree->concurrent != NULL) return 0;
+
+    uint32_t sets = 1;
+    while(sets < (1u << 28) && (long)sets * CACHE_WAYS < entries) sets *= 2;
+    struct avlt_cache *pCache = malloc(sizeof(struct avlt_cache));
+    void *mem;
+    if(pCache == NULL || posix_memalign(&mem, 64, sizeof(CACHE_ENTRY) * CACHE_WAYS * (size_t)sets) != 0){
+        free(pCache);
+        return 0;
+    }
+    pCache->sets = mem;
+    pCache->mask = sets - 1;
+    pCache->hash = hash;
+    pCache->stats = (AVLT_CACHE_STATS){0};
+    pTree->cache = pCache;
+    _cacheClear(pTree);
+    return 1;
+}
+
+/* returns hit and miss counts of the cache since AVLT_EnableCache
+*/
+AVLT_CACHE_STATS AVLT_CacheStats( TREE *pTree){
+    if(pTree->cache == NULL) return (AVLT_CACHE_STATS){0};
+    return pTree->cache->stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// batch search
+
+#define BATCH_LANES	16	// lookups in flight at once
+
+/* Searches keys[0..n-1] and stores the data found (NULL if none) in out[0..n-1]
+*/
+void AVLT_SearchBatch( TREE *pTree, void *keys[], int n, void *out[]){
+    if(pTree->image != NULL || pTree->bplus != NULL || pTree->compact != NULL || pTree->concurrent != NULL || pTree->cache != NULL || pTree->root == NULL){
+        for(int i = 0; i < n; i++)
+            out[i] = AVLT_Search(pTree, keys[i]);
+        return;
+    }
+
+    // each lane walks down for one key in two steps per level: the node has been
+    // prefetched, so read it and prefetch its data; the data has been prefetched, so
+    // compare and prefetch the child; a lane whose key is done takes the next key
+    NODE *node[BATCH_LANES];
+    int key[BATCH_LANES], hasData[BATCH_LANES];
+    int lanes = (n < BATCH_LANES) ? n : BATCH_LANES, next = lanes, active = lanes;
+    for(int l = 0; l < lanes; l++){
+        node[l] = pTree->root;
+        key[l] = l;
+        hasData[l] = 0;
+    }
+
+    while(active > 0){
+        for(int l = 0; l < lanes; l++){
+            if(key[l] < 0) continue;
+            NODE *pNode = node[l];
+            if(!hasData[l]){
+                prefetch(pNode->dataPtr);
+                hasData[l] = 1;
+                continue;
+            }
+            int cmp = pTree->compare(keys[key[l]], pNode->dataPtr);
+            STAT_ADD(pTree, compares, 1);
+            NODE *child = (cmp > 0) ? pNode->right : pNode->left;
+            hasData[l] = 0;
+            if(cmp != 0 && child != NULL){
+                STAT_ADD(pTree, hops, 1);
+                prefetch(child);
+                node[l] = child;
+                continue;
+            }
+            out[key[l]] = (cmp == 0) ? pNode->dataPtr : NULL;
+            if(next < n){
+                key[l] = next++;
+                node[l] = pTree->root;
+            }
+            else{
+                key[l] = -1;
+                active--;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// order statistics
+
+/* returns the k-th smallest data (1 <= k <= count) in O(log n)
+			NULL if k is out of range
+*/
+void *AVLT_Select( TREE *pTree, int k){
+    NODE *pNode = pTree->root;
+    if(k < 1 || k > pTree->count) return NULL;
+
+    while(pNode != NULL){
+        int leftSize = getSize(pNode->left);
+        if(k == leftSize + 1) return pNode->dataPtr;
+        if(k <= leftSize) pNode = pNode->left;
+        else{
+            k -= leftSize + 1;
+            pNode = pNode->right;
+        }
+        STAT_ADD(pTree, hops, 1);
+    }
+    return NULL;
+}
+
+// internal function
+// return	number of data less than keyPtr (less than or equal if inclusive)
+static int _countLess( TREE *pTree, void *keyPtr, int inclusive){
+    NODE *pNode = pTree->root;
+    int count = 0;
+
+    while(pNode != NULL){
+        int cmp = pTree->compare(keyPtr, pNode->dataPtr);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp > 0 || (cmp == 0 && inclusive)){
+            count += getSize(pNode->left) + 1;
+            if(cmp == 0) break;
+            pNode = pNode->right;
+        }
+        else if(cmp == 0){
+            count += getSize(pNode->left);
+            break;
+        }
+        else pNode = pNode->left;
+        STAT_ADD(pTree, hops, 1);
+    }
+    return count;
+}
+
+/* returns rank (1-based position in sorted order) of keyPtr in O(log n)
+	if the key is not in the tree, the position it would get when inserted
+*/
+int AVLT_Rank( TREE *pTree, void *keyPtr){
+    return _countLess(pTree, keyPtr, 0) + 1;
+}
+
+/* returns number of data in [loPtr, hiPtr] in O(log n)
+*/
+int AVLT_RangeCount( TREE *pTree, void *loPtr, void *hiPtr){
+    if(pTree->compare(loPtr, hiPtr) > 0) return 0;
+    return _countLess(pTree, hiPtr, 1) - _countLess(pTree, loPtr, 0);
+}
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+	visits only the nodes in range (plus one root-to-leaf path)
+*/
+void AVLT_RangeTraverse( TREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    if(pTree->bplus != NULL){
+        BPT_RangeTraverse(pTree->bplus, loPtr, hiPtr, callback);
+        return;
+    }
+    if(pTree->compact != NULL){
+        CAVL_RangeTraverse(pTree->compact, loPtr, hiPtr, callback);
+        return;
+    }
+    if(pTree->concurrent != NULL){
+        OCAVL_RangeTraverse(pTree->concurrent, loPtr, hiPtr, callback);
+        return;
+    }
+    AVLT_ITER *pIter = AVLT_IterCreate(pTree);
+    void *dataPtr;
+    if(pIter == NULL) return;
+
+    AVLT_IterSeek(pIter, loPtr);
+    while((dataPtr = AVLT_IterNext(pIter)) != NULL && pTree->compare(dataPtr, hiPtr) <= 0)
+        callback(dataPtr);
+    AVLT_IterDestroy(pIter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// join, split and union
+
+#define UNION_GRAIN	4096	// nodes a forked half of a union needs at least
+
+// one half of a union run by another thread
+typedef struct
+{
+    TREE	*pTree;	// head for compare and the counters of this thread
+    NODE	*a;
+    NODE	*b;
+    void	(*combine)(void *, void *);
+    int		nThreads;
+    NODE	*root;	// result
+} UNION_TASK;
+
+// used in AVLT_Join, AVLT_Split, _split, _union
+// links left, mid and right, where every key of left < mid < every key of right
+// descends the spine of the taller tree to a subtree of about the other's height and
+// rebalances on the way back, so it costs O(|height(left) - height(right)| + 1)
+// return	pointer to root
+static NODE *_join( TREE *pTree, NODE *left, NODE *mid, NODE *right){
+    if(getHeight(left) > getHeight(right) + 1){
+        left->right = _join(pTree, left->right, mid, right);
+        return _rebalance(pTree, left);
+    }
+    if(getHeight(right) > getHeight(left) + 1){
+        right->left = _join(pTree, left, mid, right->left);
+        return _rebalance(pTree, right);
+    }
+    mid->left = left;
+    mid->right = right;
+    return _rebalance(pTree, mid);
+}
+
+// used in AVLT_Join
+// unlinks the smallest node of the subtree into *minOut
+// return	pointer to root
+static NODE *_splitMin( TREE *pTree, NODE *root, NODE **minOut){
+    if(root->left == NULL){
+        *minOut = root;
+        return root->right;
+    }
+    root->left = _splitMin(pTree, root->left, minOut);
+    return _rebalance(pTree, root);
+}
+
+// used in AVLT_Split, _union
+// splits the subtree into the nodes less than keyPtr (*lessOut) and greater (*greaterOut)
+// return	the unlinked node equal to keyPtr
+//			NULL if none
+static NODE *_split( TREE *pTree, NODE *root, void *keyPtr, NODE **lessOut, NODE **greaterOut){
+    if(root == NULL){
+        *lessOut = *greaterOut = NULL;
+        return NULL;
+    }
+    STAT_ADD(pTree, compares, 1);
+    STAT_ADD(pTree, hops, 1);
+    int cmp = pTree->compare(keyPtr, root->dataPtr);
+    NODE *found = root, *part;
+    if(cmp == 0){
+        *lessOut = root->left;
+        *greaterOut = root->right;
+    }
+    else if(cmp < 0){
+        found = _split(pTree, root->left, keyPtr, lessOut, &part);
+        *greaterOut = _join(pTree, part, root, root->right);
+    }
+    else{
+        found = _split(pTree, root->right, keyPtr, &part, greaterOut);
+        *lessOut = _join(pTree, root->left, root, part);
+    }
+    return found;
+}
+
+static NODE *_union( TREE *pTree, NODE *a, NODE *b, void (*combine)(void *, void *), int nThreads);
+
+// used in _union
+static void *_unionWorker( void *arg){
+    UNION_TASK *pTask = arg;
+    pTask->root = _union(pTask->pTree, pTask->a, pTask->b, pTask->combine, pTask->nThreads);
+    return NULL;
+}
+
+// used in AVLT_Union
+// splits a by the root of b, unites the two lower and the two upper halves (in another
+// thread while nThreads > 1 and both halves are big enough) and joins the results around
+// the root of b, which takes the data of a on a duplicated key; no node is allocated
+// return	pointer to root
+static NODE *_union( TREE *pTree, NODE *a, NODE *b, void (*combine)(void *, void *), int nThreads){
+    if(a == NULL) return b;
+    if(b == NULL) return a;
+
+    NODE *less, *greater;
+    NODE *found = _split(pTree, a, b->dataPtr, &less, &greater);
+    if(found != NULL){
+        combine(found->dataPtr, b->dataPtr);
+        b->dataPtr = found->dataPtr;
+        free(found);
+    }
+
+    NODE *left, *right;
+    if(nThreads > 1 && getSize(less) + getSize(b->left) >= UNION_GRAIN
+        && getSize(greater) + getSize(b->right) >= UNION_GRAIN){
+        TREE head = *pTree;
+#ifdef ADT_STATS
+        head.stats = (TREE_STATS){0};
+#endif
+        UNION_TASK task = {&head, less, b->left, combine, nThreads / 2, NULL};
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, _unionWorker, &task) == 0){
+            right = _union(pTree, greater, b->right, combine, nThreads - nThreads / 2);
+            pthread_join(thread, NULL);
+#ifdef ADT_STATS
+            pTree->stats.compares += head.stats.compares;
+            pTree->stats.hops += head.stats.hops;
+            pTree->stats.rotations += head.stats.rotations;
+#endif
+            return _join(pTree, task.root, b, right);
+        }
+    }
+    // one after the other, so each half may fork with all the threads
+    left = _union(pTree, less, b->left, combine, nThreads);
+    right = _union(pTree, greater, b->right, combine, nThreads);
+    return _join(pTree, left, b, right);
+}
+
+// used in AVLT_Join, AVLT_Split and AVLT_Union
+// return	1 if the tree is a plain AVL tree of its own nodes
+static int _joinable( TREE *pTree){
+    return pTree->image == NULL && pTree->bplus == NULL && pTree->compact == NULL && pTree->concurrent == NULL && pTree->clone == NULL;
+}
+
+/* Moves all data of pRight, whose keys must all be greater, to the end of pTree
+	return	1 success
+			0 keys overlap or a tree is not a plain AVL tree
+*/
+int AVLT_Join( TREE *pTree, TREE *pRight){
+    if(!_joinable(pTree) || !_joinable(pRight)) return 0;
+    if(pRight->root == NULL) return 1;
+    if(pTree->root != NULL){
+        NODE *last = pTree->root, *first = pRight->root;
+        while(last->right != NULL) last = last->right;
+        while(first->left != NULL) first = first->left;
+        STAT_ADD(pTree, compares, 1);
+        if(pTree->compare(last->dataPtr, first->dataPtr) >= 0) return 0;
+    }
+
+    NODE *mid;
+    NODE *right = _splitMin(pTree, pRight->root, &mid);
+    pTree->root = _join(pTree, pTree->root, mid, right);
+    pTree->count += pRight->count;
+    pRight->root = NULL;
+    pRight->count = 0;
+    _cacheClear(pRight);
+    STAT_PEAK(pTree);
+    return 1;
+}
+
+/* Moves the data not less than keyPtr from pTree to a new tree
+	return	head node pointer
+			NULL if overflow or the tree is not a plain AVL tree
+*/
+TREE *AVLT_Split( TREE *pTree, void *keyPtr){
+    if(!_joinable(pTree)) return NULL;
+    TREE *pRight = AVLT_Create(pTree->compare);
+    if(pRight == NULL) return NULL;
+
+    NODE *less, *greater;
+    NODE *found = _split(pTree, pTree->root, keyPtr, &less, &greater);
+    if(found != NULL)
+        greater = _join(pTree, NULL, found, greater);
+    pTree->root = less;
+    pTree->count = getSize(less);
+    _cacheClear(pTree);
+    pRight->root = greater;
+    pRight->count = getSize(greater);
+    return pRight;
+}
+
+/* Moves all data of pOther into pTree with up to nThreads threads
+	return	1 success
+			0 a tree is not a plain AVL tree
+*/
+int AVLT_Union( TREE *pTree, TREE *pOther, int nThreads, void (*combine)(void *dataPtr, void *otherPtr)){
+    if(!_joinable(pTree) || !_joinable(pOther)) return 0;
+    if(nThreads < 1) nThreads = 1;
+    pTree->root = _union(pTree, pTree->root, pOther->root, combine, nThreads);
+    pTree->count = getSize(pTree->root);
+    pOther->root = NULL;
+    pOther->count = 0;
+    _cacheClear(pOther);
+    STAT_PEAK(pTree);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// binary image
+
+// used in AVLT_Save
+// numbers the nodes of the balanced tree over sorted positions [lo, hi) in preorder
+// and fills them; the record of sorted position pos is at recOff[pos]
+// return	index of the subtree root, 0 if empty
+static uint32_t _imageLink( IMAGE_NODE *nodes, uint32_t *recOff, int lo, int hi, uint32_t *next){
+    if(lo >= hi) return 0;
+    int mid = lo + (hi - lo) / 2;
+    uint32_t i = (*next)++;
+    nodes[i].rec = recOff[mid];
+    nodes[i].left = _imageLink(nodes, recOff, lo, mid, next);
+    nodes[i].right = _imageLink(nodes, recOff, mid + 1, hi, next);
+    return i;
+}
+
+// used in AVLT_Save
+// lays out header, nodes and the packed records of the tree in one buffer
+// return	image (size in *sizeOut)
+//			NULL if overflow or the image exceeds 4 GB
+static char *_imageBuild( TREE *pTree, uint32_t *recOff, size_t (*pack)(const void *, void *), uint64_t *sizeOut){
+    int n = pTree->count;
+    AVLT_ITER *pIter = AVLT_IterCreate(pTree);
+    if(pIter == NULL) return NULL;
+
+    // records first, so the size of the whole image is known
+    uint64_t poolSize = 0;
+    for(int i = 0; i < n; i++){
+        recOff[i] = (uint32_t)poolSize;
+        // 8-byte aligned; at least one NUL follows the last record, which _imageValid checks
+        poolSize += (pack(AVLT_IterNext(pIter), NULL) + (i == n - 1 ? 8 : 7)) & ~(size_t)7;
+        if(poolSize > UINT32_MAX){
+            AVLT_IterDestroy(pIter);
+            return NULL;
+        }
+    }
+    uint64_t nodeOff = sizeof(IMAGE_HEADER);
+    uint64_t poolOff = (nodeOff + sizeof(IMAGE_NODE) * (uint64_t)n + 7) & ~(uint64_t)7;
+    char *image = NULL;
+    if(poolOff + poolSize <= UINT32_MAX)
+        image = calloc(1, poolOff + poolSize);
+    if(image == NULL){
+        AVLT_IterDestroy(pIter);
+        return NULL;
+    }
+
+    IMAGE_HEADER *h = (IMAGE_HEADER *)image;
+    memcpy(h->magic, IMAGE_MAGIC, 8);
+    h->count = n;
+    h->nodeOff = nodeOff;
+    h->poolOff = poolOff;
+    h->poolSize = poolSize;
+    uint32_t next = 0;
+    _imageLink(IMAGE_NODES(h), recOff, 0, n, &next);
+    AVLT_IterBegin(pIter);
+    for(int i = 0; i < n; i++)
+        pack(AVLT_IterNext(pIter), IMAGE_POOL(h) + recOff[i]);
+    AVLT_IterDestroy(pIter);
+
+    *sizeOut = poolOff + poolSize;
+    return image;
+}
+
+// used in AVLT_Load
+// return	1 if the mapped file is an image whose offsets all stay inside it, whose pool ends
+//			in NUL (records compared as strings stop inside it) and whose nodes form a tree
+//			of at most IMAGE_DEPTH levels (so every walk and search ends)
+static int _imageValid( const void *image, size_t size){
+    const IMAGE_HEADER *h = image;
+    if(size < sizeof(IMAGE_HEADER) || memcmp(h->magic, IMAGE_MAGIC, 8) != 0)
+        return 0;
+    if(h->nodeOff % 8 != 0 || h->poolOff % 8 != 0
+        || (uint64_t)h->nodeOff + (uint64_t)h->count * sizeof(IMAGE_NODE) > h->poolOff
+        || (uint64_t)h->poolOff + h->poolSize > size)
+        return 0;
+    if(h->count == 0) return 1;
+    if(h->poolSize == 0 || IMAGE_POOL(h)[h->poolSize - 1] != '\0')
+        return 0;
+
+    // both layouts place a child after its parent, so no link leads back up
+    const IMAGE_NODE *nodes = IMAGE_NODES(h);
+    for(uint32_t i = 0; i < h->count; i++){
+        if(nodes[i].left >= h->count || nodes[i].right >= h->count || nodes[i].rec >= h->poolSize)
+            return 0;
+        if((nodes[i].left != 0 && nodes[i].left <= i) || (nodes[i].right != 0 && nodes[i].right <= i))
+            return 0;
+    }
+
+    // preorder walk from the root; a pending right child waits on the level of its parent,
+    // so the stack never holds more than the depth
+    uint32_t stack[IMAGE_DEPTH];
+    int levels[IMAGE_DEPTH];
+    int top = 0, level = 1;
+    uint32_t i = 0, visited = 0;
+    while(1){
+        if(level > IMAGE_DEPTH || ++visited > h->count) return 0;
+        if(nodes[i].right != 0){
+            stack[top] = nodes[i].right;
+            levels[top++] = level + 1;
+        }
+        if(nodes[i].left != 0){
+            i = nodes[i].left;
+            level++;
+        }
+        else if(top > 0){
+            i = stack[--top];
+            level = levels[top];
+        }
+        else break;
+    }
+    return 1;
+}
+
+// used in AVLT_Search
+static void *_imageSearch( TREE *pTree, void *keyPtr){
+    IMAGE_HEADER *h = pTree->image;
+    IMAGE_NODE *nodes = IMAGE_NODES(h);
+    uint32_t i = 0;
+    if(h->count == 0) return NULL;
+    while(1){
+        void *rec = IMAGE_POOL(h) + nodes[i].rec;
+        int cmp = pTree->compare(keyPtr, rec);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0)
+            return rec;
+        i = (cmp < 0) ? nodes[i].left : nodes[i].right;
+        if(i == 0)
+            return NULL;
+        STAT_ADD(pTree, hops, 1);
+    }
+}
+
+// used in AVLT_Traverse, AVLT_TraverseR and printTree
+// in-order walk over the image with a fixed stack (the saved tree is balanced)
+static void _imageWalk( TREE *pTree, int toRight, int withLevel, void (*callback)(const void *)){
+    IMAGE_HEADER *h = pTree->image;
+    IMAGE_NODE *nodes = IMAGE_NODES(h);
+    uint32_t stack[IMAGE_DEPTH];
+    int levels[IMAGE_DEPTH];
+    int depth = 0;
+    int level = 1;
+    uint32_t i = 0;
+    int has = h->count > 0;
+
+    while(1){
+        while(has){
+            if(depth == IMAGE_DEPTH) return; // not an image _imageValid accepts
+            stack[depth] = i;
+            levels[depth++] = level++;
+            i = toRight ? nodes[i].right : nodes[i].left;
+            has = i != 0;
+        }
+        if(depth == 0) break;
+        i = stack[--depth];
+        level = levels[depth];
+        if(withLevel)
+            for(int j = 0; j < level; j++)
+                printf("\t");
+        callback(IMAGE_POOL(h) + nodes[i].rec);
+        i = toRight ? nodes[i].left : nodes[i].right;
+        has = i != 0;
+        level++;
+    }
+}
+
+/* Writes the tree to a binary image file that AVLT_Load maps back without deserialization
+	return	1 success
+			0 overflow or write error
+*/
+int AVLT_Save( TREE *pTree, const char *path, size_t (*pack)(const void *dataPtr, void *buf)){
+    if(pTree->image != NULL || pTree->bplus != NULL || pTree->compact != NULL || pTree->concurrent != NULL) return 0;
+
+    uint32_t *recOff = malloc(sizeof(uint32_t) * (pTree->count ? pTree->count : 1));
+    char *image = NULL;
+    uint64_t size = 0;
+    if(recOff != NULL)
+        image = _imageBuild(pTree, recOff, pack, &size);
+    free(recOff);
+    if(image == NULL) return 0;
+
+    FILE *fp = fopen(path, "wb");
+    int ok = 0;
+    if(fp != NULL){
+        ok = fwrite(image, 1, size, fp) == size;
+        if(fclose(fp) != 0) ok = 0;
+    }
+    free(image);
+    return ok;
+}
+
+/* Maps an image written by AVLT_Save read-only into memory
+	return	head node pointer
+			NULL if the file cannot be mapped or is not an image
+*/
+TREE *AVLT_Load( const char *path, int (*compareRec)(const void *, const void *)){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0) return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(IMAGE_HEADER)){
+        close(fd);
+        return NULL;
+    }
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) return NULL;
+
+    TREE *pTree = NULL;
+    if(_imageValid(image, st.st_size))
+        pTree = AVLT_Create(compareRec);
+    if(pTree == NULL){
+        munmap(image, st.st_size);
+        return NULL;
+    }
+    pTree->image = image;
+    pTree->imageSize = st.st_size;
+    return pTree;
+}
@@ -1,3 +1,18 @@
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+////////////////////////////////////////////////////////////////////////////////
+// engines of AVLT_CreateEngine
+#define AVLT_AVL	0	// AVL tree of NODEs (AVLT_Create)
+#define AVLT_BPLUS	1	// B+-tree of cache-line nodes (bptree.h)
+#define AVLT_COMPACT	2	// AVL tree of 32-byte pool nodes with inline keys (cavl.h)
+#define AVLT_CONCURRENT	3	// AVL tree for many threads at once (ocavl.h)
+
+struct bptree;
+struct cavl;
+struct ocavl;
+struct avlt_cache;
+
 ////////////////////////////////////////////////////////////////////////////////
 // TREE type definition
 typedef struct node
@@ -6,15 +21,57 @@ typedef struct node
 	struct node	*left;
 	struct node	*right;
 	int 	height; // newly added
+	int 	size;	// number of nodes in the subtree rooted here
+	int		refs;	// links to the node, roots of snapshots included (1 unless persistent)
 } NODE;
 
+// operation counters (compiled in only with -DADT_STATS); the engines count into the
+// block of their TREE (a B+-tree counts its node splits, borrows and merges as rotations)
+typedef struct tree_stats
+{
+	long	compares;	// comparator calls
+	long	hops;		// pointer hops (child links followed)
+	long	rotations;	// rotations
+	long	allocs;		// node allocations
+	int		peak;		// peak node count
+} TREE_STATS;
+
+// counters of the front cache of AVLT_Search (AVLT_EnableCache)
+typedef struct
+{
+	long	hits;		// searches answered by the cache
+	long	misses;		// searches that went down the tree
+} AVLT_CACHE_STATS;
+
 typedef struct
 {
 	int 	count;
 	NODE 	*root;
 	int 	(*compare)(const void *, const void *); 
+	NODE	**path;	// access path buffer
+	int		pathCap;
+	void	*image;	// file mapped by AVLT_Load (read-only tree), NULL otherwise
+	size_t	imageSize;
+	void	*(*clone)(const void *);	// copies data of a shared node, NULL unless persistent
+	struct bptree	*bplus;	// the B+-tree holding the data (AVLT_BPLUS), NULL otherwise
+	struct cavl		*compact;	// the compact AVL tree holding the data (AVLT_COMPACT), NULL otherwise
+	struct ocavl	*concurrent;	// the concurrent AVL tree holding the data (AVLT_CONCURRENT), NULL otherwise
+	struct avlt_cache	*cache;	// front cache of AVLT_Search (AVLT_EnableCache), NULL otherwise
+#ifdef ADT_STATS
+	TREE_STATS	stats;
+#endif
 } TREE;
 
+// external iterator (in-order cursor)
+// the cursor sits between two nodes; AVLT_IterNext/AVLT_IterPrev return the data after/before it
+// any insertion or deletion invalidates the iterator
+typedef struct
+{
+	TREE	*pTree;
+	NODE	**path;		// path from root to the node after the cursor (room for any AVL tree)
+	int		depth;		// length of path, 0 if the cursor is at the end
+} AVLT_ITER;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Prototype declarations
 
@@ -24,12 +81,91 @@ typedef struct
 */
 TREE *AVLT_Create( int (*compare)(const void *, const void *));
 
+/* Allocates a tree head on the given engine
+	AVLT_BPLUS keeps the data in a B+-tree: each node holds 8 keys with their first 8
+	bytes (from getKey) in one cache line, so a search compares integers and calls compare
+	only on equal prefixes, and the leaves are linked for traversal; compare must order
+	data like strcmp on getKey (getKey may be NULL: every key calls compare)
+	AVLT_COMPACT keeps an AVL tree of 32-byte nodes in one pool: 32-bit child indices, an
+	8-bit balance factor and the first 14 bytes of the key (from getKey, same contract),
+	so most comparisons end inside the node; a longer key calls compare on a tie
+	AVLT_CONCURRENT keeps an AVL tree that threads share (getKey is not used):
+	AVLT_Search takes no lock, and AVLT_Insert and AVLT_Delete lock one to three
+	nodes at a time, so the three run in any number of threads at once; the callback
+	of AVLT_Insert runs without a lock and must be atomic (e.g. an atomic increment of a
+	frequency); data returned by AVLT_Search or AVLT_Delete may be read until the calling
+	thread's next call of the three; unlinked nodes are freed in batches once every thread
+	has moved on, and so is deleted data if AVLT_SetRelease gave the tree a callback for
+	it (without one it may be freed only after AVLT_Destroy); the other functions need the
+	tree to be left alone by other threads
+	these engines serve AVLT_Insert, AVLT_Delete, AVLT_Search, AVLT_Traverse,
+	AVLT_TraverseR, AVLT_RangeTraverse, printTree, AVLT_Count, AVLT_Height, AVLT_Check
+	and AVLT_Destroy; AVLT_SetPersistent and AVLT_Save return 0, the other functions
+	see an empty tree
+	return	head node pointer
+			NULL if overflow or unknown engine
+*/
+TREE *AVLT_CreateEngine( int (*compare)(const void *, const void *), int engine, const char *(*getKey)(const void *));
+
+/* Gives a concurrent tree (AVLT_CONCURRENT) the callback that frees data AVLT_Delete
+	returns; the tree calls it once no node holds the data and every thread, the deleting
+	one included, has called AVLT_Search, AVLT_Insert or AVLT_Delete since (or exited)
+	to be set before other threads use the tree
+	return	1 success
+			0 the tree is not concurrent
+*/
+int AVLT_SetRelease( TREE *pTree, void (*callback)(void *));
+
+/* Writes the tree to a binary image file that AVLT_Load maps back without deserialization
+	pack copies data into a pointer-free record at buf and returns its size in bytes
+	(with buf NULL it only returns the size); records are stored in sorted order in a
+	pool, and the nodes of a balanced tree over them (preorder) link to each other and
+	to the records by 32-bit offsets, so the file works at any address
+	the image keeps the records, not the shape of the tree: printTree of a loaded image
+	shows the balanced tree
+	return	1 success
+			0 overflow, write error, the image exceeds 4 GB or the tree is on another engine
+*/
+int AVLT_Save( TREE *pTree, const char *path, size_t (*pack)(const void *dataPtr, void *buf));
+
+/* Maps an image written by AVLT_Save read-only into memory
+	compareRec compares a search key (as passed to AVLT_Search) with a stored record
+	the tree serves AVLT_Search, AVLT_Traverse, AVLT_TraverseR, printTree, AVLT_Count and
+	AVLT_Height straight from the mapping, and their results are pointers to the records;
+	AVLT_Insert returns 0, AVLT_Delete NULL, the other functions see an empty tree
+	AVLT_Destroy unmaps the file without calling its callback on the records
+	return	head node pointer
+			NULL if the file cannot be mapped or is not an image
+*/
+TREE *AVLT_Load( const char *path, int (*compareRec)(const void *, const void *));
+
+/* Turns on persistent mode: the tree and its snapshots (AVLT_Snapshot) share nodes
+	AVLT_Insert and AVLT_Delete copy the shared nodes on their path (O(log n) of them) and
+	never change a node another version can reach; clone copies the data of a copied node
+	(NULL if overflow), so each version owns its data and callbacks never see another
+	version's data
+	a snapshot can be searched and traversed in another thread while its origin changes;
+	AVLT_Destroy and changes of versions of the same tree must not overlap
+	return	1 success
+			0 the tree is a mapped image, on another engine or caches searches
+*/
+int AVLT_SetPersistent( TREE *pTree, void *(*clone)(const void *));
+
+/* Returns a tree head sharing all nodes with pTree in O(1) (persistent mode)
+	both trees change independently afterwards, and each is destroyed with AVLT_Destroy
+	return	head node pointer
+			NULL if overflow or the tree is not persistent
+*/
+TREE *AVLT_Snapshot( TREE *pTree);
+
 /* Deletes all data in tree and recycles memory
+	in persistent mode only the nodes (and data) no other version uses
 */
 void AVLT_Destroy( TREE *pTree, void (*callback)(void *));
 
 /* Inserts new data into the tree
 	callback은 이미 트리에 존재하는 데이터를 발견했을 때 호출하는 함수
+	in persistent mode callback gets this version's own copy of the data
 	return	1 success
 			0 overflow
 			2 if duplicated key
@@ -38,7 +174,7 @@ int AVLT_Insert( TREE *pTree, void *dataInPtr, void (*callback)(void *));
 
 /* Deletes a node with keyPtr from the tree
 	return	address of data of the node containing the key
-			NULL not found
+			NULL not found (or overflow in persistent mode)
 */
 void *AVLT_Delete( TREE *pTree, void *keyPtr);
 
@@ -48,23 +184,142 @@ void *AVLT_Delete( TREE *pTree, void *keyPtr);
 */
 void *AVLT_Search( TREE *pTree, void *keyPtr);
 
+/* Puts a set-associative cache of about entries data in front of AVLT_Search (0: none)
+	hash maps a key (as passed to AVLT_Search) to 32 bits, equal for keys compare finds
+	equal; a set of 4 entries (one cache line) keeps the data found last for keys of its
+	hash, so a repeated search costs one hash and one compare instead of a descent
+	AVLT_Delete drops the entry of its key, AVLT_Split, AVLT_Join and AVLT_Union those of
+	the tree losing data; searches that find nothing are not cached
+	return	1 success
+			0 overflow, or the tree is persistent or concurrent (AVLT_CONCURRENT)
+*/
+int AVLT_EnableCache( TREE *pTree, int entries, uint32_t (*hash)(const void *));
+
+/* returns hit and miss counts of the cache since AVLT_EnableCache
+	all zero without a cache
+*/
+AVLT_CACHE_STATS AVLT_CacheStats( TREE *pTree);
+
+/* Searches keys[0..n-1] like AVLT_Search and stores the results in out[0..n-1]
+	up to 16 lookups advance in turns, each prefetching its next node and that node's
+	data a turn before using them, so their cache misses overlap instead of stalling one
+	after another; the other engines, mapped images and cached trees search one key at a time
+*/
+void AVLT_SearchBatch( TREE *pTree, void *keys[], int n, void *out[]);
+
 /* prints tree using inorder traversal
+	the walk keeps its own stack, so walks may nest in callbacks and run in several threads
+	at once; the tree must not change while it is walked
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void AVLT_Traverse( TREE *pTree, void (*callback)(const void *));
+int AVLT_Traverse( TREE *pTree, void (*callback)(const void *));
 
 /* prints tree using right-to-left inorder traversal
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void AVLT_TraverseR( TREE *pTree, void (*callback)(const void *));
+int AVLT_TraverseR( TREE *pTree, void (*callback)(const void *));
 
 /* Print tree using right-to-left inorder traversal with level
+	return	1 success
+			0 overflow (nothing was passed to the callback)
 */
-void printTree( TREE *pTree, void (*callback)(const void *));
+int printTree( TREE *pTree, void (*callback)(const void *));
 
 /* returns number of nodes in tree
 */
 int AVLT_Count( TREE *pTree);
 
 /* returns height of the tree
+	levels of nodes for a B+-tree, leaves included
 */
 int AVLT_Height( TREE *pTree);
 
+/* returns the k-th smallest data (1 <= k <= count) in O(log n)
+			NULL if k is out of range
+*/
+void *AVLT_Select( TREE *pTree, int k);
+
+/* returns rank (1-based position in sorted order) of keyPtr in O(log n)
+	if the key is not in the tree, the position it would get when inserted
+*/
+int AVLT_Rank( TREE *pTree, void *keyPtr);
+
+/* returns number of data in [loPtr, hiPtr] in O(log n)
+*/
+int AVLT_RangeCount( TREE *pTree, void *loPtr, void *hiPtr);
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+	visits only the nodes in range (plus one root-to-leaf path)
+*/
+void AVLT_RangeTraverse( TREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *));
+
+/* Moves all data of pRight, whose keys must all be greater than those of pTree, to the
+	end of pTree in O(log n) (pRight is left empty)
+	return	1 success
+			0 keys overlap, or a tree is persistent, on another engine or a mapped image
+*/
+int AVLT_Join( TREE *pTree, TREE *pRight);
+
+/* Moves the data not less than keyPtr from pTree to a new tree in O(log n)
+	return	head node pointer
+			NULL if overflow, or the tree is persistent, on another engine or a mapped image
+*/
+TREE *AVLT_Split( TREE *pTree, void *keyPtr);
+
+/* Moves all data of pOther into pTree (pOther is left empty) by splits and joins, in
+	O(m log(n / m + 1)) for trees of m <= n nodes, without allocating nodes
+	the recursion forks halves to other threads, up to nThreads at once
+	on a duplicated key pTree keeps its data, and combine merges the data of pOther into
+	it (e.g. adds the frequency and frees otherPtr); combine may run in several threads at
+	once, but never twice on the same data
+	return	1 success
+			0 a tree is persistent, on another engine or a mapped image
+*/
+int AVLT_Union( TREE *pTree, TREE *pOther, int nThreads, void (*combine)(void *dataPtr, void *otherPtr));
+
+/* checks the AVL invariants: keys strictly ascending in order, stored heights and
+	subtree sizes right, subtree heights of every node differ by at most 1, count matches
+	(the other engines check BPT_Check, CAVL_Check, OCAVL_Check)
+	return	1 valid (a mapped image is always valid)
+			0 broken
+*/
+int AVLT_Check( TREE *pTree);
+
+/* returns operation counters of the tree
+	all zero if not compiled with -DADT_STATS
+*/
+TREE_STATS AVLT_Stats( TREE *pTree);
+
+/* Allocates an iterator positioned before the first node
+	return	iterator pointer
+			NULL if overflow
+*/
+AVLT_ITER *AVLT_IterCreate( TREE *pTree);
+
+/* recycles memory of the iterator
+*/
+void AVLT_IterDestroy( AVLT_ITER *pIter);
+
+/* positions the iterator before the first node
+*/
+void AVLT_IterBegin( AVLT_ITER *pIter);
+
+/* positions the iterator after the last node (for AVLT_IterPrev)
+*/
+void AVLT_IterEnd( AVLT_ITER *pIter);
+
+/* positions the iterator before the first node whose data is not less than keyPtr
+*/
+void AVLT_IterSeek( AVLT_ITER *pIter, void *keyPtr);
+
+/* returns data after the cursor and moves the cursor forward
+			NULL if at the end
+*/
+void *AVLT_IterNext( AVLT_ITER *pIter);
+
+/* returns data before the cursor and moves the cursor backward
+			NULL if at the beginning
+*/
+void *AVLT_IterPrev( AVLT_ITER *pIter);
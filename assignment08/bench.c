@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, realloc
+#include <string.h> // strdup, strcmp
+#include <time.h> // clock_gettime
+
+#include "bench.h"
+
+////////////////////////////////////////////////////////////////////////////////
+int compare_by_word( const void *n1, const void *n2)
+{
+	return strcmp( ((tWord *)n1)->word, ((tWord *)n2)->word);
+}
+
+const char *word_key( const void *dataPtr)
+{
+	return ((tWord *)dataPtr)->word;
+}
+
+void increase_freq(void *dataPtr)
+{
+	((tWord *)dataPtr)->freq++;
+}
+
+tWord *createWord( char *word)
+{
+	tWord *newWord = malloc( sizeof( tWord));
+
+	if (newWord == NULL) return NULL;
+
+	newWord->word = strdup( word);
+	newWord->freq = 1;
+
+	return newWord;
+}
+
+void destroyWord( void *pWord)
+{
+	free( ((tWord *)pWord)->word);
+	free( pWord);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double now( void)
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned int next_random( unsigned int *seed)
+{
+	unsigned int x = *seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *seed = x;
+}
+
+int load_tokens( char *filename, char ***tokensOut)
+{
+	char word[100];
+	int num_tokens = 0, capacity = 1024;
+	char **tokens;
+	FILE *fp = fopen( filename, "rt");
+
+	if (!fp) return -1;
+
+	tokens = malloc( sizeof( char *) * capacity);
+	while (fscanf( fp, "%99s", word) != EOF)
+	{
+		if (num_tokens == capacity)
+		{
+			capacity *= 2;
+			tokens = realloc( tokens, sizeof( char *) * capacity);
+		}
+		tokens[num_tokens++] = strdup( word);
+	}
+	fclose( fp);
+
+	*tokensOut = tokens;
+	return num_tokens;
+}
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, atoi
+#include <string.h> // strcmp, memcmp
+#include <math.h> // log2
+
+#include "avlt.h"
+#include "bench.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// height bound of an AVL tree with n nodes
+static double avl_bound( int n)
+{
+	return 1.4405 * log2( n + 2) - 0.3277;
+}
+
+// height bound of the concurrent engine with n data: its AVL tree also holds routing
+// nodes (deleted data with two children), fewer than the leaves, so under 2n nodes
+static double relaxed_bound( int n)
+{
+	return avl_bound( 2 * n);
+}
+
+// height bound of the B+-tree with n data: the root has 2 children, other inner nodes
+// at least 5, leaves at least 4 data, so n >= 8 * 5^(height - 2)
+static double bplus_bound( int n)
+{
+	return (n < 8) ? 1 : 2 + log2( n / 8.0) / log2( 5);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// lookup throughput of AVLT_SearchBatch by batch size against AVLT_Search
+// the tree holds n random words (larger than the caches for big n); q lookups of random
+// words, half of them in the tree, are answered one at a time and in batches of 1..1024
+// return	1 if a batch answers differently from AVLT_Search
+static int bench_batch( int n, int q)
+{
+	unsigned int seed = 2463534242u;
+	char word[32];
+	tWord **queries, **expected, **found;
+	TREE *tree;
+	double t0, single;
+	int failed = 0;
+
+	tree = AVLT_Create( compare_by_word);
+	while (AVLT_Count( tree) < n)
+	{
+		tWord *pWord;
+		sprintf( word, "w%09u", next_random( &seed) % (2u * n));
+		pWord = createWord( word);
+		if (AVLT_Insert( tree, pWord, increase_freq) != 1) destroyWord( pWord);
+	}
+
+	queries = malloc( sizeof( tWord *) * q);
+	expected = malloc( sizeof( tWord *) * q);
+	found = malloc( sizeof( tWord *) * q);
+	for (int i = 0; i < q; i++)
+	{
+		sprintf( word, "w%09u", next_random( &seed) % (2u * n));
+		queries[i] = createWord( word);
+	}
+
+	// the faster of two passes, so the first one's cold start does not count
+	single = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		double elapsed;
+
+		t0 = now();
+		for (int i = 0; i < q; i++)
+			expected[i] = AVLT_Search( tree, queries[i]);
+		elapsed = now() - t0;
+		if (pass == 0 || elapsed < single) single = elapsed;
+	}
+	printf( "one at a time\t%.2f M lookups/s\n", q / single / 1e6);
+
+	for (int batch = 1; batch <= 1024; batch *= 4)
+	{
+		double elapsed;
+
+		t0 = now();
+		for (int i = 0; i < q; i += batch)
+			AVLT_SearchBatch( tree, (void **)queries + i, (q - i < batch) ? q - i : batch, (void **)found + i);
+		elapsed = now() - t0;
+
+		if (memcmp( found, expected, sizeof( tWord *) * q) != 0) failed = 1;
+		printf( "batch %d\t%.2f M lookups/s (x%.2f)\n", batch, q / elapsed / 1e6, single / elapsed);
+	}
+
+	for (int i = 0; i < q; i++)
+		destroyWord( queries[i]);
+	free( queries);
+	free( expected);
+	free( found);
+	AVLT_Destroy( tree, destroyWord);
+
+	if (failed) fprintf( stderr, "Error: batch results differ\n");
+	return failed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// height/latency regression under interleaved inserts and deletes
+// the tokens of FILE stream through a sliding window of WINDOW tokens: each token is
+// inserted, and the word WINDOW tokens back is deleted (eviction); after every tenth of
+// the stream the height is compared with the AVL bound, the invariants are checked and
+// the words of the window are searched
+// ENGINE is avl (default), bplus, compact or concurrent (AVLT_CreateEngine); bplus is
+// held to the B+-tree's height bound, concurrent to the AVL bound over its routing nodes
+// too, and it frees evicted words itself (AVLT_SetRelease)
+// with -b, runs bench_batch on N words and Q lookups instead
+// exit status 3 if the bound or an invariant is ever broken (or a batch answers differently)
+int main( int argc, char **argv)
+{
+	char **tokens;
+	int num_tokens, window, step, failed = 0;
+	int engine = AVLT_AVL;
+	double (*bound)(int) = avl_bound;
+	TREE *tree;
+
+	if (argc > 1 && strcmp( argv[1], "-b") == 0)
+	{
+		int n = (argc > 2) ? atoi( argv[2]) : 1000000;
+		int q = (argc > 3) ? atoi( argv[3]) : 1000000;
+
+		if (n >= 1 && q >= 1) return bench_batch( n, q) ? 3 : 0;
+		argc = 1;
+	}
+	if (argc > 3 && strcmp( argv[3], "bplus") == 0)
+	{
+		engine = AVLT_BPLUS;
+		bound = bplus_bound;
+	}
+	else if (argc > 3 && strcmp( argv[3], "compact") == 0) engine = AVLT_COMPACT;
+	else if (argc > 3 && strcmp( argv[3], "concurrent") == 0)
+	{
+		engine = AVLT_CONCURRENT;
+		bound = relaxed_bound;
+	}
+	else if (argc > 3 && strcmp( argv[3], "avl") != 0) argc = 1;
+	if (argc < 2) {
+		fprintf( stderr, "usage: %s FILE [WINDOW [avl|bplus|compact|concurrent]]\n", argv[0]);
+		fprintf( stderr, "       %s -b [N [Q]]\n", argv[0]);
+		return 1;
+	}
+
+	num_tokens = load_tokens( argv[1], &tokens);
+	if (num_tokens < 0)
+	{
+		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
+		return 2;
+	}
+	window = (argc > 2) ? atoi( argv[2]) : num_tokens / 4;
+	if (window < 1) window = 1;
+	step = (num_tokens >= 10) ? num_tokens / 10 : 1;
+
+	tree = AVLT_CreateEngine( compare_by_word, engine, word_key);
+	if (engine == AVLT_CONCURRENT) AVLT_SetRelease( tree, destroyWord);
+
+	for (int i = 0; i < num_tokens; i++)
+	{
+		tWord *pWord = createWord( tokens[i]);
+		int ret = AVLT_Insert( tree, pWord, increase_freq);
+		if (ret == 0 || ret == 2) destroyWord( pWord);
+
+		if (i >= window)
+		{
+			tWord key = { tokens[i - window], 0};
+			tWord *pOut = AVLT_Delete( tree, &key);
+			if (pOut && engine != AVLT_CONCURRENT) destroyWord( pOut);
+		}
+
+		if ((i + 1) % step == 0 || i + 1 == num_tokens)
+		{
+			int count = AVLT_Count( tree), height = AVLT_Height( tree);
+			int valid = AVLT_Check( tree);
+			int lo = (i + 1 > window) ? i + 1 - window : 0;
+			long found = 0;
+			double t0, t_search;
+
+			t0 = now();
+			for (int j = lo; j <= i; j++)
+			{
+				tWord key = { tokens[j], 0};
+				found += (AVLT_Search( tree, &key) != NULL);
+			}
+			t_search = now() - t0;
+
+			printf( "%d/%d\tcount=%d\theight=%d (bound %.1f)\tcheck=%s\tsearch %.1f ns (%ld found)\n",
+				i + 1, num_tokens, count, height, bound( count), valid ? "ok" : "BROKEN",
+				t_search * 1e9 / (i + 1 - lo), found);
+
+			if (!valid || height > bound( count)) failed = 1;
+		}
+	}
+
+	AVLT_Destroy( tree, destroyWord);
+	for (int i = 0; i < num_tokens; i++)
+		free( tokens[i]);
+	free( tokens);
+
+	return failed ? 3 : 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, atoi
+#include <string.h> // memcmp
+#include <stdint.h> // uint32_t
+#include <math.h> // pow
+
+#include "avlt.h"
+#include "bench.h"
+
+#define ZIPF_S	1.0	// exponent of the query distribution
+
+////////////////////////////////////////////////////////////////////////////////
+// FNV-1a of the word
+uint32_t hash_word( const void *dataPtr)
+{
+	uint32_t h = 2166136261u;
+
+	for (const unsigned char *p = (const unsigned char *)((tWord *)dataPtr)->word; *p; p++)
+		h = (h ^ *p) * 16777619u;
+	return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// looks all queries up; the faster of two passes, so the first one's cold start does not count
+// return	lookups per second
+static double run( TREE *tree, tWord **queries, int q, tWord **found)
+{
+	double best = 0;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		double t0 = now(), elapsed;
+
+		for (int i = 0; i < q; i++)
+			found[i] = AVLT_Search( tree, queries[i]);
+		elapsed = now() - t0;
+		if (pass == 0 || elapsed < best) best = elapsed;
+	}
+	return q / best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// lookup throughput of AVLT_Search with front caches of several sizes against none
+// the tree holds N words; Q lookups follow a Zipf distribution (ZIPF_S) over them,
+// as word frequencies of text do; then a hot word is deleted under the cache
+// exit status 3 if a cached search answers differently from the tree
+int main( int argc, char **argv)
+{
+	int n = (argc > 1) ? atoi( argv[1]) : 1000000;
+	int q = (argc > 2) ? atoi( argv[2]) : 1000000;
+	static const int sizes[] = { 1024, 16384, 262144 };
+	unsigned int seed = 2463534242u;
+	char word[32];
+	tWord **words, **queries, **expected, **found, *pWord, *key;
+	double *cdf, sum = 0, single;
+	TREE *tree;
+	int failed = 0;
+
+	if (n < 1 || q < 1) {
+		fprintf( stderr, "usage: %s [N [Q]]\n", argv[0]);
+		return 1;
+	}
+
+	// words[r] is the word of rank r, at a random place in the tree
+	tree = AVLT_Create( compare_by_word);
+	words = malloc( sizeof( tWord *) * n);
+	for (int r = 0; r < n; )
+	{
+		sprintf( word, "w%09u", next_random( &seed));
+		pWord = createWord( word);
+		if (AVLT_Insert( tree, pWord, increase_freq) != 1) { destroyWord( pWord); continue; }
+		words[r++] = pWord;
+	}
+
+	cdf = malloc( sizeof( double) * n);
+	for (int r = 0; r < n; r++)
+		cdf[r] = sum += 1.0 / pow( r + 1, ZIPF_S);
+
+	queries = malloc( sizeof( tWord *) * q);
+	expected = malloc( sizeof( tWord *) * q);
+	found = malloc( sizeof( tWord *) * q);
+	for (int i = 0; i < q; i++)
+	{
+		double u = (double)next_random( &seed) / 4294967296.0 * sum;
+		int lo = 0, hi = n - 1;
+
+		while (lo < hi)
+		{
+			int mid = (lo + hi) / 2;
+			if (cdf[mid] < u) lo = mid + 1;
+			else hi = mid;
+		}
+		queries[i] = createWord( words[lo]->word); // a copy, as a caller's key would be
+	}
+
+	single = run( tree, queries, q, expected);
+	printf( "no cache\t%.2f M lookups/s\n", single / 1e6);
+
+	for (int s = 0; s < (int)(sizeof( sizes) / sizeof( sizes[0])); s++)
+	{
+		double rate;
+		AVLT_CACHE_STATS cs;
+
+		AVLT_EnableCache( tree, sizes[s], hash_word);
+		rate = run( tree, queries, q, found);
+		cs = AVLT_CacheStats( tree);
+
+		if (memcmp( found, expected, sizeof( tWord *) * q) != 0) failed = 1;
+		printf( "cache %d\t%.2f M lookups/s (x%.2f), hit rate %.1f%%\n", sizes[s], rate / 1e6, rate / single,
+			100.0 * cs.hits / (cs.hits + cs.misses));
+	}
+
+	// the hottest word, surely cached, must not be found once deleted, and a new record of
+	// it must be found instead of the freed one
+	key = createWord( words[0]->word);
+	if (AVLT_Search( tree, key) != words[0] || AVLT_Delete( tree, key) != words[0]) failed = 1;
+	else destroyWord( words[0]);
+	if (AVLT_Search( tree, key) != NULL) failed = 1;
+	pWord = createWord( key->word);
+	AVLT_Insert( tree, pWord, increase_freq);
+	if (AVLT_Search( tree, key) != pWord) failed = 1;
+	destroyWord( key);
+
+	for (int i = 0; i < q; i++)
+		destroyWord( queries[i]);
+	free( queries);
+	free( expected);
+	free( found);
+	free( words);
+	free( cdf);
+	AVLT_Destroy( tree, destroyWord);
+
+	if (failed) fprintf( stderr, "Error: cached results differ\n");
+	return failed ? 3 : 0;
+}
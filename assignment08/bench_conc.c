@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc, atoi
+#include <string.h> // strcmp
+#include <stdint.h> // uint64_t
+#include <pthread.h>
+
+#include "avlt.h"
+#include "bench.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// callback of AVLT_Insert on a tree other threads change at the same time
+void increase_freq_atomic(void *dataPtr)
+{
+	__atomic_fetch_add( &((tWord *)dataPtr)->freq, 1, __ATOMIC_RELAXED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// stress test: threads insert, delete and search a few keys at once and log each
+// operation with its result and the ticks of a shared clock at its call and return;
+// afterwards each key's log must have a linearization (operations on different keys
+// commute, so keys are checked one by one)
+
+#define STRESS_KEYS	32
+#define MAX_KEY_OPS	1024	// operations on one key in a round
+
+enum { OP_INSERT, OP_DELETE, OP_SEARCH };
+
+typedef struct {
+	int		key;
+	int		op;
+	int		result;	// 1 success/found, 0 otherwise (insert: 1 inserted, 0 duplicated)
+	long	call;	// clock ticks around the operation
+	long	ret;
+} EVENT;
+
+typedef struct {
+	TREE	*tree;
+	int		ops;
+	unsigned int	seed;
+	EVENT	*log;
+	int		broken;	// a search or deletion answered with another key
+} STRESS_ARG;
+
+static long ticks;
+
+static void *stress_worker( void *arg)
+{
+	STRESS_ARG *pArg = arg;
+	char word[16];
+
+	for (int i = 0; i < pArg->ops; i++)
+	{
+		EVENT *e = &pArg->log[i];
+		tWord key, *pWord;
+
+		e->key = next_random( &pArg->seed) % STRESS_KEYS;
+		e->op = next_random( &pArg->seed) % 3;
+		sprintf( word, "k%02d", e->key);
+		key.word = word;
+
+		if (e->op == OP_INSERT)
+		{
+			pWord = createWord( word);
+			e->call = __atomic_fetch_add( &ticks, 1, __ATOMIC_SEQ_CST);
+			e->result = (AVLT_Insert( pArg->tree, pWord, increase_freq_atomic) == 1);
+			e->ret = __atomic_fetch_add( &ticks, 1, __ATOMIC_SEQ_CST);
+			if (!e->result) destroyWord( pWord);
+		}
+		else
+		{
+			e->call = __atomic_fetch_add( &ticks, 1, __ATOMIC_SEQ_CST);
+			pWord = (e->op == OP_DELETE) ? AVLT_Delete( pArg->tree, &key) : AVLT_Search( pArg->tree, &key);
+			e->ret = __atomic_fetch_add( &ticks, 1, __ATOMIC_SEQ_CST);
+			e->result = (pWord != NULL);
+			// data found or deleted stays readable until this thread's next call
+			if (pWord != NULL && strcmp( pWord->word, word) != 0) pArg->broken = 1;
+		}
+	}
+	return NULL;
+}
+
+// linearization search of one key's events (Wing and Gong): an event may go next if it
+// was called before every pending event returned; configurations (events placed, whether
+// the key is present) already found to be dead ends are remembered by hash
+typedef struct {
+	EVENT	**events;
+	int		n;
+	uint64_t	placed[MAX_KEY_OPS / 64];
+	uint64_t	*dead;	// open addressing; 0 is empty
+	int		deadCap;
+	int		deadCount;
+} LIN;
+
+static uint64_t lin_hash( LIN *pLin, int present)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ull + present;
+	for (int i = 0; i < (pLin->n + 63) / 64; i++)
+	{
+		h ^= pLin->placed[i];
+		h *= 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 31;
+	}
+	return h ? h : 1;
+}
+
+static int lin_seen( LIN *pLin, uint64_t h, int add)
+{
+	int i = h % pLin->deadCap;
+	while (pLin->dead[i] != 0)
+	{
+		if (pLin->dead[i] == h) return 1;
+		i = (i + 1) % pLin->deadCap;
+	}
+	if (add && pLin->deadCount < pLin->deadCap / 2)
+	{
+		pLin->dead[i] = h;
+		pLin->deadCount++;
+	}
+	return 0;
+}
+
+// return	1 if the events not placed yet can follow in some order
+static int lin_search( LIN *pLin, int present, int left)
+{
+	long firstRet = -1;
+	uint64_t h;
+
+	if (left == 0) return 1;
+	h = lin_hash( pLin, present);
+	if (lin_seen( pLin, h, 0)) return 0;
+
+	for (int i = 0; i < pLin->n; i++)
+		if (!(pLin->placed[i / 64] >> (i % 64) & 1) && (firstRet < 0 || pLin->events[i]->ret < firstRet))
+			firstRet = pLin->events[i]->ret;
+
+	for (int i = 0; i < pLin->n; i++)
+	{
+		EVENT *e = pLin->events[i];
+		int next;
+
+		if (pLin->placed[i / 64] >> (i % 64) & 1) continue;
+		if (e->call > firstRet) continue;
+
+		if (e->op == OP_SEARCH)
+		{
+			if (e->result != present) continue;
+			next = present;
+		}
+		else if (e->op == OP_INSERT)
+		{
+			if (e->result == present) continue; // inserted only if absent, duplicated if present
+			next = 1;
+		}
+		else
+		{
+			if (e->result != present) continue;
+			next = 0;
+		}
+
+		pLin->placed[i / 64] |= 1ull << (i % 64);
+		if (lin_search( pLin, next, left - 1)) return 1;
+		pLin->placed[i / 64] &= ~(1ull << (i % 64));
+	}
+	lin_seen( pLin, h, 1);
+	return 0;
+}
+
+// return	number of keys whose events have no linearization
+//			-1 if a key has too many events to check
+static int check_linearizable( STRESS_ARG *args, int threads, int *finalPresent)
+{
+	static EVENT *events[MAX_KEY_OPS];
+	LIN lin;
+	int failed = 0;
+
+	lin.deadCap = 1 << 14;
+	lin.dead = malloc( sizeof( uint64_t) * lin.deadCap);
+	lin.events = events;
+
+	for (int key = 0; key < STRESS_KEYS; key++)
+	{
+		lin.n = 0;
+		for (int t = 0; t < threads; t++)
+			for (int i = 0; i < args[t].ops; i++)
+				if (args[t].log[i].key == key)
+				{
+					if (lin.n == MAX_KEY_OPS)
+					{
+						free( lin.dead);
+						return -1;
+					}
+					events[lin.n++] = &args[t].log[i];
+				}
+
+		// a search in the quiescent tree closes the history
+		{
+			static EVENT last;
+			last.key = key;
+			last.op = OP_SEARCH;
+			last.result = finalPresent[key];
+			last.call = last.ret = ticks;
+			if (lin.n == MAX_KEY_OPS)
+			{
+				free( lin.dead);
+				return -1;
+			}
+			events[lin.n++] = &last;
+		}
+
+		memset( lin.placed, 0, sizeof( lin.placed));
+		memset( lin.dead, 0, sizeof( uint64_t) * lin.deadCap);
+		lin.deadCount = 0;
+		if (!lin_search( &lin, 0, lin.n)) failed++;
+	}
+	free( lin.dead);
+	return failed;
+}
+
+// return	1 if all rounds passed
+static int stress( int threads, int rounds, int ops)
+{
+	STRESS_ARG *args = malloc( sizeof( STRESS_ARG) * threads);
+	pthread_t *tids = malloc( sizeof( pthread_t) * threads);
+	int passed = 1;
+
+	for (int t = 0; t < threads; t++)
+		args[t].log = malloc( sizeof( EVENT) * ops);
+
+	for (int round = 0; round < rounds && passed; round++)
+	{
+		TREE *tree = AVLT_CreateEngine( compare_by_word, AVLT_CONCURRENT, NULL);
+		int finalPresent[STRESS_KEYS];
+		int valid, failedKeys, broken = 0;
+		char word[16];
+
+		AVLT_SetRelease( tree, destroyWord); // deleted words are freed by the tree
+		ticks = 0;
+		for (int t = 0; t < threads; t++)
+		{
+			args[t].tree = tree;
+			args[t].ops = ops;
+			args[t].seed = 2463534242u + 7919u * (round * threads + t);
+			args[t].broken = 0;
+			pthread_create( &tids[t], NULL, stress_worker, &args[t]);
+		}
+		for (int t = 0; t < threads; t++)
+		{
+			pthread_join( tids[t], NULL);
+			broken |= args[t].broken;
+		}
+
+		for (int key = 0; key < STRESS_KEYS; key++)
+		{
+			tWord probe;
+			sprintf( word, "k%02d", key);
+			probe.word = word;
+			finalPresent[key] = (AVLT_Search( tree, &probe) != NULL);
+		}
+		valid = AVLT_Check( tree) && !broken;
+		failedKeys = check_linearizable( args, threads, finalPresent);
+		if (!valid || failedKeys != 0) passed = 0;
+
+		if (!passed || round == rounds - 1)
+			printf( "stress\tthreads=%d\trounds=%d\tops=%d\tcheck=%s\tlinearizable=%s\n",
+				threads, round + 1, ops, valid ? "ok" : "BROKEN",
+				failedKeys == 0 ? "ok" : failedKeys < 0 ? "too many events" : "NO");
+
+		AVLT_Destroy( tree, destroyWord);
+	}
+
+	for (int t = 0; t < threads; t++)
+		free( args[t].log);
+	free( args);
+	free( tids);
+	return passed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// throughput: threads count a shared stream of words into one tree (AVLT_Insert with an
+// atomic increment), then look words up; the concurrent engine against an AVL tree
+// behind one mutex
+
+typedef struct {
+	TREE	*tree;
+	pthread_mutex_t	*mutex;	// NULL for the concurrent engine
+	tWord	**tokens;	// this thread's slice
+	char	*taken;		// 1 for the tokens the tree took over
+	int		n;
+	int		search;		// 1: look the tokens up instead
+	long	found;
+} THRU_ARG;
+
+static void *thru_worker( void *arg)
+{
+	THRU_ARG *pArg = arg;
+
+	for (int i = 0; i < pArg->n; i++)
+	{
+		if (pArg->mutex) pthread_mutex_lock( pArg->mutex);
+		if (pArg->search)
+			pArg->found += (AVLT_Search( pArg->tree, pArg->tokens[i]) != NULL);
+		else
+			pArg->taken[i] = (AVLT_Insert( pArg->tree, pArg->tokens[i], increase_freq_atomic) == 1);
+		if (pArg->mutex) pthread_mutex_unlock( pArg->mutex);
+	}
+	return NULL;
+}
+
+static int total;
+
+static void sum_freq( const void *dataPtr)
+{
+	total += ((tWord *)dataPtr)->freq;
+}
+
+// runs both phases on threads threads
+// return	1 if the counts came out right
+static int throughput( int threads, int engine, int distinct, int q)
+{
+	TREE *tree = AVLT_CreateEngine( compare_by_word, engine, NULL);
+	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	THRU_ARG *args = malloc( sizeof( THRU_ARG) * threads);
+	pthread_t *tids = malloc( sizeof( pthread_t) * threads);
+	tWord **tokens = malloc( sizeof( tWord *) * q);
+	char *taken = malloc( q);
+	unsigned int seed = 88675123u;
+	double t0, insertTime = 0, searchTime = 0;
+	long found = 0;
+	int valid;
+	char word[32];
+
+	for (int i = 0; i < q; i++)
+	{
+		sprintf( word, "w%09u", next_random( &seed) % distinct);
+		tokens[i] = createWord( word);
+	}
+
+	for (int search = 0; search < 2; search++)
+	{
+		t0 = now();
+		for (int t = 0; t < threads; t++)
+		{
+			args[t].tree = tree;
+			args[t].mutex = (engine == AVLT_CONCURRENT) ? NULL : &mutex;
+			args[t].tokens = tokens + (long)q * t / threads;
+			args[t].taken = taken + (long)q * t / threads;
+			args[t].n = (long)q * (t + 1) / threads - (long)q * t / threads;
+			args[t].search = search;
+			args[t].found = 0;
+			pthread_create( &tids[t], NULL, thru_worker, &args[t]);
+		}
+		for (int t = 0; t < threads; t++)
+		{
+			pthread_join( tids[t], NULL);
+			found += args[t].found;
+		}
+		if (search)
+			searchTime = now() - t0;
+		else
+			insertTime = now() - t0;
+	}
+
+	total = 0;
+	AVLT_Traverse( tree, sum_freq);
+	// every token was counted once, and every search found its word
+	valid = AVLT_Check( tree) && total == q && found == q;
+
+	printf( "%s\tthreads=%d\tinsert %.2f M ops/s\tsearch %.2f M ops/s\tcount=%d\tcheck=%s\n",
+		(engine == AVLT_CONCURRENT) ? "concurrent" : "avl+mutex", threads,
+		q / insertTime / 1e6, q / searchTime / 1e6, AVLT_Count( tree), valid ? "ok" : "BROKEN");
+
+	for (int i = 0; i < q; i++)
+		if (!taken[i]) destroyWord( tokens[i]);
+	free( tokens);
+	free( taken);
+	free( args);
+	free( tids);
+	AVLT_Destroy( tree, destroyWord);
+	return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// stress test of the concurrent engine (AVLT_CONCURRENT) on THREADS threads, then
+// word-count throughput for 1..THREADS threads against an AVL tree behind a mutex
+// exit status 3 if a check fails
+int main( int argc, char **argv)
+{
+	int max_threads = (argc > 1) ? atoi( argv[1]) : 8;
+	int q = (argc > 2) ? atoi( argv[2]) : 2000000;
+	int failed = 0;
+
+	if (max_threads < 1 || q < 1) {
+		fprintf( stderr, "usage: %s [THREADS [TOKENS]]\n", argv[0]);
+		return 1;
+	}
+
+	for (int threads = 2; threads <= max_threads; threads *= 2)
+		if (!stress( threads, 20, 1000)) failed = 1;
+
+	for (int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		if (!throughput( threads, AVLT_CONCURRENT, 100000, q)) failed = 1;
+		if (!throughput( threads, AVLT_AVL, 100000, q)) failed = 1;
+	}
+
+	return failed ? 3 : 0;
+}
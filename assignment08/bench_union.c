@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h> // atoi
+
+#include "avlt.h"
+#include "bench.h"
+
+////////////////////////////////////////////////////////////////////////////////
+void merge_freq( void *dataPtr, void *otherPtr)
+{
+	((tWord *)dataPtr)->freq += ((tWord *)otherPtr)->freq;
+	destroyWord( otherPtr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// tree of n distinct words w<k> for random k in [0, 2n) (seeded), so two trees share about half
+static TREE *make_tree( int n, unsigned int seed)
+{
+	TREE *tree = AVLT_Create( compare_by_word);
+	char word[32];
+
+	while (AVLT_Count( tree) < n)
+	{
+		tWord *pWord;
+		sprintf( word, "w%09u", next_random( &seed) % (2u * n));
+		pWord = createWord( word);
+		if (AVLT_Insert( tree, pWord, increase_freq) != 1) destroyWord( pWord);
+	}
+	return tree;
+}
+
+static int total;
+
+static void sum_freq( const void *dataPtr)
+{
+	total += ((tWord *)dataPtr)->freq;
+}
+
+// inserts a copy of each data into other one by one (the old way)
+static TREE *other;
+
+static void reinsert( const void *dataPtr)
+{
+	tWord *pWord = createWord( ((tWord *)dataPtr)->word);
+	if (AVLT_Insert( other, pWord, increase_freq) != 1) destroyWord( pWord);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// unites two trees of N distinct words each (about half of them shared) with
+// AVLT_Union on 1..THREADS threads, and with reinsertion for comparison; the result is
+// checked for the AVL invariants and for the sum of the frequencies
+// exit status 3 if a result is broken
+int main( int argc, char **argv)
+{
+	int n = (argc > 1) ? atoi( argv[1]) : 500000;
+	int max_threads = (argc > 2) ? atoi( argv[2]) : 8;
+	int failed = 0;
+
+	if (n < 1 || max_threads < 1) {
+		fprintf( stderr, "usage: %s [N [THREADS]]\n", argv[0]);
+		return 1;
+	}
+
+	for (int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		TREE *a = make_tree( n, 2463534242u), *b = make_tree( n, 88675123u);
+		double t0, elapsed;
+		int valid, freq_sum;
+
+		total = 0;
+		AVLT_Traverse( a, sum_freq);
+		AVLT_Traverse( b, sum_freq);
+		freq_sum = total;
+
+		t0 = now();
+		AVLT_Union( a, b, threads, merge_freq);
+		elapsed = now() - t0;
+
+		valid = AVLT_Check( a) && AVLT_Count( b) == 0;
+		total = 0;
+		AVLT_Traverse( a, sum_freq);
+		if (total != freq_sum) valid = 0;
+
+		printf( "union\tthreads=%d\tcount=%d\theight=%d\t%.1f ms\tcheck=%s\n",
+			threads, AVLT_Count( a), AVLT_Height( a), elapsed * 1e3, valid ? "ok" : "BROKEN");
+		if (!valid) failed = 1;
+
+		AVLT_Destroy( a, destroyWord);
+		AVLT_Destroy( b, destroyWord);
+	}
+
+	{
+		TREE *a = make_tree( n, 2463534242u), *b = make_tree( n, 88675123u);
+		double t0 = now();
+
+		other = a;
+		AVLT_Traverse( b, reinsert);
+		printf( "reinsert\tcount=%d\t%.1f ms\n", AVLT_Count( a), (now() - t0) * 1e3);
+
+		AVLT_Destroy( a, destroyWord);
+		AVLT_Destroy( b, destroyWord);
+	}
+
+	return failed ? 3 : 0;
+}
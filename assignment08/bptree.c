@@ -0,0 +1,502 @@
+#include <stdlib.h> // malloc, posix_memalign
+#include <stdio.h>
+#include <string.h> // memmove
+
+#include "avlt.h" // TREE_STATS
+#include "bptree.h"
+
+// operation counters of the TREE on top (see TREE_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(pTree, field, n)	do { if ((pTree)->stats != NULL) (pTree)->stats->field += (n); } while (0)
+#else
+#define STAT_ADD(pTree, field, n)	((void)(pTree))
+#endif
+
+// internal function
+// return	first 8 bytes of the key, big-endian, zero padded (0 without getKey)
+static uint64_t _prefix( BPTREE *pTree, const void *dataPtr){
+    uint64_t prefix = 0;
+    if(pTree->getKey == NULL) return 0;
+    const unsigned char *key = (const unsigned char *)pTree->getKey(dataPtr);
+    for(int i = 0; i < 8; i++){
+        prefix <<= 8;
+        if(*key != '\0') prefix |= *key++;
+    }
+    return prefix;
+}
+
+// internal function
+// fills the spare list up to height + 1 nodes, one per level plus a new root, so an
+// insertion never runs out of memory halfway through its splits
+// return	0 if overflow
+static int _reserve( BPTREE *pTree){
+    while(pTree->spareCount < pTree->height + 1){
+        void *mem;
+        if(posix_memalign(&mem, 64, sizeof(BPNODE)) != 0) return 0;
+        BPNODE *pNode = mem;
+        pNode->u.link.next = pTree->spare;
+        pTree->spare = pNode;
+        pTree->spareCount++;
+    }
+    return 1;
+}
+
+// internal function
+// takes an empty node (aligned to the cache line) from the spare list filled by _reserve
+static BPNODE *_makeNode( BPTREE *pTree, int leaf){
+    BPNODE *pNode = pTree->spare;
+    pTree->spare = pNode->u.link.next;
+    pTree->spareCount--;
+    pNode->n = 0;
+    pNode->leaf = leaf;
+    pNode->u.link.next = NULL;
+    pNode->u.link.prev = NULL;
+    STAT_ADD(pTree, allocs, 1);
+    return pNode;
+}
+
+// internal function
+// scans the prefix line, calling compare only on equal prefixes
+// equal	1 if key[return] equals keyPtr
+// return	number of keys less than keyPtr
+static int _position( BPTREE *pTree, BPNODE *pNode, const void *keyPtr, uint64_t prefix, int *equal){
+    int i = 0;
+    *equal = 0;
+    while(i < pNode->n && pNode->prefix[i] < prefix) i++;
+    while(i < pNode->n && pNode->prefix[i] == prefix){
+        int cmp = pTree->compare(keyPtr, pNode->key[i]);
+        STAT_ADD(pTree, compares, 1);
+        if(cmp <= 0){
+            *equal = (cmp == 0);
+            break;
+        }
+        i++;
+    }
+    return i;
+}
+
+// internal function
+// puts key (and for an inner node the child right of it) at position i
+static void _putKey( BPNODE *pNode, int i, void *key, uint64_t prefix, BPNODE *right){
+    memmove(&pNode->prefix[i + 1], &pNode->prefix[i], sizeof(uint64_t) * (pNode->n - i));
+    memmove(&pNode->key[i + 1], &pNode->key[i], sizeof(void *) * (pNode->n - i));
+    pNode->prefix[i] = prefix;
+    pNode->key[i] = key;
+    if(!pNode->leaf){
+        memmove(&pNode->u.child[i + 2], &pNode->u.child[i + 1], sizeof(BPNODE *) * (pNode->n - i));
+        pNode->u.child[i + 1] = right;
+    }
+    pNode->n++;
+}
+
+// internal function
+// removes key i (and for an inner node the child right of it)
+static void _takeKey( BPNODE *pNode, int i){
+    memmove(&pNode->prefix[i], &pNode->prefix[i + 1], sizeof(uint64_t) * (pNode->n - i - 1));
+    memmove(&pNode->key[i], &pNode->key[i + 1], sizeof(void *) * (pNode->n - i - 1));
+    if(!pNode->leaf)
+        memmove(&pNode->u.child[i + 1], &pNode->u.child[i + 2], sizeof(BPNODE *) * (pNode->n - i - 1));
+    pNode->n--;
+}
+
+// used in BPT_Insert
+// inserts into the subtree; a full node splits, and the new right sibling goes up with the
+// separator *upKey (a leaf copies its new right's first key up, an inner node moves its middle key)
+// result	1 inserted, 2 duplicated key
+// return	new right sibling
+//			NULL if the node did not split
+static BPNODE *_insert( BPTREE *pTree, BPNODE *pNode, void *dataInPtr, uint64_t prefix,
+    void (*callback)(void *), int *result, void **upKey, uint64_t *upPrefix){
+    int equal;
+    int i = _position(pTree, pNode, dataInPtr, prefix, &equal);
+    void *key = dataInPtr;
+    BPNODE *right = NULL;
+
+    if(pNode->leaf){
+        if(equal){
+            callback(pNode->key[i]);
+            *result = 2;
+            return NULL;
+        }
+    }
+    else{
+        i += equal; // an equal separator leads right
+        STAT_ADD(pTree, hops, 1);
+        right = _insert(pTree, pNode->u.child[i], dataInPtr, prefix, callback, result, &key, &prefix);
+        if(right == NULL) return NULL;
+    }
+    *result = 1;
+
+    if(pNode->n < BPT_KEYS){
+        _putKey(pNode, i, key, prefix, right);
+        return NULL;
+    }
+
+    BPNODE *sibling = _makeNode(pTree, pNode->leaf);
+    int half;
+    STAT_ADD(pTree, rotations, 1);
+
+    if(pNode->leaf){ // of the BPT_KEYS + 1 keys, the first half stay
+        half = (BPT_KEYS + 1) / 2;
+        int keep = (i < half) ? half - 1 : half;
+        sibling->n = BPT_KEYS - keep;
+        memcpy(sibling->prefix, &pNode->prefix[keep], sizeof(uint64_t) * sibling->n);
+        memcpy(sibling->key, &pNode->key[keep], sizeof(void *) * sibling->n);
+        pNode->n = keep;
+        if(i < half) _putKey(pNode, i, key, prefix, NULL);
+        else _putKey(sibling, i - half, key, prefix, NULL);
+
+        sibling->u.link.next = pNode->u.link.next;
+        sibling->u.link.prev = pNode;
+        if(pNode->u.link.next != NULL) pNode->u.link.next->u.link.prev = sibling;
+        pNode->u.link.next = sibling;
+
+        *upKey = sibling->key[0];
+        *upPrefix = sibling->prefix[0];
+        return sibling;
+    }
+
+    // inner: collect the BPT_KEYS + 1 keys and BPT_KEYS + 2 children, keep half, move one up
+    uint64_t prefixes[BPT_KEYS + 1];
+    void *keys[BPT_KEYS + 1];
+    BPNODE *children[BPT_KEYS + 2];
+    memcpy(prefixes, pNode->prefix, sizeof(uint64_t) * i);
+    memcpy(keys, pNode->key, sizeof(void *) * i);
+    prefixes[i] = prefix;
+    keys[i] = key;
+    memcpy(&prefixes[i + 1], &pNode->prefix[i], sizeof(uint64_t) * (BPT_KEYS - i));
+    memcpy(&keys[i + 1], &pNode->key[i], sizeof(void *) * (BPT_KEYS - i));
+    memcpy(children, pNode->u.child, sizeof(BPNODE *) * (i + 1));
+    children[i + 1] = right;
+    memcpy(&children[i + 2], &pNode->u.child[i + 1], sizeof(BPNODE *) * (BPT_KEYS - i));
+
+    half = BPT_KEYS / 2;
+    pNode->n = half;
+    memcpy(pNode->prefix, prefixes, sizeof(uint64_t) * half);
+    memcpy(pNode->key, keys, sizeof(void *) * half);
+    memcpy(pNode->u.child, children, sizeof(BPNODE *) * (half + 1));
+    sibling->n = BPT_KEYS - half;
+    memcpy(sibling->prefix, &prefixes[half + 1], sizeof(uint64_t) * sibling->n);
+    memcpy(sibling->key, &keys[half + 1], sizeof(void *) * sibling->n);
+    memcpy(sibling->u.child, &children[half + 1], sizeof(BPNODE *) * (sibling->n + 1));
+
+    *upKey = keys[half];
+    *upPrefix = prefixes[half];
+    return sibling;
+}
+
+// used in BPT_Delete
+// refills child c of pNode, which fell below BPT_MIN keys: borrows a key from a sibling
+// with more than BPT_MIN, or else merges with one (pNode loses a key)
+static void _refill( BPTREE *pTree, BPNODE *pNode, int c){
+    BPNODE *child = pNode->u.child[c];
+    BPNODE *left = (c > 0) ? pNode->u.child[c - 1] : NULL;
+    BPNODE *right = (c < pNode->n) ? pNode->u.child[c + 1] : NULL;
+
+    STAT_ADD(pTree, rotations, 1);
+
+    if(left != NULL && left->n > BPT_MIN){
+        int last = left->n - 1;
+        if(child->leaf){
+            _putKey(child, 0, left->key[last], left->prefix[last], NULL);
+            pNode->key[c - 1] = child->key[0];
+            pNode->prefix[c - 1] = child->prefix[0];
+        }
+        else{ // rotate through the parent
+            BPNODE *moved = left->u.child[left->n];
+            _putKey(child, 0, pNode->key[c - 1], pNode->prefix[c - 1], child->u.child[0]);
+            child->u.child[0] = moved;
+            pNode->key[c - 1] = left->key[last];
+            pNode->prefix[c - 1] = left->prefix[last];
+        }
+        left->n--;
+        return;
+    }
+    if(right != NULL && right->n > BPT_MIN){
+        if(child->leaf){
+            _putKey(child, child->n, right->key[0], right->prefix[0], NULL);
+            _takeKey(right, 0);
+            pNode->key[c] = right->key[0];
+            pNode->prefix[c] = right->prefix[0];
+        }
+        else{
+            BPNODE *moved = right->u.child[0];
+            _putKey(child, child->n, pNode->key[c], pNode->prefix[c], moved);
+            pNode->key[c] = right->key[0];
+            pNode->prefix[c] = right->prefix[0];
+            right->u.child[0] = right->u.child[1];
+            _takeKey(right, 0);
+        }
+        return;
+    }
+
+    // merge the right one of the pair into the left one
+    if(left == NULL){
+        left = child;
+        c++;
+    }
+    right = pNode->u.child[c];
+    if(!left->leaf){ // the separator comes down between them
+        left->prefix[left->n] = pNode->prefix[c - 1];
+        left->key[left->n] = pNode->key[c - 1];
+        left->n++;
+        memcpy(&left->u.child[left->n], right->u.child, sizeof(BPNODE *) * (right->n + 1));
+    }
+    else{
+        left->u.link.next = right->u.link.next;
+        if(right->u.link.next != NULL) right->u.link.next->u.link.prev = left;
+    }
+    memcpy(&left->prefix[left->n], right->prefix, sizeof(uint64_t) * right->n);
+    memcpy(&left->key[left->n], right->key, sizeof(void *) * right->n);
+    left->n += right->n;
+    free(right);
+    _takeKey(pNode, c - 1);
+}
+
+// used in BPT_Delete
+// removes keyPtr from the subtree; sepNode/sepIndex is the separator equal to it on the path,
+// if any, which then takes the next key, so separators always point at stored data
+// return	address of the deleted data
+//			NULL not found
+static void *_delete( BPTREE *pTree, BPNODE *pNode, void *keyPtr, uint64_t prefix, BPNODE *sepNode, int sepIndex){
+    int equal;
+    int i = _position(pTree, pNode, keyPtr, prefix, &equal);
+
+    if(pNode->leaf){
+        if(!equal) return NULL;
+        void *out = pNode->key[i];
+        _takeKey(pNode, i);
+        if(sepNode != NULL && i == 0 && pNode->n > 0){
+            sepNode->key[sepIndex] = pNode->key[0];
+            sepNode->prefix[sepIndex] = pNode->prefix[0];
+        }
+        return out;
+    }
+
+    if(equal){
+        sepNode = pNode;
+        sepIndex = i;
+        i++;
+    }
+    STAT_ADD(pTree, hops, 1);
+    void *out = _delete(pTree, pNode->u.child[i], keyPtr, prefix, sepNode, sepIndex);
+    if(out != NULL && pNode->u.child[i]->n < BPT_MIN)
+        _refill(pTree, pNode, i);
+    return out;
+}
+
+// used in BPT_Destroy
+static void _destroy( BPNODE *pNode, void (*callback)(void *)){
+    if(pNode->leaf){
+        for(int i = 0; i < pNode->n; i++)
+            callback(pNode->key[i]);
+    }
+    else{
+        for(int i = 0; i <= pNode->n; i++)
+            _destroy(pNode->u.child[i], callback);
+    }
+    free(pNode);
+}
+
+// used in BPT_Print
+static void _print( BPNODE *pNode, int level, void (*callback)(const void *)){
+    for(int i = pNode->n; i >= 0; i--){
+        if(!pNode->leaf)
+            _print(pNode->u.child[i], level + 1, callback);
+        if(i == 0) break;
+        for(int t = 0; t < level; t++)
+            printf("\t");
+        callback(pNode->key[i - 1]);
+    }
+}
+
+// used in BPT_Check
+// checks the subtree against [lo, hi) (NULL: unbounded)
+// return	number of data in the subtree
+//			-1 if broken
+static int _check( BPTREE *pTree, BPNODE *pNode, int depth, const void *lo, const void *hi){
+    if(pNode->n > BPT_KEYS || (pNode != pTree->root && pNode->n < BPT_MIN)) return -1;
+    if(pNode->leaf != (depth == pTree->height)) return -1;
+    for(int i = 0; i < pNode->n; i++){
+        if(pNode->prefix[i] != _prefix(pTree, pNode->key[i])) return -1;
+        if(i > 0 && pTree->compare(pNode->key[i - 1], pNode->key[i]) >= 0) return -1;
+    }
+    if(pNode->n > 0){
+        if(lo != NULL && pTree->compare(pNode->key[0], lo) < 0) return -1;
+        if(hi != NULL && pTree->compare(pNode->key[pNode->n - 1], hi) >= 0) return -1;
+    }
+    if(pNode->leaf) return pNode->n;
+
+    int count = 0;
+    for(int i = 0; i <= pNode->n; i++){
+        int c = _check(pTree, pNode->u.child[i], depth + 1,
+            (i > 0) ? pNode->key[i - 1] : lo, (i < pNode->n) ? pNode->key[i] : hi);
+        if(c < 0) return -1;
+        count += c;
+    }
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Allocates an empty B+-tree
+	return	head pointer
+			NULL if overflow
+*/
+BPTREE *BPT_Create( int (*compare)(const void *, const void *), const char *(*getKey)(const void *)){
+    BPTREE *pTree = malloc(sizeof(BPTREE));
+    if(pTree == NULL) return NULL;
+    pTree->root = NULL;
+    pTree->height = 0;
+    pTree->compare = compare;
+    pTree->getKey = getKey;
+    pTree->spare = NULL;
+    pTree->spareCount = 0;
+    pTree->stats = NULL;
+    return pTree;
+}
+
+/* Deletes all data in tree and recycles memory
+*/
+void BPT_Destroy( BPTREE *pTree, void (*callback)(void *)){
+    if(pTree->root != NULL)
+        _destroy(pTree->root, callback);
+    while(pTree->spare != NULL){
+        BPNODE *next = pTree->spare->u.link.next;
+        free(pTree->spare);
+        pTree->spare = next;
+    }
+    free(pTree);
+}
+
+/* Inserts new data into the tree
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int BPT_Insert( BPTREE *pTree, void *dataInPtr, void (*callback)(void *)){
+    uint64_t prefix = _prefix(pTree, dataInPtr);
+    if(!_reserve(pTree)) return 0;
+    if(pTree->root == NULL){
+        pTree->root = _makeNode(pTree, 1);
+        pTree->height = 1;
+    }
+
+    int result = 0;
+    void *upKey;
+    uint64_t upPrefix;
+    BPNODE *right = _insert(pTree, pTree->root, dataInPtr, prefix, callback, &result, &upKey, &upPrefix);
+    if(right != NULL){ // the root split: one level more
+        BPNODE *root = _makeNode(pTree, 0);
+        root->n = 1;
+        root->prefix[0] = upPrefix;
+        root->key[0] = upKey;
+        root->u.child[0] = pTree->root;
+        root->u.child[1] = right;
+        pTree->root = root;
+        pTree->height++;
+    }
+    return result;
+}
+
+/* Deletes the data with keyPtr
+	return	address of the deleted data
+			NULL not found
+*/
+void *BPT_Delete( BPTREE *pTree, void *keyPtr){
+    if(pTree->root == NULL) return NULL;
+    void *out = _delete(pTree, pTree->root, keyPtr, _prefix(pTree, keyPtr), NULL, 0);
+
+    BPNODE *root = pTree->root;
+    if(root->n == 0){ // an inner root with one child left, or an empty leaf
+        pTree->root = root->leaf ? NULL : root->u.child[0];
+        pTree->height--;
+        free(root);
+    }
+    return out;
+}
+
+/* return	address of data with keyPtr
+			NULL not found
+*/
+void *BPT_Search( BPTREE *pTree, void *keyPtr){
+    BPNODE *pNode = pTree->root;
+    uint64_t prefix = _prefix(pTree, keyPtr);
+    int equal;
+
+    if(pNode == NULL) return NULL;
+    while(!pNode->leaf){
+        int i = _position(pTree, pNode, keyPtr, prefix, &equal);
+        pNode = pNode->u.child[i + equal];
+        STAT_ADD(pTree, hops, 1);
+    }
+    int i = _position(pTree, pNode, keyPtr, prefix, &equal);
+    return equal ? pNode->key[i] : NULL;
+}
+
+/* calls callback on all data in ascending (toRight 0) or descending order along the leaf links
+*/
+void BPT_Traverse( BPTREE *pTree, int toRight, void (*callback)(const void *)){
+    BPNODE *pNode = pTree->root;
+
+    if(pNode == NULL) return;
+    while(!pNode->leaf)
+        pNode = pNode->u.child[toRight ? pNode->n : 0];
+    for(; pNode != NULL; pNode = toRight ? pNode->u.link.prev : pNode->u.link.next){
+        if(toRight){
+            for(int i = pNode->n - 1; i >= 0; i--)
+                callback(pNode->key[i]);
+        }
+        else{
+            for(int i = 0; i < pNode->n; i++)
+                callback(pNode->key[i]);
+        }
+    }
+}
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void BPT_RangeTraverse( BPTREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    BPNODE *pNode = pTree->root;
+    uint64_t prefix = _prefix(pTree, loPtr);
+    int equal, i;
+
+    if(pNode == NULL) return;
+    while(!pNode->leaf){
+        i = _position(pTree, pNode, loPtr, prefix, &equal);
+        pNode = pNode->u.child[i + equal];
+    }
+    i = _position(pTree, pNode, loPtr, prefix, &equal);
+    for(; pNode != NULL; pNode = pNode->u.link.next, i = 0){
+        for(; i < pNode->n; i++){
+            if(pTree->compare(pNode->key[i], hiPtr) > 0) return;
+            callback(pNode->key[i]);
+        }
+    }
+}
+
+/* prints keys right-to-left with a tab per level
+*/
+void BPT_Print( BPTREE *pTree, void (*callback)(const void *)){
+    if(pTree->root != NULL)
+        _print(pTree->root, 1, callback);
+}
+
+/* checks order, separators, prefixes, fill, equal leaf depth, leaf links and count
+	return	1 valid
+			0 broken
+*/
+int BPT_Check( BPTREE *pTree, int count){
+    if(pTree->root == NULL) return count == 0 && pTree->height == 0;
+    if(_check(pTree, pTree->root, 1, NULL, NULL) != count) return 0;
+
+    // the leaf chain visits every data once, both ways
+    BPNODE *pNode = pTree->root, *prev = NULL;
+    int n = 0;
+    while(!pNode->leaf) pNode = pNode->u.child[0];
+    for(; pNode != NULL; prev = pNode, pNode = pNode->u.link.next){
+        if(pNode->u.link.prev != prev) return 0;
+        if(prev != NULL && pTree->compare(prev->key[prev->n - 1], pNode->key[0]) >= 0) return 0;
+        n += pNode->n;
+    }
+    return n == count;
+}
@@ -0,0 +1,91 @@
+#include <stdint.h> // uint64_t
+
+struct tree_stats;
+
+////////////////////////////////////////////////////////////////////////////////
+// B+-tree engine of AVLT_CreateEngine (AVLT_BPLUS)
+
+#define BPT_KEYS	8	// keys per node: their prefixes fill one 64-byte cache line
+#define BPT_MIN		(BPT_KEYS / 2)	// keys of a node other than the root, at least
+
+// node; a search looks at the prefix line first and calls the comparator only on a tie
+typedef struct bpnode
+{
+	uint64_t	prefix[BPT_KEYS];	// first 8 bytes of the keys, big-endian, zero padded
+	void		*key[BPT_KEYS];		// leaf: data; inner: separator (smallest data of child i + 1)
+	union
+	{
+		struct bpnode	*child[BPT_KEYS + 1];	// inner node
+		struct
+		{
+			struct bpnode	*next;	// leaves are linked in key order
+			struct bpnode	*prev;
+		} link;
+	} u;
+	int			n;		// number of keys
+	int			leaf;
+} BPNODE;
+
+typedef struct bptree
+{
+	BPNODE	*root;	// NULL if empty
+	int		height;	// levels, leaves included
+	int		(*compare)(const void *, const void *);
+	const char	*(*getKey)(const void *);	// key bytes of data for the prefixes
+	BPNODE	*spare;	// nodes allocated ahead for splits (linked by u.link.next)
+	int		spareCount;
+	struct tree_stats	*stats;	// counters of the TREE on top (-DADT_STATS), NULL if none
+} BPTREE;
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototype declarations
+
+/* Allocates an empty B+-tree
+	compare must order data like strcmp on getKey (getKey may be NULL: no prefixes, every
+	key on the way calls compare)
+	return	head pointer
+			NULL if overflow
+*/
+BPTREE *BPT_Create( int (*compare)(const void *, const void *), const char *(*getKey)(const void *));
+
+/* Deletes all data in tree and recycles memory
+*/
+void BPT_Destroy( BPTREE *pTree, void (*callback)(void *));
+
+/* Inserts new data into the tree
+	callback is called with the stored data on a duplicated key
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int BPT_Insert( BPTREE *pTree, void *dataInPtr, void (*callback)(void *));
+
+/* Deletes the data with keyPtr; nodes below half full borrow from or merge with a sibling
+	return	address of the deleted data
+			NULL not found
+*/
+void *BPT_Delete( BPTREE *pTree, void *keyPtr);
+
+/* return	address of data with keyPtr
+			NULL not found
+*/
+void *BPT_Search( BPTREE *pTree, void *keyPtr);
+
+/* calls callback on all data in ascending (toRight 0) or descending order along the leaf links
+*/
+void BPT_Traverse( BPTREE *pTree, int toRight, void (*callback)(const void *));
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void BPT_RangeTraverse( BPTREE *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *));
+
+/* prints keys right-to-left with a tab per level: separators at their node's level,
+	data at the leaf level
+*/
+void BPT_Print( BPTREE *pTree, void (*callback)(const void *));
+
+/* checks order, separators, prefixes, fill, equal leaf depth, leaf links and count
+	return	1 valid
+			0 broken
+*/
+int BPT_Check( BPTREE *pTree, int count);
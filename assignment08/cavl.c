@@ -0,0 +1,458 @@
+#include <stdlib.h> // free, posix_memalign
+#include <stdio.h>
+#include <string.h> // memcmp, memcpy, memset
+
+#include "avlt.h" // TREE_STATS
+#include "cavl.h"
+
+// operation counters of the TREE on top (see TREE_STATS)
+#ifdef ADT_STATS
+#define STAT_ADD(pTree, field, n)	do { if ((pTree)->stats != NULL) (pTree)->stats->field += (n); } while (0)
+#else
+#define STAT_ADD(pTree, field, n)	((void)(pTree))
+#endif
+
+#define MAX_DEPTH	64	// deeper than an AVL tree of 2^32 nodes can get
+
+// key of a search, prepared once like the inline key of a node
+typedef struct
+{
+    const void	*dataPtr;
+    uint8_t		longKey;
+    char		key[CAVL_INLINE];
+} CKEY;
+
+// internal function
+// fills the inline key of dataPtr (none without getKey: every comparison calls compare)
+static void _keyOf( CAVL *pTree, const void *dataPtr, char *key, uint8_t *longKey){
+    memset(key, 0, CAVL_INLINE);
+    if(pTree->getKey == NULL){
+        *longKey = 1;
+        return;
+    }
+    const char *word = pTree->getKey(dataPtr);
+    int len = 0;
+    while(len < CAVL_INLINE && word[len] != '\0'){
+        key[len] = word[len];
+        len++;
+    }
+    *longKey = (word[len] != '\0');
+}
+
+// internal function
+static void _makeKey( CAVL *pTree, const void *dataPtr, CKEY *pKey){
+    pKey->dataPtr = dataPtr;
+    _keyOf(pTree, dataPtr, pKey->key, &pKey->longKey);
+}
+
+// internal function
+// compares the inline bytes first; compare runs only when they are equal and a key is long
+// return	negative, 0 or positive like strcmp
+static int _compare( CAVL *pTree, const CKEY *pKey, const CNODE *pNode){
+    int cmp = memcmp(pKey->key, pNode->key, CAVL_INLINE);
+    if(cmp != 0 || !(pKey->longKey | pNode->longKey)) return cmp;
+    STAT_ADD(pTree, compares, 1);
+    return pTree->compare(pKey->dataPtr, pNode->dataPtr);
+}
+
+// internal function
+// makes sure the free list holds a node, so an insertion cannot fail halfway
+// the pool doubles into a new cache-line aligned block; indices stay valid
+// return	0 if overflow
+static int _reserve( CAVL *pTree){
+    if(pTree->freeList != 0) return 1;
+    uint32_t capacity = pTree->capacity ? pTree->capacity * 2 : 64;
+    void *mem;
+    if(capacity <= pTree->capacity || posix_memalign(&mem, 64, sizeof(CNODE) * (size_t)capacity) != 0)
+        return 0;
+    CNODE *pool = mem;
+    if(pTree->pool != NULL)
+        memcpy(pool, pTree->pool, sizeof(CNODE) * pTree->capacity);
+    free(pTree->pool);
+    for(uint32_t i = capacity - 1; i >= pTree->capacity && i > 0; i--){
+        pool[i].left = pTree->freeList;
+        pTree->freeList = i;
+    }
+    pTree->pool = pool;
+    pTree->capacity = capacity;
+    return 1;
+}
+
+// internal function
+static void _freeNode( CAVL *pTree, uint32_t i){
+    pTree->pool[i].left = pTree->freeList;
+    pTree->freeList = i;
+}
+
+// internal function
+// rotates the subtree i, whose left subtree is 2 taller, back into balance
+// same	1 if the subtree kept its height before the change (only after a deletion)
+// return	new root
+static uint32_t _fixLeft( CAVL *pTree, uint32_t i, int *same){
+    CNODE *pool = pTree->pool;
+    uint32_t l = pool[i].left;
+    *same = 0;
+    if(pool[l].balance <= 0){ // single rotation
+        STAT_ADD(pTree, rotations, 1);
+        pool[i].left = pool[l].right;
+        pool[l].right = i;
+        if(pool[l].balance == 0){
+            pool[i].balance = -1;
+            pool[l].balance = 1;
+            *same = 1;
+        }
+        else pool[i].balance = pool[l].balance = 0;
+        return l;
+    }
+    uint32_t g = pool[l].right; // double rotation
+    STAT_ADD(pTree, rotations, 2);
+    pool[l].right = pool[g].left;
+    pool[i].left = pool[g].right;
+    pool[g].left = l;
+    pool[g].right = i;
+    pool[i].balance = (pool[g].balance < 0) ? 1 : 0;
+    pool[l].balance = (pool[g].balance > 0) ? -1 : 0;
+    pool[g].balance = 0;
+    return g;
+}
+
+// internal function
+// mirror of _fixLeft for a right subtree 2 taller
+static uint32_t _fixRight( CAVL *pTree, uint32_t i, int *same){
+    CNODE *pool = pTree->pool;
+    uint32_t r = pool[i].right;
+    *same = 0;
+    if(pool[r].balance >= 0){
+        STAT_ADD(pTree, rotations, 1);
+        pool[i].right = pool[r].left;
+        pool[r].left = i;
+        if(pool[r].balance == 0){
+            pool[i].balance = 1;
+            pool[r].balance = -1;
+            *same = 1;
+        }
+        else pool[i].balance = pool[r].balance = 0;
+        return r;
+    }
+    uint32_t g = pool[r].left;
+    STAT_ADD(pTree, rotations, 2);
+    pool[r].left = pool[g].right;
+    pool[i].right = pool[g].left;
+    pool[g].right = r;
+    pool[g].left = i;
+    pool[i].balance = (pool[g].balance > 0) ? -1 : 0;
+    pool[r].balance = (pool[g].balance < 0) ? 1 : 0;
+    pool[g].balance = 0;
+    return g;
+}
+
+// used in CAVL_Insert
+// grew	1 if the subtree got taller
+// return	new root of the subtree
+static uint32_t _insert( CAVL *pTree, uint32_t i, CKEY *pKey, void (*callback)(void *), int *result, int *grew){
+    if(i == 0){
+        uint32_t n = pTree->freeList;
+        CNODE *pNode = &pTree->pool[n];
+        pTree->freeList = pNode->left;
+        pNode->left = pNode->right = 0;
+        pNode->dataPtr = (void *)pKey->dataPtr;
+        pNode->balance = 0;
+        pNode->longKey = pKey->longKey;
+        memcpy(pNode->key, pKey->key, CAVL_INLINE);
+        STAT_ADD(pTree, allocs, 1);
+        *result = 1;
+        *grew = 1;
+        return n;
+    }
+    CNODE *pNode = &pTree->pool[i];
+    int cmp = _compare(pTree, pKey, pNode), same;
+    if(cmp == 0){
+        callback(pNode->dataPtr);
+        *result = 2;
+        *grew = 0;
+        return i;
+    }
+    STAT_ADD(pTree, hops, 1);
+    if(cmp < 0){
+        pNode->left = _insert(pTree, pNode->left, pKey, callback, result, grew);
+        if(!*grew) return i;
+        if(pNode->balance >= 0){
+            *grew = (--pNode->balance < 0);
+            return i;
+        }
+        *grew = 0;
+        return _fixLeft(pTree, i, &same);
+    }
+    pNode->right = _insert(pTree, pNode->right, pKey, callback, result, grew);
+    if(!*grew) return i;
+    if(pNode->balance <= 0){
+        *grew = (++pNode->balance > 0);
+        return i;
+    }
+    *grew = 0;
+    return _fixRight(pTree, i, &same);
+}
+
+// used in _delete, _deleteMin
+// updates node i after its left subtree got shorter (*shrank) and rebalances it
+// return	new root of the subtree
+static uint32_t _leftShrank( CAVL *pTree, uint32_t i, int *shrank){
+    CNODE *pNode = &pTree->pool[i];
+    int same;
+    if(!*shrank) return i;
+    if(pNode->balance <= 0){
+        *shrank = (++pNode->balance == 0);
+        return i;
+    }
+    i = _fixRight(pTree, i, &same);
+    *shrank = !same;
+    return i;
+}
+
+// used in _delete
+// mirror of _leftShrank
+static uint32_t _rightShrank( CAVL *pTree, uint32_t i, int *shrank){
+    CNODE *pNode = &pTree->pool[i];
+    int same;
+    if(!*shrank) return i;
+    if(pNode->balance >= 0){
+        *shrank = (--pNode->balance == 0);
+        return i;
+    }
+    i = _fixLeft(pTree, i, &same);
+    *shrank = !same;
+    return i;
+}
+
+// used in _delete
+// unlinks the smallest node of the subtree into *minOut
+// return	new root of the subtree
+static uint32_t _deleteMin( CAVL *pTree, uint32_t i, uint32_t *minOut, int *shrank){
+    CNODE *pNode = &pTree->pool[i];
+    if(pNode->left == 0){
+        *minOut = i;
+        *shrank = 1;
+        return pNode->right;
+    }
+    STAT_ADD(pTree, hops, 1);
+    pNode->left = _deleteMin(pTree, pNode->left, minOut, shrank);
+    return _leftShrank(pTree, i, shrank);
+}
+
+// used in CAVL_Delete
+// a node with two children takes over the data and key of its successor
+// return	new root of the subtree
+static uint32_t _delete( CAVL *pTree, uint32_t i, CKEY *pKey, void **dataOutPtr, int *shrank){
+    if(i == 0){
+        *shrank = 0;
+        return 0;
+    }
+    CNODE *pNode = &pTree->pool[i];
+    int cmp = _compare(pTree, pKey, pNode);
+    if(cmp != 0)
+        STAT_ADD(pTree, hops, 1);
+    if(cmp < 0){
+        pNode->left = _delete(pTree, pNode->left, pKey, dataOutPtr, shrank);
+        return _leftShrank(pTree, i, shrank);
+    }
+    if(cmp > 0){
+        pNode->right = _delete(pTree, pNode->right, pKey, dataOutPtr, shrank);
+        return _rightShrank(pTree, i, shrank);
+    }
+
+    *dataOutPtr = pNode->dataPtr;
+    if(pNode->left == 0 || pNode->right == 0){
+        uint32_t child = pNode->left ? pNode->left : pNode->right;
+        _freeNode(pTree, i);
+        *shrank = 1;
+        return child;
+    }
+    uint32_t succ;
+    STAT_ADD(pTree, hops, 1);
+    pNode->right = _deleteMin(pTree, pNode->right, &succ, shrank);
+    CNODE *pSucc = &pTree->pool[succ];
+    pNode->dataPtr = pSucc->dataPtr;
+    pNode->longKey = pSucc->longKey;
+    memcpy(pNode->key, pSucc->key, CAVL_INLINE);
+    _freeNode(pTree, succ);
+    return _rightShrank(pTree, i, shrank);
+}
+
+// used in CAVL_Destroy
+static void _destroy( CAVL *pTree, uint32_t i, void (*callback)(void *)){
+    if(i == 0) return;
+    _destroy(pTree, pTree->pool[i].left, callback);
+    _destroy(pTree, pTree->pool[i].right, callback);
+    callback(pTree->pool[i].dataPtr);
+}
+
+// used in CAVL_RangeTraverse
+// visits only the subtrees that overlap [lo, hi]
+static void _range( CAVL *pTree, uint32_t i, CKEY *pLo, CKEY *pHi, void (*callback)(const void *)){
+    if(i == 0) return;
+    CNODE *pNode = &pTree->pool[i];
+    int cmpLo = _compare(pTree, pLo, pNode);
+    int cmpHi = _compare(pTree, pHi, pNode);
+    if(cmpLo < 0)
+        _range(pTree, pNode->left, pLo, pHi, callback);
+    if(cmpLo <= 0 && cmpHi >= 0)
+        callback(pNode->dataPtr);
+    if(cmpHi > 0)
+        _range(pTree, pNode->right, pLo, pHi, callback);
+}
+
+// used in CAVL_Print
+static void _print( CAVL *pTree, uint32_t i, int level, void (*callback)(const void *)){
+    if(i == 0) return;
+    _print(pTree, pTree->pool[i].right, level + 1, callback);
+    for(int t = 0; t < level; t++)
+        printf("\t");
+    callback(pTree->pool[i].dataPtr);
+    _print(pTree, pTree->pool[i].left, level + 1, callback);
+}
+
+// used in CAVL_Check
+// checks the subtree against (lo, hi) (NULL: unbounded); *count gets its nodes added
+// return	height of the subtree
+//			-1 if broken
+static int _check( CAVL *pTree, uint32_t i, const void *lo, const void *hi, int depth, int *count){
+    if(i == 0) return 0;
+    if(depth >= MAX_DEPTH || i >= pTree->capacity) return -1;
+    CNODE *pNode = &pTree->pool[i];
+    char key[CAVL_INLINE];
+    uint8_t longKey;
+    _keyOf(pTree, pNode->dataPtr, key, &longKey);
+    if(longKey != pNode->longKey || memcmp(key, pNode->key, CAVL_INLINE) != 0) return -1;
+    if(lo != NULL && pTree->compare(lo, pNode->dataPtr) >= 0) return -1;
+    if(hi != NULL && pTree->compare(pNode->dataPtr, hi) >= 0) return -1;
+
+    int hl = _check(pTree, pNode->left, lo, pNode->dataPtr, depth + 1, count);
+    int hr = (hl < 0) ? -1 : _check(pTree, pNode->right, pNode->dataPtr, hi, depth + 1, count);
+    if(hr < 0 || pNode->balance != hr - hl || pNode->balance < -1 || pNode->balance > 1) return -1;
+    (*count)++;
+    return ((hl > hr) ? hl : hr) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Allocates an empty compact AVL tree
+	return	head pointer
+			NULL if overflow
+*/
+CAVL *CAVL_Create( int (*compare)(const void *, const void *), const char *(*getKey)(const void *)){
+    CAVL *pTree = malloc(sizeof(CAVL));
+    if(pTree == NULL) return NULL;
+    pTree->pool = NULL;
+    pTree->capacity = 0;
+    pTree->freeList = 0;
+    pTree->root = 0;
+    pTree->compare = compare;
+    pTree->getKey = getKey;
+    pTree->stats = NULL;
+    return pTree;
+}
+
+/* Deletes all data in tree and recycles memory
+*/
+void CAVL_Destroy( CAVL *pTree, void (*callback)(void *)){
+    _destroy(pTree, pTree->root, callback);
+    free(pTree->pool);
+    free(pTree);
+}
+
+/* Inserts new data into the tree
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int CAVL_Insert( CAVL *pTree, void *dataInPtr, void (*callback)(void *)){
+    CKEY key;
+    int result = 0, grew;
+    if(!_reserve(pTree)) return 0;
+    _makeKey(pTree, dataInPtr, &key);
+    pTree->root = _insert(pTree, pTree->root, &key, callback, &result, &grew);
+    return result;
+}
+
+/* Deletes the data with keyPtr
+	return	address of the deleted data
+			NULL not found
+*/
+void *CAVL_Delete( CAVL *pTree, void *keyPtr){
+    CKEY key;
+    void *dataOut = NULL;
+    int shrank;
+    _makeKey(pTree, keyPtr, &key);
+    pTree->root = _delete(pTree, pTree->root, &key, &dataOut, &shrank);
+    return dataOut;
+}
+
+/* return	address of data with keyPtr
+			NULL not found
+*/
+void *CAVL_Search( CAVL *pTree, void *keyPtr){
+    CKEY key;
+    uint32_t i = pTree->root;
+    _makeKey(pTree, keyPtr, &key);
+    while(i != 0){
+        CNODE *pNode = &pTree->pool[i];
+        int cmp = _compare(pTree, &key, pNode);
+        if(cmp == 0) return pNode->dataPtr;
+        STAT_ADD(pTree, hops, 1);
+        i = (cmp < 0) ? pNode->left : pNode->right;
+    }
+    return NULL;
+}
+
+/* calls callback on all data in ascending (toRight 0) or descending order
+*/
+void CAVL_Traverse( CAVL *pTree, int toRight, void (*callback)(const void *)){
+    uint32_t stack[MAX_DEPTH];
+    uint32_t i = pTree->root;
+    int depth = 0;
+
+    while(1){
+        while(i != 0){
+            stack[depth++] = i;
+            i = toRight ? pTree->pool[i].right : pTree->pool[i].left;
+        }
+        if(depth == 0) break;
+        i = stack[--depth];
+        callback(pTree->pool[i].dataPtr);
+        i = toRight ? pTree->pool[i].left : pTree->pool[i].right;
+    }
+}
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void CAVL_RangeTraverse( CAVL *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    CKEY lo, hi;
+    _makeKey(pTree, loPtr, &lo);
+    _makeKey(pTree, hiPtr, &hi);
+    _range(pTree, pTree->root, &lo, &hi, callback);
+}
+
+/* prints data right-to-left with a tab per level
+*/
+void CAVL_Print( CAVL *pTree, void (*callback)(const void *)){
+    _print(pTree, pTree->root, 1, callback);
+}
+
+/* returns height of the tree
+	follows the taller child, which the balance factor tells
+*/
+int CAVL_Height( CAVL *pTree){
+    int height = 0;
+    for(uint32_t i = pTree->root; i != 0; height++)
+        i = (pTree->pool[i].balance < 0) ? pTree->pool[i].left : pTree->pool[i].right;
+    return height;
+}
+
+/* checks order, balance factors, inline keys and count
+	return	1 valid
+			0 broken
+*/
+int CAVL_Check( CAVL *pTree, int count){
+    int n = 0;
+    if(_check(pTree, pTree->root, NULL, NULL, 0, &n) < 0) return 0;
+    return n == count;
+}
@@ -0,0 +1,87 @@
+#include <stdint.h> // uint32_t, int8_t
+
+struct tree_stats;
+
+////////////////////////////////////////////////////////////////////////////////
+// compact AVL engine of AVLT_CreateEngine (AVLT_COMPACT)
+
+#define CAVL_INLINE	14	// key bytes kept in the node
+
+// node of 32 bytes, two to a cache line; children are indices into the node pool
+// (0: none), and a key no longer than CAVL_INLINE is compared without leaving the node
+typedef struct
+{
+	uint32_t	left;
+	uint32_t	right;
+	void		*dataPtr;
+	int8_t		balance;	// height of right subtree - height of left subtree (-1, 0, 1)
+	uint8_t		longKey;	// 1 if the key is longer than CAVL_INLINE: equal inline bytes call compare
+	char		key[CAVL_INLINE];	// first bytes of the key, NUL padded
+} CNODE;
+
+typedef struct cavl
+{
+	CNODE	*pool;	// nodes, aligned to the cache line; pool[0] is unused
+	uint32_t	capacity;
+	uint32_t	freeList;	// unused nodes linked by left
+	uint32_t	root;	// 0 if empty
+	int		(*compare)(const void *, const void *);
+	const char	*(*getKey)(const void *);	// key bytes of data for the inline keys
+	struct tree_stats	*stats;	// counters of the TREE on top (-DADT_STATS), NULL if none
+} CAVL;
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototype declarations
+
+/* Allocates an empty compact AVL tree
+	compare must order data like strcmp on getKey (getKey may be NULL: no inline keys,
+	every key on the way calls compare)
+	return	head pointer
+			NULL if overflow
+*/
+CAVL *CAVL_Create( int (*compare)(const void *, const void *), const char *(*getKey)(const void *));
+
+/* Deletes all data in tree and recycles memory
+*/
+void CAVL_Destroy( CAVL *pTree, void (*callback)(void *));
+
+/* Inserts new data into the tree
+	callback is called with the stored data on a duplicated key
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int CAVL_Insert( CAVL *pTree, void *dataInPtr, void (*callback)(void *));
+
+/* Deletes the data with keyPtr
+	return	address of the deleted data
+			NULL not found
+*/
+void *CAVL_Delete( CAVL *pTree, void *keyPtr);
+
+/* return	address of data with keyPtr
+			NULL not found
+*/
+void *CAVL_Search( CAVL *pTree, void *keyPtr);
+
+/* calls callback on all data in ascending (toRight 0) or descending order
+*/
+void CAVL_Traverse( CAVL *pTree, int toRight, void (*callback)(const void *));
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void CAVL_RangeTraverse( CAVL *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *));
+
+/* prints data right-to-left with a tab per level
+*/
+void CAVL_Print( CAVL *pTree, void (*callback)(const void *));
+
+/* returns height of the tree
+*/
+int CAVL_Height( CAVL *pTree);
+
+/* checks order, balance factors, inline keys and count
+	return	1 valid
+			0 broken
+*/
+int CAVL_Check( CAVL *pTree, int count);
@@ -0,0 +1,229 @@
+#include <stdlib.h> // malloc
+#include <stdio.h>
+#include <stdint.h> // uintptr_t
+#include <string.h> // strlen, memcpy
+#include <malloc.h> // malloc_usable_size
+#include <pthread.h> // pthread_mutex_t
+#include <sys/resource.h> // getrusage
+
+#include "memrep.h"
+
+// the allocator itself (-Wl,--wrap=malloc makes malloc of the program __wrap_malloc)
+void *__real_malloc( size_t size);
+void *__real_calloc( size_t n, size_t size);
+void *__real_realloc( void *ptr, size_t size);
+int __real_posix_memalign( void **memptr, size_t alignment, size_t size);
+void __real_free( void *ptr);
+
+// tracked block; the table lives beside the blocks, so they keep their sizes and the
+// slack is the allocator's own
+typedef struct
+{
+    void	*ptr;	// NULL if empty
+    uint64_t	size : 60;	// bytes asked for
+    uint64_t	kind : 4;
+} BLOCK;
+
+typedef struct
+{
+    long	allocs;
+    long	frees;
+    long	live;	// blocks
+    size_t	bytes;	// bytes asked for by live blocks
+    size_t	slack;	// bytes given beyond them
+} KIND_STATS;
+
+static const char *kindNames[MEM_KINDS] = { "tree nodes", "tWord records", "strings", "other" };
+
+static int memOn = 0;
+static __thread int memKind = MEM_TREE;
+static pthread_mutex_t memLock = PTHREAD_MUTEX_INITIALIZER;
+static BLOCK *table = NULL;	// open addressing, linear probing
+static size_t tableCap = 0;	// power of 2
+static size_t tableUsed = 0;
+static size_t tablePeak = 0;	// bytes, old and new table of a growth together
+static KIND_STATS kinds[MEM_KINDS];
+static size_t liveBytes = 0, peakBytes = 0;
+
+// internal function
+static size_t _slot( void *ptr){
+    return (size_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull) & (tableCap - 1);
+}
+
+// internal function
+// return	0 if overflow (the block stays untracked)
+static int _grow( void){
+    size_t capacity = tableCap ? tableCap * 2 : 4096;
+    BLOCK *old = table, *new = __real_calloc(capacity, sizeof(BLOCK));
+    if(new == NULL) return 0;
+
+    size_t oldCap = tableCap;
+    if((oldCap + capacity) * sizeof(BLOCK) > tablePeak) tablePeak = (oldCap + capacity) * sizeof(BLOCK);
+    table = new;
+    tableCap = capacity;
+    for(size_t i = 0; i < oldCap; i++){
+        if(old[i].ptr == NULL) continue;
+        size_t s = _slot(old[i].ptr);
+        while(table[s].ptr != NULL) s = (s + 1) & (tableCap - 1);
+        table[s] = old[i];
+    }
+    __real_free(old);
+    return 1;
+}
+
+// used in the wrappers
+static void _track( void *ptr, size_t size, int kind){
+    if(ptr == NULL) return;
+    pthread_mutex_lock(&memLock);
+    if((tableUsed + 1) * 4 > tableCap * 3 && !_grow()){
+        pthread_mutex_unlock(&memLock);
+        return;
+    }
+    size_t s = _slot(ptr);
+    while(table[s].ptr != NULL) s = (s + 1) & (tableCap - 1);
+    table[s].ptr = ptr;
+    table[s].size = size;
+    table[s].kind = kind;
+    tableUsed++;
+
+    KIND_STATS *k = &kinds[kind];
+    k->allocs++;
+    k->live++;
+    k->bytes += size;
+    k->slack += malloc_usable_size(ptr) - size;
+    liveBytes += size;
+    if(liveBytes > peakBytes) peakBytes = liveBytes;
+    pthread_mutex_unlock(&memLock);
+}
+
+// used in the wrappers
+// stores the bytes asked for in *size
+// return	kind of the block, -1 if untracked
+static int _untrack( void *ptr, size_t *size){
+    if(ptr == NULL) return -1;
+    pthread_mutex_lock(&memLock);
+    if(tableCap == 0){ // tableCap is written by _grow under the lock
+        pthread_mutex_unlock(&memLock);
+        return -1;
+    }
+    size_t s = _slot(ptr);
+    while(table[s].ptr != NULL && table[s].ptr != ptr) s = (s + 1) & (tableCap - 1);
+    if(table[s].ptr == NULL){
+        pthread_mutex_unlock(&memLock);
+        return -1;
+    }
+
+    BLOCK b = table[s];
+    KIND_STATS *k = &kinds[b.kind];
+    k->frees++;
+    k->live--;
+    k->bytes -= b.size;
+    k->slack -= malloc_usable_size(ptr) - b.size;
+    liveBytes -= b.size;
+    *size = b.size;
+
+    // backward shift: later entries of the run move into the hole
+    size_t hole = s;
+    for(size_t i = (s + 1) & (tableCap - 1); table[i].ptr != NULL; i = (i + 1) & (tableCap - 1)){
+        size_t home = _slot(table[i].ptr);
+        if(((i - home) & (tableCap - 1)) >= ((i - hole) & (tableCap - 1))){
+            table[hole] = table[i];
+            hole = i;
+        }
+    }
+    table[hole].ptr = NULL;
+    tableUsed--;
+    pthread_mutex_unlock(&memLock);
+    return b.kind;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// wrappers
+
+void *__wrap_malloc( size_t size){
+    void *ptr = __real_malloc(size);
+    if(memOn) _track(ptr, size, memKind);
+    return ptr;
+}
+
+void *__wrap_calloc( size_t n, size_t size){
+    void *ptr = __real_calloc(n, size);
+    if(memOn) _track(ptr, n * size, memKind);
+    return ptr;
+}
+
+// a moved block is freed and allocated again, keeping its kind
+void *__wrap_realloc( void *ptr, size_t size){
+    if(!memOn) return __real_realloc(ptr, size);
+    size_t oldSize;
+    int kind = _untrack(ptr, &oldSize);
+    void *new = __real_realloc(ptr, size);
+    if(new == NULL && size != 0){
+        if(kind >= 0) _track(ptr, oldSize, kind); // kept as it was
+        return NULL;
+    }
+    _track(new, size, kind >= 0 ? kind : memKind);
+    return new;
+}
+
+int __wrap_posix_memalign( void **memptr, size_t alignment, size_t size){
+    int ret = __real_posix_memalign(memptr, alignment, size);
+    if(memOn && ret == 0) _track(*memptr, size, memKind);
+    return ret;
+}
+
+// libc's strdup would call its own malloc
+char *__wrap_strdup( const char *s){
+    size_t size = strlen(s) + 1;
+    char *copy = __wrap_malloc(size);
+    if(copy != NULL) memcpy(copy, s, size);
+    return copy;
+}
+
+void __wrap_free( void *ptr){
+    size_t size;
+    if(memOn) _untrack(ptr, &size);
+    __real_free(ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Starts tracking the blocks allocated from now on
+*/
+void MEM_Start( void){
+    memOn = 1;
+}
+
+/* Sets the kind of the following allocations of the calling thread
+	return	previous kind
+*/
+int MEM_Kind( int kind){
+    int old = memKind;
+    memKind = kind;
+    return old;
+}
+
+/* Prints per kind allocations, frees, live blocks, bytes asked for and slack, then the
+	peak of live bytes and the peak RSS
+	the tracking table is not counted in the kinds but is in the RSS, so its size is printed
+*/
+void MEM_Report( FILE *fp){
+    KIND_STATS total = {0};
+    struct rusage ru;
+
+    pthread_mutex_lock(&memLock);
+    fprintf(fp, "[mem] %-14s %10s %10s %10s %12s %12s\n", "kind", "allocs", "frees", "live", "bytes", "slack");
+    for(int i = 0; i < MEM_KINDS; i++){
+        KIND_STATS *k = &kinds[i];
+        fprintf(fp, "[mem] %-14s %10ld %10ld %10ld %12zu %12zu\n", kindNames[i], k->allocs, k->frees, k->live, k->bytes, k->slack);
+        total.allocs += k->allocs;
+        total.frees += k->frees;
+        total.live += k->live;
+        total.bytes += k->bytes;
+        total.slack += k->slack;
+    }
+    fprintf(fp, "[mem] %-14s %10ld %10ld %10ld %12zu %12zu\n", "total", total.allocs, total.frees, total.live, total.bytes, total.slack);
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(fp, "[mem] peak live bytes=%zu peak RSS=%ld KB (up to %zu KB of it the tracking table)\n",
+        peakBytes, ru.ru_maxrss, tablePeak / 1024);
+    pthread_mutex_unlock(&memLock);
+}
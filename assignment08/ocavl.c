@@ -0,0 +1,949 @@
+#include <stdlib.h> // malloc, free
+#include <stdio.h>
+#include <sched.h> // sched_yield
+#include <pthread.h> // epoch registry
+
+#include "avlt.h" // TREE_STATS
+#include "ocavl.h"
+
+#define MAX_DEPTH	64	// deeper than an AVL tree of 2^32 nodes can get
+#define SPINS		100	// polls of a changing version before blocking on its lock
+
+// fields other threads change are read and written atomically (like Java volatiles)
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#define CHILD(n, dir)	((dir) < 0 ? LOAD((n)->left) : LOAD((n)->right))
+
+// operation counters of the TREE on top (see TREE_STATS), shared by all threads
+#ifdef ADT_STATS
+#define STAT_ADD(pTree, field, n)	do { if ((pTree)->stats != NULL) __atomic_fetch_add(&(pTree)->stats->field, (n), __ATOMIC_RELAXED); } while (0)
+#else
+#define STAT_ADD(pTree, field, n)	((void)(pTree))
+#endif
+
+// results of _condition besides a new height
+#define NOTHING		-1	// height and balance are right
+#define REBALANCE	-2	// subtree heights differ by more than 1
+#define UNLINK		-3	// routing node with less than two children
+
+#define RETRY		-1	// the version of a node on the path changed: go back a level
+static char retryMark;
+#define RETRY_PTR	((void *)&retryMark)
+
+// read-side registry of retired nodes and data, shared by all trees (as BST_RCU in bst.c)
+// each call of OCAVL_Search, OCAVL_Insert or OCAVL_Delete publishes the epoch it started
+// in, and the slot keeps it after the call returns: the caller may still read the data it
+// got back until its next call (or until its thread exits, which clears the slot)
+// retired nodes and data are taken as a batch marked with a new epoch, and freed once no
+// slot is behind that epoch, so a thread that stops calling holds them back
+#define EPOCH_READERS	128	// threads with a slot; further threads share _epochGuests
+#define EPOCH_BATCH		64	// nodes and data retired before a batch is taken
+#define EPOCH_GUEST		(EPOCH_READERS + 1)	// value of _epochKey for a thread without a slot
+
+typedef struct
+{
+    unsigned long epoch;
+    int used;
+    char pad[64 - sizeof(unsigned long) - sizeof(int)]; // one cache line per reader
+} EPOCH_SLOT;
+
+static EPOCH_SLOT _epochSlots[EPOCH_READERS];
+static unsigned long _epoch = 1;
+static __thread int _epochSlot = -1; // slot of the calling thread, EPOCH_GUEST if none is left
+static pthread_once_t _epochOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _epochKey; // gives the slot back when its thread exits
+// held shared by each thread without a slot from its first call until it exits
+static pthread_rwlock_t _epochGuests = PTHREAD_RWLOCK_INITIALIZER;
+
+// internal function
+// destructor of _epochKey
+static void _epochRelease( void *arg){
+    intptr_t slot = (intptr_t)arg - 1;
+    if(slot == EPOCH_GUEST - 1){
+        pthread_rwlock_unlock(&_epochGuests);
+        return;
+    }
+    __atomic_store_n(&_epochSlots[slot].epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&_epochSlots[slot].used, 0, __ATOMIC_RELEASE);
+}
+
+// internal function
+static void _epochInit( void){
+    pthread_key_create(&_epochKey, _epochRelease);
+}
+
+// used in _epochEnter
+// takes a free slot, or the guest lock if none is left
+static void _epochRegister( void){
+    pthread_once(&_epochOnce, _epochInit);
+    for(int i = 0; i < EPOCH_READERS; i++){
+        int expected = 0;
+        if(__atomic_compare_exchange_n(&_epochSlots[i].used, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+            pthread_setspecific(_epochKey, (void *)(intptr_t)(i + 1));
+            _epochSlot = i;
+            return;
+        }
+    }
+    pthread_rwlock_rdlock(&_epochGuests);
+    pthread_setspecific(_epochKey, (void *)(intptr_t)EPOCH_GUEST);
+    _epochSlot = EPOCH_GUEST;
+}
+
+// used in OCAVL_Search, OCAVL_Insert, OCAVL_Delete
+// the data the calling thread got from its previous call may be freed from now on
+static void _epochEnter( void){
+    if(_epochSlot < 0)
+        _epochRegister();
+    if(_epochSlot == EPOCH_GUEST) return;
+    // release: what the thread read before is done with once a reclaimer sees the new epoch
+    __atomic_store_n(&_epochSlots[_epochSlot].epoch, __atomic_load_n(&_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // the slot is visible before any link is read
+}
+
+// used in _reclaim
+// return	1 if no thread can reach what was retired before epoch began
+static int _epochPassed( unsigned long epoch){
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with the fence of _epochEnter
+    for(int i = 0; i < EPOCH_READERS; i++){
+        unsigned long seen = __atomic_load_n(&_epochSlots[i].epoch, __ATOMIC_ACQUIRE);
+        if(seen != 0 && seen < epoch) return 0;
+    }
+    if(pthread_rwlock_trywrlock(&_epochGuests) != 0) return 0;
+    pthread_rwlock_unlock(&_epochGuests);
+    return 1;
+}
+
+// used in _reclaim, OCAVL_Destroy
+// frees nodes and data of a batch; an unlinked node holds the deleted data it was made for
+static void _free( OCAVL *pTree, OCNODE *nodes, OCDATA *data){
+    while(nodes != NULL){
+        OCNODE *next = nodes->retired;
+        if(pTree->release != NULL)
+            pTree->release(nodes->key);
+        free(nodes);
+        nodes = next;
+    }
+    while(data != NULL){
+        OCDATA *next = data->next;
+        pTree->release(data->dataPtr);
+        free(data);
+        data = next;
+    }
+}
+
+// used in OCAVL_Insert, OCAVL_Delete
+// frees the pending batch once its epoch has passed, then takes the retired nodes and data
+// as the next batch if enough were collected; never waits (another thread reclaiming the
+// tree, or a slot behind the epoch, leaves the work to a later call)
+static void _reclaim( OCAVL *pTree){
+    if(__atomic_exchange_n(&pTree->reclaiming, 1, __ATOMIC_ACQUIRE)) return;
+    if(pTree->pendingNodes != NULL || pTree->pendingData != NULL){
+        if(!_epochPassed(pTree->pendingEpoch)){
+            __atomic_store_n(&pTree->reclaiming, 0, __ATOMIC_RELEASE);
+            return;
+        }
+        _free(pTree, pTree->pendingNodes, pTree->pendingData);
+        pTree->pendingNodes = NULL;
+        pTree->pendingData = NULL;
+    }
+    if(LOAD(pTree->retiredCount) >= EPOCH_BATCH){
+        OCNODE *nodes = __atomic_exchange_n(&pTree->retiredNodes, NULL, __ATOMIC_SEQ_CST);
+        OCDATA *data = __atomic_exchange_n(&pTree->retiredData, NULL, __ATOMIC_SEQ_CST);
+        int n = 0;
+        for(OCNODE *pNode = nodes; pNode != NULL; pNode = pNode->retired)
+            n++;
+        for(OCDATA *pData = data; pData != NULL; pData = pData->next)
+            n++;
+        __atomic_fetch_sub(&pTree->retiredCount, n, __ATOMIC_SEQ_CST);
+        pTree->pendingNodes = nodes;
+        pTree->pendingData = data;
+        // a thread that publishes this epoch or a later one sees the unlinks
+        pTree->pendingEpoch = __atomic_add_fetch(&_epoch, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_store_n(&pTree->reclaiming, 0, __ATOMIC_RELEASE);
+}
+
+// internal function
+static void _lock( OCNODE *pNode){
+    while(__atomic_exchange_n(&pNode->lock, 1, __ATOMIC_ACQUIRE))
+        while(__atomic_load_n(&pNode->lock, __ATOMIC_RELAXED))
+            sched_yield();
+}
+
+// internal function
+static void _unlock( OCNODE *pNode){
+    __atomic_store_n(&pNode->lock, 0, __ATOMIC_RELEASE);
+}
+
+// internal function
+// waits until a rotation moving keys out of pNode ends; the rotating thread holds the
+// lock of pNode, so after a short spin the lock is the way to wait
+static void _waitUntilNotChanging( OCNODE *pNode){
+    uint64_t version = LOAD(pNode->version);
+    if(!(version & OCAVL_SHRINKING)) return;
+    for(int i = 0; i < SPINS; i++)
+        if(LOAD(pNode->version) != version) return;
+    _lock(pNode);
+    _unlock(pNode);
+}
+
+// internal function
+static int _height( OCNODE *pNode){
+    return (pNode == NULL) ? 0 : LOAD(pNode->height);
+}
+
+// internal function
+static void _setChild( OCNODE *pNode, int dir, OCNODE *child){
+    if(dir < 0)
+        STORE(pNode->left, child);
+    else
+        STORE(pNode->right, child);
+}
+
+// internal function
+// return	NOTHING, REBALANCE, UNLINK or the height pNode should have
+static int _condition( OCNODE *pNode){
+    OCNODE *left = LOAD(pNode->left);
+    OCNODE *right = LOAD(pNode->right);
+    if((left == NULL || right == NULL) && LOAD(pNode->value) == NULL) return UNLINK;
+    int hl = _height(left), hr = _height(right);
+    int height = 1 + ((hl > hr) ? hl : hr);
+    if(hl - hr < -1 || hl - hr > 1) return REBALANCE;
+    return (LOAD(pNode->height) != height) ? height : NOTHING;
+}
+
+// internal function
+// fixes the height of the locked pNode
+// return	next node to repair (NULL if none)
+static OCNODE *_fixHeight( OCNODE *pNode){
+    int c = _condition(pNode);
+    if(c == REBALANCE || c == UNLINK) return pNode;
+    if(c == NOTHING) return NULL;
+    STORE(pNode->height, c);
+    return LOAD(pNode->parent);
+}
+
+// internal function
+// unlinks the locked pNode, a child of the locked parent with less than two children
+// return	0 if the links changed since the caller looked
+static int _attemptUnlink( OCAVL *pTree, OCNODE *parent, OCNODE *pNode){
+    OCNODE *parentLeft = LOAD(parent->left);
+    if(parentLeft != pNode && LOAD(parent->right) != pNode) return 0;
+    OCNODE *left = LOAD(pNode->left), *right = LOAD(pNode->right);
+    if(left != NULL && right != NULL) return 0;
+
+    OCNODE *splice = (left != NULL) ? left : right;
+    if(parentLeft == pNode)
+        STORE(parent->left, splice);
+    else
+        STORE(parent->right, splice);
+    if(splice != NULL)
+        STORE(splice->parent, parent);
+    STORE(pNode->version, OCAVL_UNLINKED);
+    STORE(pNode->value, NULL);
+
+    // operations may still be on the node: it waits in limbo until every thread has moved on
+    pNode->retired = LOAD(pTree->retiredNodes);
+    while(!__atomic_compare_exchange_n(&pTree->retiredNodes, &pNode->retired, pNode, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        ;
+    __atomic_fetch_add(&pTree->retiredCount, 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// rotations of locked nodes; each returns the next node to repair (NULL if none)
+// only the node moving down loses keys from its subtree, so only its version changes
+
+// used in rotations
+// pNode, now below top, still needs repair: top keeps the height the parent counted on,
+// so the way up from pNode goes on past top exactly when the subtree height changed
+static OCNODE *_repairBelow( OCNODE *top, OCNODE *pNode, int oldHeight){
+    STORE(top->height, oldHeight);
+    return pNode;
+}
+
+// used in _rebalanceToRight
+static OCNODE *_rotateRight( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, OCNODE *left, int hr, int hll, OCNODE *leftRight, int hlr){
+    uint64_t version = LOAD(pNode->version);
+    int oldHeight = LOAD(pNode->height);
+    OCNODE *parentLeft = LOAD(parent->left);
+    STAT_ADD(pTree, rotations, 1);
+    STORE(pNode->version, version | OCAVL_SHRINKING);
+
+    STORE(pNode->left, leftRight);
+    if(leftRight != NULL)
+        STORE(leftRight->parent, pNode);
+    STORE(left->right, pNode);
+    STORE(pNode->parent, left);
+    if(parentLeft == pNode)
+        STORE(parent->left, left);
+    else
+        STORE(parent->right, left);
+    STORE(left->parent, parent);
+
+    int height = 1 + ((hlr > hr) ? hlr : hr);
+    STORE(pNode->height, height);
+    STORE(left->height, 1 + ((hll > height) ? hll : height));
+    STORE(pNode->version, version + OCAVL_VERSION);
+
+    if(hlr - hr < -1 || hlr - hr > 1) return _repairBelow(left, pNode, oldHeight);
+    if((leftRight == NULL || hr == 0) && LOAD(pNode->value) == NULL) return _repairBelow(left, pNode, oldHeight);
+    if(hll - height < -1 || hll - height > 1) return left;
+    if(hll == 0 && LOAD(left->value) == NULL) return left;
+    return _fixHeight(parent);
+}
+
+// used in _rebalanceToLeft
+// mirror of _rotateRight
+static OCNODE *_rotateLeft( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, int hl, OCNODE *right, OCNODE *rightLeft, int hrl, int hrr){
+    uint64_t version = LOAD(pNode->version);
+    int oldHeight = LOAD(pNode->height);
+    OCNODE *parentLeft = LOAD(parent->left);
+    STAT_ADD(pTree, rotations, 1);
+    STORE(pNode->version, version | OCAVL_SHRINKING);
+
+    STORE(pNode->right, rightLeft);
+    if(rightLeft != NULL)
+        STORE(rightLeft->parent, pNode);
+    STORE(right->left, pNode);
+    STORE(pNode->parent, right);
+    if(parentLeft == pNode)
+        STORE(parent->left, right);
+    else
+        STORE(parent->right, right);
+    STORE(right->parent, parent);
+
+    int height = 1 + ((hl > hrl) ? hl : hrl);
+    STORE(pNode->height, height);
+    STORE(right->height, 1 + ((height > hrr) ? height : hrr));
+    STORE(pNode->version, version + OCAVL_VERSION);
+
+    if(hrl - hl < -1 || hrl - hl > 1) return _repairBelow(right, pNode, oldHeight);
+    if((rightLeft == NULL || hl == 0) && LOAD(pNode->value) == NULL) return _repairBelow(right, pNode, oldHeight);
+    if(hrr - height < -1 || hrr - height > 1) return right;
+    if(hrr == 0 && LOAD(right->value) == NULL) return right;
+    return _fixHeight(parent);
+}
+
+// used in _rebalanceToRight
+// left-right double rotation; pNode and left both lose keys
+// left ends up beside pNode, not above it, so the way up from pNode would not repair it:
+// if left is a routing node left with one child, it is unlinked here
+static OCNODE *_rotateRightOverLeft( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, OCNODE *left, int hr, int hll, OCNODE *leftRight, int hlrl){
+    uint64_t version = LOAD(pNode->version), leftVersion = LOAD(left->version);
+    int oldHeight = LOAD(pNode->height);
+    OCNODE *parentLeft = LOAD(parent->left);
+    OCNODE *lrl = LOAD(leftRight->left), *lrr = LOAD(leftRight->right);
+    int hlrr = _height(lrr);
+    STAT_ADD(pTree, rotations, 2);
+    STORE(pNode->version, version | OCAVL_SHRINKING);
+    STORE(left->version, leftVersion | OCAVL_SHRINKING);
+
+    STORE(pNode->left, lrr);
+    if(lrr != NULL)
+        STORE(lrr->parent, pNode);
+    STORE(left->right, lrl);
+    if(lrl != NULL)
+        STORE(lrl->parent, left);
+    STORE(leftRight->left, left);
+    STORE(left->parent, leftRight);
+    STORE(leftRight->right, pNode);
+    STORE(pNode->parent, leftRight);
+    if(parentLeft == pNode)
+        STORE(parent->left, leftRight);
+    else
+        STORE(parent->right, leftRight);
+    STORE(leftRight->parent, parent);
+
+    int height = 1 + ((hlrr > hr) ? hlrr : hr);
+    STORE(pNode->height, height);
+    int leftHeight = 1 + ((hll > hlrl) ? hll : hlrl);
+    STORE(left->height, leftHeight);
+    STORE(leftRight->height, 1 + ((leftHeight > height) ? leftHeight : height));
+    STORE(pNode->version, version + OCAVL_VERSION);
+    STORE(left->version, leftVersion + OCAVL_VERSION);
+
+    if((hll == 0 || hlrl == 0) && LOAD(left->value) == NULL && _attemptUnlink(pTree, leftRight, left)){
+        leftHeight = _height(LOAD(leftRight->left));
+        STORE(leftRight->height, 1 + ((leftHeight > height) ? leftHeight : height));
+    }
+
+    if(hlrr - hr < -1 || hlrr - hr > 1) return _repairBelow(leftRight, pNode, oldHeight);
+    if((lrr == NULL || hr == 0) && LOAD(pNode->value) == NULL) return _repairBelow(leftRight, pNode, oldHeight);
+    if(leftHeight - height < -1 || leftHeight - height > 1) return leftRight;
+    return _fixHeight(parent);
+}
+
+// used in _rebalanceToLeft
+// mirror of _rotateRightOverLeft
+static OCNODE *_rotateLeftOverRight( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, int hl, OCNODE *right, OCNODE *rightLeft, int hrr, int hrlr){
+    uint64_t version = LOAD(pNode->version), rightVersion = LOAD(right->version);
+    int oldHeight = LOAD(pNode->height);
+    OCNODE *parentLeft = LOAD(parent->left);
+    OCNODE *rll = LOAD(rightLeft->left), *rlr = LOAD(rightLeft->right);
+    int hrll = _height(rll);
+    STAT_ADD(pTree, rotations, 2);
+    STORE(pNode->version, version | OCAVL_SHRINKING);
+    STORE(right->version, rightVersion | OCAVL_SHRINKING);
+
+    STORE(pNode->right, rll);
+    if(rll != NULL)
+        STORE(rll->parent, pNode);
+    STORE(right->left, rlr);
+    if(rlr != NULL)
+        STORE(rlr->parent, right);
+    STORE(rightLeft->right, right);
+    STORE(right->parent, rightLeft);
+    STORE(rightLeft->left, pNode);
+    STORE(pNode->parent, rightLeft);
+    if(parentLeft == pNode)
+        STORE(parent->left, rightLeft);
+    else
+        STORE(parent->right, rightLeft);
+    STORE(rightLeft->parent, parent);
+
+    int height = 1 + ((hl > hrll) ? hl : hrll);
+    STORE(pNode->height, height);
+    int rightHeight = 1 + ((hrlr > hrr) ? hrlr : hrr);
+    STORE(right->height, rightHeight);
+    STORE(rightLeft->height, 1 + ((height > rightHeight) ? height : rightHeight));
+    STORE(pNode->version, version + OCAVL_VERSION);
+    STORE(right->version, rightVersion + OCAVL_VERSION);
+
+    if((hrr == 0 || hrlr == 0) && LOAD(right->value) == NULL && _attemptUnlink(pTree, rightLeft, right)){
+        rightHeight = _height(LOAD(rightLeft->right));
+        STORE(rightLeft->height, 1 + ((height > rightHeight) ? height : rightHeight));
+    }
+
+    if(hrll - hl < -1 || hrll - hl > 1) return _repairBelow(rightLeft, pNode, oldHeight);
+    if((rll == NULL || hl == 0) && LOAD(pNode->value) == NULL) return _repairBelow(rightLeft, pNode, oldHeight);
+    if(rightHeight - height < -1 || rightHeight - height > 1) return rightLeft;
+    return _fixHeight(parent);
+}
+
+static OCNODE *_rebalanceToLeft( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, OCNODE *right, int hl0);
+
+// used in _rebalance
+// pNode (locked, like its parent) is left heavy; locks its left child and the grandchild
+// a double rotation would lift, and rotates unless another thread fixed it first
+static OCNODE *_rebalanceToRight( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, OCNODE *left, int hr0){
+    OCNODE *next;
+    _lock(left);
+    int hl = LOAD(left->height);
+    if(hl - hr0 <= 1){
+        _unlock(left);
+        return pNode;
+    }
+    OCNODE *leftRight = LOAD(left->right);
+    int hll0 = _height(LOAD(left->left));
+    int hlr0 = _height(leftRight);
+    if(hll0 >= hlr0){
+        next = _rotateRight(pTree, parent, pNode, left, hr0, hll0, leftRight, hlr0);
+        _unlock(left);
+        return next;
+    }
+    _lock(leftRight);
+    int hlr = LOAD(leftRight->height);
+    if(hll0 >= hlr){
+        next = _rotateRight(pTree, parent, pNode, left, hr0, hll0, leftRight, hlr);
+        _unlock(leftRight);
+        _unlock(left);
+        return next;
+    }
+    int hlrl = _height(LOAD(leftRight->left));
+    int b = hll0 - hlrl;
+    if(b >= -1 && b <= 1){
+        next = _rotateRightOverLeft(pTree, parent, pNode, left, hr0, hll0, leftRight, hlrl);
+        _unlock(leftRight);
+        _unlock(left);
+        return next;
+    }
+    _unlock(leftRight);
+    // the double rotation would unbalance left: rotate left's right child up first
+    next = _rebalanceToLeft(pTree, pNode, left, leftRight, hll0);
+    _unlock(left);
+    return next;
+}
+
+// used in _rebalance
+// mirror of _rebalanceToRight
+static OCNODE *_rebalanceToLeft( OCAVL *pTree, OCNODE *parent, OCNODE *pNode, OCNODE *right, int hl0){
+    OCNODE *next;
+    _lock(right);
+    int hr = LOAD(right->height);
+    if(hl0 - hr >= -1){
+        _unlock(right);
+        return pNode;
+    }
+    OCNODE *rightLeft = LOAD(right->left);
+    int hrl0 = _height(rightLeft);
+    int hrr0 = _height(LOAD(right->right));
+    if(hrr0 >= hrl0){
+        next = _rotateLeft(pTree, parent, pNode, hl0, right, rightLeft, hrl0, hrr0);
+        _unlock(right);
+        return next;
+    }
+    _lock(rightLeft);
+    int hrl = LOAD(rightLeft->height);
+    if(hrr0 >= hrl){
+        next = _rotateLeft(pTree, parent, pNode, hl0, right, rightLeft, hrl, hrr0);
+        _unlock(rightLeft);
+        _unlock(right);
+        return next;
+    }
+    int hrlr = _height(LOAD(rightLeft->right));
+    int b = hrr0 - hrlr;
+    if(b >= -1 && b <= 1){
+        next = _rotateLeftOverRight(pTree, parent, pNode, hl0, right, rightLeft, hrr0, hrlr);
+        _unlock(rightLeft);
+        _unlock(right);
+        return next;
+    }
+    _unlock(rightLeft);
+    next = _rebalanceToRight(pTree, pNode, right, rightLeft, hrr0);
+    _unlock(right);
+    return next;
+}
+
+// used in _fixHeightAndRebalance
+// unlinks, rotates or fixes the height of pNode (locked, like its parent)
+// return	next node to repair (NULL if none)
+static OCNODE *_rebalance( OCAVL *pTree, OCNODE *parent, OCNODE *pNode){
+    OCNODE *left = LOAD(pNode->left), *right = LOAD(pNode->right);
+    if((left == NULL || right == NULL) && LOAD(pNode->value) == NULL)
+        return _attemptUnlink(pTree, parent, pNode) ? _fixHeight(parent) : pNode;
+
+    int hn = LOAD(pNode->height);
+    int hl0 = _height(left), hr0 = _height(right);
+    int height = 1 + ((hl0 > hr0) ? hl0 : hr0);
+    if(hl0 - hr0 > 1) return _rebalanceToRight(pTree, parent, pNode, left, hr0);
+    if(hl0 - hr0 < -1) return _rebalanceToLeft(pTree, parent, pNode, right, hl0);
+    if(height != hn){
+        STORE(pNode->height, height);
+        return _fixHeight(parent);
+    }
+    return NULL;
+}
+
+// used in OCAVL_Insert, OCAVL_Delete
+// repairs pNode and its ancestors after a change, one or two locks at a time; stops where
+// nothing is left to do or another thread has taken over (the node was unlinked)
+static void _fixHeightAndRebalance( OCAVL *pTree, OCNODE *pNode){
+    while(pNode != NULL && LOAD(pNode->parent) != NULL){
+        int c = _condition(pNode);
+        if(c == NOTHING || (LOAD(pNode->version) & OCAVL_UNLINKED)) return;
+        if(c != UNLINK && c != REBALANCE){
+            OCNODE *locked = pNode;
+            _lock(locked);
+            pNode = _fixHeight(locked);
+            _unlock(locked);
+        }
+        else{
+            OCNODE *parent = LOAD(pNode->parent);
+            _lock(parent);
+            if(!(LOAD(parent->version) & OCAVL_UNLINKED) && LOAD(pNode->parent) == parent){
+                OCNODE *locked = pNode;
+                _lock(locked);
+                pNode = _rebalance(pTree, parent, locked);
+                _unlock(locked);
+            }
+            _unlock(parent);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// optimistic descent: each level reads the child, then checks that the version of the
+// node it came from is still the one read before (ovl); if not, the key may have moved
+// out of that subtree and the search goes back a level
+
+// used in OCAVL_Search
+// return	data, NULL or RETRY_PTR
+static void *_attemptGet( OCAVL *pTree, void *keyPtr, OCNODE *pNode, int dir, uint64_t ovl){
+    while(1){
+        OCNODE *child = CHILD(pNode, dir);
+        if(child == NULL)
+            return (LOAD(pNode->version) != ovl) ? RETRY_PTR : NULL;
+
+        int cmp = pTree->compare(keyPtr, LOAD(child->key));
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0) return LOAD(child->value);
+
+        uint64_t childOvl = LOAD(child->version);
+        if(childOvl & (OCAVL_SHRINKING | OCAVL_UNLINKED)){
+            _waitUntilNotChanging(child);
+            if(LOAD(pNode->version) != ovl) return RETRY_PTR;
+        }
+        else if(child != CHILD(pNode, dir)){
+            if(LOAD(pNode->version) != ovl) return RETRY_PTR;
+        }
+        else{
+            if(LOAD(pNode->version) != ovl) return RETRY_PTR;
+            STAT_ADD(pTree, hops, 1);
+            void *result = _attemptGet(pTree, keyPtr, child, cmp, childOvl);
+            if(result != RETRY_PTR) return result;
+        }
+    }
+}
+
+// used in _attemptInsert
+// the key is in node pNode: counts a duplicate without a lock, or refills a routing node;
+// the deleted data the routing node kept as its key is retired (with a release callback)
+// return	1, 2, 0 (overflow) or RETRY
+static int _attemptNodeInsert( OCAVL *pTree, OCNODE *pNode, void *dataInPtr, void (*callback)(void *)){
+    void *dataPtr = LOAD(pNode->value);
+    if(dataPtr == NULL){
+        OCDATA *pData = NULL;
+        if(pTree->release != NULL && (pData = malloc(sizeof(OCDATA))) == NULL) return 0;
+        _lock(pNode);
+        if(LOAD(pNode->version) & OCAVL_UNLINKED){
+            _unlock(pNode);
+            free(pData);
+            return RETRY;
+        }
+        dataPtr = LOAD(pNode->value);
+        if(dataPtr == NULL){
+            STORE(pNode->value, dataInPtr);
+            if(pData != NULL){
+                pData->dataPtr = LOAD(pNode->key);
+                STORE(pNode->key, dataInPtr); // compares the same, so searches may read either
+                pData->next = LOAD(pTree->retiredData);
+                while(!__atomic_compare_exchange_n(&pTree->retiredData, &pData->next, pData, 0,
+                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                    ;
+                __atomic_fetch_add(&pTree->retiredCount, 1, __ATOMIC_SEQ_CST);
+            }
+            _unlock(pNode);
+            return 1;
+        }
+        _unlock(pNode);
+        free(pData);
+    }
+    if(callback != NULL)
+        callback(dataPtr);
+    return 2;
+}
+
+// used in OCAVL_Insert
+// links a new node (*spare, allocated on first need) under pNode with only pNode locked
+// return	1, 2, 0 (overflow) or RETRY
+static int _attemptInsert( OCAVL *pTree, void *dataInPtr, void (*callback)(void *), OCNODE *pNode, int dir, uint64_t ovl, OCNODE **spare){
+    while(1){
+        OCNODE *child = CHILD(pNode, dir);
+        if(LOAD(pNode->version) != ovl) return RETRY;
+
+        if(child == NULL){
+            if(*spare == NULL && (*spare = malloc(sizeof(OCNODE))) == NULL) return 0;
+            _lock(pNode);
+            if(LOAD(pNode->version) != ovl){
+                _unlock(pNode);
+                return RETRY;
+            }
+            if(CHILD(pNode, dir) != NULL){
+                _unlock(pNode);
+                continue;
+            }
+            OCNODE *new = *spare;
+            *spare = NULL;
+            new->key = dataInPtr;
+            new->value = dataInPtr;
+            new->parent = pNode;
+            new->left = NULL;
+            new->right = NULL;
+            new->version = 0;
+            new->height = 1;
+            new->lock = 0;
+            new->retired = NULL;
+            STAT_ADD(pTree, allocs, 1);
+            _setChild(pNode, dir, new);
+            OCNODE *damaged = _fixHeight(pNode);
+            _unlock(pNode);
+            _fixHeightAndRebalance(pTree, damaged);
+            return 1;
+        }
+
+        int cmp = pTree->compare(dataInPtr, LOAD(child->key));
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0){
+            int result = _attemptNodeInsert(pTree, child, dataInPtr, callback);
+            if(result != RETRY) return result;
+            continue;
+        }
+        uint64_t childOvl = LOAD(child->version);
+        if(childOvl & (OCAVL_SHRINKING | OCAVL_UNLINKED)){
+            _waitUntilNotChanging(child);
+            continue;
+        }
+        if(child != CHILD(pNode, dir)) continue;
+        if(LOAD(pNode->version) != ovl) return RETRY;
+        STAT_ADD(pTree, hops, 1);
+        int result = _attemptInsert(pTree, dataInPtr, callback, child, cmp, childOvl, spare);
+        if(result != RETRY) return result;
+    }
+}
+
+// used in _attemptRemove
+// the key is in node pNode, a child of parent: unlinks it if it has less than two
+// children (locking parent, then pNode), else turns it into a routing node
+// return	deleted data, NULL or RETRY_PTR
+static void *_attemptNodeRemove( OCAVL *pTree, OCNODE *parent, OCNODE *pNode){
+    void *dataPtr;
+    if(LOAD(pNode->value) == NULL) return NULL;
+
+    if(LOAD(pNode->left) == NULL || LOAD(pNode->right) == NULL){
+        _lock(parent);
+        if((LOAD(parent->version) & OCAVL_UNLINKED) || LOAD(pNode->parent) != parent){
+            _unlock(parent);
+            return RETRY_PTR;
+        }
+        _lock(pNode);
+        dataPtr = LOAD(pNode->value);
+        if(dataPtr != NULL && !_attemptUnlink(pTree, parent, pNode)) dataPtr = RETRY_PTR;
+        _unlock(pNode);
+        OCNODE *damaged = (dataPtr != NULL && dataPtr != RETRY_PTR) ? _fixHeight(parent) : NULL;
+        _unlock(parent);
+        _fixHeightAndRebalance(pTree, damaged);
+        return dataPtr;
+    }
+
+    _lock(pNode);
+    if(LOAD(pNode->version) & OCAVL_UNLINKED){
+        _unlock(pNode);
+        return RETRY_PTR;
+    }
+    dataPtr = LOAD(pNode->value);
+    if(dataPtr != NULL){
+        // a child left meanwhile: unlinking needs the parent's lock first
+        if(LOAD(pNode->left) == NULL || LOAD(pNode->right) == NULL)
+            dataPtr = RETRY_PTR;
+        else
+            STORE(pNode->value, NULL);
+    }
+    _unlock(pNode);
+    return dataPtr;
+}
+
+// used in OCAVL_Delete
+// return	deleted data, NULL or RETRY_PTR
+static void *_attemptRemove( OCAVL *pTree, void *keyPtr, OCNODE *pNode, int dir, uint64_t ovl){
+    while(1){
+        OCNODE *child = CHILD(pNode, dir);
+        if(LOAD(pNode->version) != ovl) return RETRY_PTR;
+        if(child == NULL) return NULL;
+
+        int cmp = pTree->compare(keyPtr, LOAD(child->key));
+        STAT_ADD(pTree, compares, 1);
+        if(cmp == 0){
+            void *result = _attemptNodeRemove(pTree, pNode, child);
+            if(result != RETRY_PTR) return result;
+            continue;
+        }
+        uint64_t childOvl = LOAD(child->version);
+        if(childOvl & (OCAVL_SHRINKING | OCAVL_UNLINKED)){
+            _waitUntilNotChanging(child);
+            continue;
+        }
+        if(child != CHILD(pNode, dir)) continue;
+        if(LOAD(pNode->version) != ovl) return RETRY_PTR;
+        STAT_ADD(pTree, hops, 1);
+        void *result = _attemptRemove(pTree, keyPtr, child, cmp, childOvl);
+        if(result != RETRY_PTR) return result;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// quiescent walks
+
+// used in OCAVL_Destroy
+// a routing node still holds the deleted data it was made for
+static void _destroy( OCAVL *pTree, OCNODE *pNode, void (*callback)(void *)){
+    if(pNode == NULL) return;
+    _destroy(pTree, pNode->left, callback);
+    _destroy(pTree, pNode->right, callback);
+    if(pNode->value != NULL)
+        callback(pNode->value);
+    else if(pTree->release != NULL)
+        pTree->release(pNode->key);
+    free(pNode);
+}
+
+// used in OCAVL_Traverse
+static void _traverse( OCNODE *pNode, int toRight, void (*callback)(const void *)){
+    if(pNode == NULL) return;
+    _traverse(toRight ? pNode->right : pNode->left, toRight, callback);
+    if(pNode->value != NULL)
+        callback(pNode->value);
+    _traverse(toRight ? pNode->left : pNode->right, toRight, callback);
+}
+
+// used in OCAVL_RangeTraverse
+// visits only the subtrees that overlap [lo, hi]
+static void _range( OCAVL *pTree, OCNODE *pNode, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    if(pNode == NULL) return;
+    int cmpLo = pTree->compare(loPtr, pNode->key);
+    int cmpHi = pTree->compare(hiPtr, pNode->key);
+    if(cmpLo < 0)
+        _range(pTree, pNode->left, loPtr, hiPtr, callback);
+    if(cmpLo <= 0 && cmpHi >= 0 && pNode->value != NULL)
+        callback(pNode->value);
+    if(cmpHi > 0)
+        _range(pTree, pNode->right, loPtr, hiPtr, callback);
+}
+
+// used in OCAVL_Print
+static void _print( OCNODE *pNode, int level, void (*callback)(const void *)){
+    if(pNode == NULL) return;
+    _print(pNode->right, level + 1, callback);
+    if(pNode->value != NULL){
+        for(int t = 0; t < level; t++)
+            printf("\t");
+        callback(pNode->value);
+    }
+    _print(pNode->left, level + 1, callback);
+}
+
+// used in OCAVL_Check
+// checks the subtree against (lo, hi) (NULL: unbounded); *count gets its data added
+// return	height of the subtree
+//			-1 if broken
+static int _check( OCAVL *pTree, OCNODE *pNode, OCNODE *parent, const void *lo, const void *hi, int depth, int *count){
+    if(pNode == NULL) return 0;
+    if(depth >= MAX_DEPTH || pNode->parent != parent || (pNode->version & (OCAVL_SHRINKING | OCAVL_UNLINKED)) || pNode->lock)
+        return -1;
+    if(lo != NULL && pTree->compare(lo, pNode->key) >= 0) return -1;
+    if(hi != NULL && pTree->compare(pNode->key, hi) >= 0) return -1;
+    if(pNode->value == NULL && (pNode->left == NULL || pNode->right == NULL)) return -1;
+    if(pNode->value != NULL && pTree->compare(pNode->value, pNode->key) != 0) return -1;
+
+    int hl = _check(pTree, pNode->left, pNode, lo, pNode->key, depth + 1, count);
+    int hr = (hl < 0) ? -1 : _check(pTree, pNode->right, pNode, pNode->key, hi, depth + 1, count);
+    if(hr < 0 || hl - hr < -1 || hl - hr > 1) return -1;
+    if(pNode->height != 1 + ((hl > hr) ? hl : hr)) return -1;
+    if(pNode->value != NULL)
+        (*count)++;
+    return pNode->height;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* Allocates an empty concurrent AVL tree
+	return	head pointer
+			NULL if overflow
+*/
+OCAVL *OCAVL_Create( int (*compare)(const void *, const void *)){
+    OCAVL *pTree = malloc(sizeof(OCAVL));
+    if(pTree == NULL) return NULL;
+    pTree->holder.key = NULL;
+    pTree->holder.value = NULL;
+    pTree->holder.parent = NULL;
+    pTree->holder.left = NULL;
+    pTree->holder.right = NULL;
+    pTree->holder.version = 0;
+    pTree->holder.height = 0;
+    pTree->holder.lock = 0;
+    pTree->holder.retired = NULL;
+    pTree->compare = compare;
+    pTree->release = NULL;
+    pTree->retiredNodes = NULL;
+    pTree->retiredData = NULL;
+    pTree->retiredCount = 0;
+    pTree->pendingNodes = NULL;
+    pTree->pendingData = NULL;
+    pTree->pendingEpoch = 0;
+    pTree->reclaiming = 0;
+    pTree->stats = NULL;
+    return pTree;
+}
+
+/* Sets the callback that frees data deleted from the tree (NULL: none)
+*/
+void OCAVL_SetRelease( OCAVL *pTree, void (*release)(void *)){
+    pTree->release = release;
+}
+
+/* Deletes all data in tree and recycles memory
+*/
+void OCAVL_Destroy( OCAVL *pTree, void (*callback)(void *)){
+    _destroy(pTree, pTree->holder.right, callback);
+    _free(pTree, pTree->pendingNodes, pTree->pendingData);
+    _free(pTree, pTree->retiredNodes, pTree->retiredData);
+    free(pTree);
+}
+
+/* Inserts new data into the tree
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int OCAVL_Insert( OCAVL *pTree, void *dataInPtr, void (*callback)(void *)){
+    OCNODE *spare = NULL;
+    int result;
+    _epochEnter();
+    _reclaim(pTree);
+    // the holder never changes version, so the descent from it never returns RETRY
+    do
+        result = _attemptInsert(pTree, dataInPtr, callback, &pTree->holder, 1, 0, &spare);
+    while(result == RETRY);
+    free(spare);
+    return result;
+}
+
+/* Deletes the data with keyPtr
+	return	address of the deleted data
+			NULL not found
+*/
+void *OCAVL_Delete( OCAVL *pTree, void *keyPtr){
+    void *dataOut;
+    _epochEnter();
+    _reclaim(pTree);
+    do
+        dataOut = _attemptRemove(pTree, keyPtr, &pTree->holder, 1, 0);
+    while(dataOut == RETRY_PTR);
+    return dataOut;
+}
+
+/* return	address of data with keyPtr
+			NULL not found
+*/
+void *OCAVL_Search( OCAVL *pTree, void *keyPtr){
+    void *dataPtr;
+    _epochEnter();
+    do
+        dataPtr = _attemptGet(pTree, keyPtr, &pTree->holder, 1, 0);
+    while(dataPtr == RETRY_PTR);
+    return dataPtr;
+}
+
+/* calls callback on all data in ascending (toRight 0) or descending order
+*/
+void OCAVL_Traverse( OCAVL *pTree, int toRight, void (*callback)(const void *)){
+    _traverse(pTree->holder.right, toRight, callback);
+}
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void OCAVL_RangeTraverse( OCAVL *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *)){
+    _range(pTree, pTree->holder.right, loPtr, hiPtr, callback);
+}
+
+/* prints data right-to-left with a tab per level
+*/
+void OCAVL_Print( OCAVL *pTree, void (*callback)(const void *)){
+    _print(pTree->holder.right, 1, callback);
+}
+
+/* returns height of the tree
+*/
+int OCAVL_Height( OCAVL *pTree){
+    return _height(LOAD(pTree->holder.right));
+}
+
+/* checks order, parent links, heights, balance, versions, routing nodes and count
+	return	1 valid
+			0 broken
+*/
+int OCAVL_Check( OCAVL *pTree, int count){
+    int n = 0;
+    if(_check(pTree, pTree->holder.right, &pTree->holder, NULL, NULL, 0, &n) < 0) return 0;
+    return n == count;
+}
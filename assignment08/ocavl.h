@@ -0,0 +1,125 @@
+#include <stdint.h> // uint64_t
+
+struct tree_stats;
+
+////////////////////////////////////////////////////////////////////////////////
+// optimistic concurrent AVL engine of AVLT_CreateEngine (AVLT_CONCURRENT)
+// (relaxed-balance AVL tree with optimistic hand-over-hand validation, after Bronson,
+// Casper, Chafi and Olukotun, "A Practical Concurrent Binary Search Tree", PPoPP 2010)
+
+// node; a search reads no lock: it validates each step against the version of the node it
+// came from, which a rotation that moves keys out of the node's subtree changes
+typedef struct ocnode
+{
+	void		*key;		// data the node was made for; compared, changes only to equal data
+	void		*value;		// data, NULL if deleted (a routing node)
+	struct ocnode	*parent;
+	struct ocnode	*left;
+	struct ocnode	*right;
+	uint64_t	version;	// OCAVL_SHRINKING while keys leave the subtree, OCAVL_UNLINKED once out
+	int			height;
+	int			lock;		// spin lock of writers
+	struct ocnode	*retired;	// next unlinked node in limbo (OCAVL.retiredNodes)
+} OCNODE;
+
+#define OCAVL_UNLINKED	1ull
+#define OCAVL_SHRINKING	2ull
+#define OCAVL_VERSION	4ull	// version increment of a finished change
+
+// deleted data a refilled routing node no longer holds as its key, in limbo until no
+// operation in flight can still compare with it
+typedef struct ocdata
+{
+	void		*dataPtr;
+	struct ocdata	*next;
+} OCDATA;
+
+typedef struct ocavl
+{
+	OCNODE	holder;	// sentinel: holder.right is the root; never changes version
+	int		(*compare)(const void *, const void *);
+	void	(*release)(void *);	// frees deleted data (OCAVL_SetRelease), NULL if none
+	OCNODE	*retiredNodes;	// limbo: nodes unlinked from the tree, each with its deleted data
+	OCDATA	*retiredData;	// limbo: deleted data no node holds any more
+	int		retiredCount;	// in both lists; a full batch is taken as the pending batch
+	OCNODE	*pendingNodes;	// batch freed once every thread has called again since pendingEpoch
+	OCDATA	*pendingData;
+	unsigned long	pendingEpoch;
+	int		reclaiming;	// a thread is taking or freeing the pending batch
+	struct tree_stats	*stats;	// counters of the TREE on top (-DADT_STATS, added atomically), NULL if none
+} OCAVL;
+
+////////////////////////////////////////////////////////////////////////////////
+// Prototype declarations
+
+/* Allocates an empty concurrent AVL tree
+	return	head pointer
+			NULL if overflow
+*/
+OCAVL *OCAVL_Create( int (*compare)(const void *, const void *));
+
+/* Sets the callback that frees data deleted from the tree (NULL: none, the default)
+	deleted data stays the key of its node until the node is unlinked, so it is released
+	only once no operation can reach it any more and the thread that deleted it has made
+	its next call; without a callback the caller keeps the deleted data and may free it
+	only after OCAVL_Destroy
+	to be set before other threads use the tree
+*/
+void OCAVL_SetRelease( OCAVL *pTree, void (*release)(void *));
+
+/* Deletes all data in tree and recycles memory; deleted data the tree still holds goes
+	to the release callback
+	no other thread may use the tree any more
+*/
+void OCAVL_Destroy( OCAVL *pTree, void (*callback)(void *));
+
+/* Inserts new data into the tree; safe in any number of threads beside searches and deletions
+	callback is called with the stored data on a duplicated key, without a lock (it may
+	run in several threads at once on the same data, so it must be atomic)
+	return	1 success
+			0 overflow
+			2 if duplicated key
+*/
+int OCAVL_Insert( OCAVL *pTree, void *dataInPtr, void (*callback)(void *));
+
+/* Deletes the data with keyPtr; safe in any number of threads
+	unlinked nodes and deleted data wait in limbo (epoch reader slots, as BST_RCU in bst.c)
+	and are freed in batches of 64 once every thread that could reach them has called
+	OCAVL_Search, OCAVL_Insert or OCAVL_Delete again (or exited); so the data returned
+	here or by OCAVL_Search may be read until the calling thread's next call, and a
+	thread that stops calling holds the batches back
+	return	address of the deleted data
+			NULL not found
+*/
+void *OCAVL_Delete( OCAVL *pTree, void *keyPtr);
+
+/* return	address of data with keyPtr
+			NULL not found
+	takes no lock (threads after the first 128 share a reader lock until they exit, and
+	hold back the freeing of deleted data meanwhile); safe in any number of threads
+*/
+void *OCAVL_Search( OCAVL *pTree, void *keyPtr);
+
+/* calls callback on all data in ascending (toRight 0) or descending order
+	the traversals, OCAVL_Print, OCAVL_Height and OCAVL_Check need a quiescent tree
+*/
+void OCAVL_Traverse( OCAVL *pTree, int toRight, void (*callback)(const void *));
+
+/* calls callback on data in [loPtr, hiPtr] in ascending order
+*/
+void OCAVL_RangeTraverse( OCAVL *pTree, void *loPtr, void *hiPtr, void (*callback)(const void *));
+
+/* prints data right-to-left with a tab per level (routing nodes print nothing)
+*/
+void OCAVL_Print( OCAVL *pTree, void (*callback)(const void *));
+
+/* returns height of the tree, routing nodes included
+*/
+int OCAVL_Height( OCAVL *pTree);
+
+/* checks order, parent links, heights, balance, versions, that routing nodes have two
+	children and that count data are in the tree
+	return	1 valid
+			0 broken
+*/
+int OCAVL_Check( OCAVL *pTree, int count);
@@ -2,8 +2,10 @@
 #include <stdlib.h> // malloc
 #include <string.h> // strdup, strcmp
 #include <ctype.h> // toupper
+#include <pthread.h>
 
 #include "avlt.h"
+#include "memrep.h"
 
 #define QUIT			1
 #define FORWARD_PRINT	2
@@ -13,6 +15,7 @@
 #define DELETE			6
 #define COUNT			7
 #define HEIGHT			8
+#define RANGE_PRINT		9
 
 // User structure type definition
 // 단어 구조체
@@ -21,6 +24,21 @@ typedef struct {
 	int		freq;		// 빈도
 } tWord;
 
+// shard of the input built by one thread
+// for -p option
+typedef struct {
+	char	**words;	// tokens of the shard
+	int		num_words;
+	TREE	*tree;
+	void	(*increase)(void *);	// callback of AVLT_Insert on a duplicated word
+} tShard;
+
+// record of a word in the binary image (AVLT_Save, AVLT_Load)
+typedef struct {
+	int		freq;		// 빈도
+	char	word[];		// 단어
+} tRecord;
+
 ////////////////////////////////////////////////////////////////////////////////
 // 단어 구조체를 위한 메모리를 할당하고 word, freq 초기화
 // return	할당된 단어 구조체에 대한 pointer
@@ -54,6 +72,8 @@ int get_action()
 			return DELETE;
 		case 'C':
 			return COUNT;
+		case 'R':
+			return RANGE_PRINT;
 		case 'H':
 			return HEIGHT;
 	}
@@ -71,6 +91,54 @@ int compare_by_word( const void *n1, const void *n2)
 	return strcmp( p1->word, p2->word);
 }
 
+// returns the word of word structure
+// for AVLT_CreateEngine function (key prefixes of the B+-tree, inline keys of the compact tree)
+const char *word_key( const void *dataPtr)
+{
+	return ((tWord *)dataPtr)->word;
+}
+
+// hashes the word of word structure (FNV-1a)
+// for AVLT_EnableCache function
+uint32_t hash_word( const void *dataPtr)
+{
+	uint32_t h = 2166136261u;
+	
+	for (const unsigned char *p = (const unsigned char *)((tWord *)dataPtr)->word; *p; p++)
+		h = (h ^ *p) * 16777619u;
+	return h;
+}
+
+// adds the frequency of a duplicated word to the word kept in the tree
+// for AVLT_Union function
+void merge_freq( void *dataPtr, void *otherPtr)
+{
+	((tWord *)dataPtr)->freq += ((tWord *)otherPtr)->freq;
+	destroyWord( otherPtr);
+}
+
+// copies word structure into a record of the binary image
+// for AVLT_Save function
+// return	size of the record
+size_t pack_word( const void *dataPtr, void *buf)
+{
+	tWord *pWord = (tWord *)dataPtr;
+	
+	if (buf)
+	{
+		((tRecord *)buf)->freq = pWord->freq;
+		strcpy( ((tRecord *)buf)->word, pWord->word);
+	}
+	return sizeof( tRecord) + strlen( pWord->word) + 1;
+}
+
+// compares a word in word structure with the word of a record
+// for AVLT_Load function
+int compare_to_record( const void *n1, const void *n2)
+{
+	return strcmp( ((tWord *)n1)->word, ((tRecord *)n2)->word);
+}
+
 // prints contents of word structure
 // for AVLT_Traverse and AVLT_TraverseR functions
 void print_word(const void *dataPtr)
@@ -90,6 +158,27 @@ void increase_freq(void *dataPtr)
 	((tWord *)dataPtr)->freq++;
 }
 
+// increases the frequency of a word other threads may count at the same time
+// for AVLT_Insert function on the concurrent engine (-p with -e concurrent)
+void increase_freq_atomic(void *dataPtr)
+{
+	__atomic_fetch_add( &((tWord *)dataPtr)->freq, 1, __ATOMIC_RELAXED);
+}
+
+// prints contents of record
+// for AVLT_Traverse and AVLT_TraverseR functions on a loaded image
+void print_record(const void *dataPtr)
+{
+	printf( "%s\t%d\n", ((tRecord *)dataPtr)->word, ((tRecord *)dataPtr)->freq);
+}
+
+// prints word of record
+// for printTree function on a loaded image
+void print_record_only(const void *dataPtr)
+{
+	printf( "%s\n", ((tRecord *)dataPtr)->word);
+}
+
 // gets user's input
 void input_word(char *word)
 {
@@ -97,51 +186,235 @@ void input_word(char *word)
 	fscanf( stdin, "%s", word);
 }
 
+// gets user's input for range print
+void input_range(char *from, char *to)
+{
+	fprintf( stderr, "Input a range of words (from to): ");
+	fscanf( stdin, "%s %s", from, to);
+}
+
+// prints operation counters of the tree in one line
+// for -s option
+void print_stats( TREE *tree)
+{
+	TREE_STATS st = AVLT_Stats( tree);
+	
+	fprintf( stderr, "[stats] count=%d compares=%ld hops=%ld rotations=%ld allocs=%ld peak=%d\n",
+		AVLT_Count( tree), st.compares, st.hops, st.rotations, st.allocs, st.peak);
+	
+	if (tree->cache)
+	{
+		AVLT_CACHE_STATS cs = AVLT_CacheStats( tree);
+		long lookups = cs.hits + cs.misses;
+		
+		fprintf( stderr, "[cache] hits=%ld misses=%ld hit rate=%.1f%%\n",
+			cs.hits, cs.misses, lookups ? 100.0 * cs.hits / lookups : 0.0);
+	}
+}
+
+// builds the tree of one shard
+// for -p option
+void *build_shard( void *arg)
+{
+	tShard *pShard = (tShard *)arg;
+	
+	for (int i = 0; i < pShard->num_words; i++)
+	{
+		tWord *pWord = createWord( pShard->words[i]);
+		int ret = AVLT_Insert( pShard->tree, pWord, pShard->increase);
+		
+		if (ret == 0 || ret == 2) destroyWord( pWord);
+	}
+	return NULL;
+}
+
+// builds the tree from all words of the file: one tree per thread over a slice of the
+// words, then the trees are united pairwise with AVLT_Union; on the concurrent engine
+// all threads insert into one tree instead
+// for -p option
+// return	NULL if overflow
+TREE *build_sharded( FILE *fp, int threads, int engine)
+{
+	char word[100];
+	int num_words = 0, capacity = 1024, ok = 1;
+	int kind = MEM_Kind( MEM_OTHER);
+	char **words = malloc( sizeof( char *) * capacity);
+	tShard *shards = calloc( threads, sizeof( tShard));
+	pthread_t *tids = malloc( sizeof( pthread_t) * threads);
+	TREE *tree = NULL;
+	TREE *shared = NULL;
+	
+	while (fscanf( fp, "%s", word) != EOF)
+	{
+		if (num_words == capacity)
+		{
+			capacity *= 2;
+			words = realloc( words, sizeof( char *) * capacity);
+		}
+		words[num_words++] = strdup( word);
+	}
+	MEM_Kind( kind);
+	
+	if (engine == AVLT_CONCURRENT && (shared = AVLT_CreateEngine( compare_by_word, engine, NULL)) == NULL)
+		ok = 0;
+	
+	for (int t = 0; t < threads; t++)
+	{
+		int lo = (int)((long long)num_words * t / threads);
+		int hi = (int)((long long)num_words * (t + 1) / threads);
+		
+		shards[t].words = words + lo;
+		shards[t].num_words = hi - lo;
+		shards[t].tree = shared ? shared : AVLT_Create( compare_by_word);
+		shards[t].increase = shared ? increase_freq_atomic : increase_freq;
+		if (!shards[t].tree) ok = 0;
+	}
+	
+	// each thread inserts its own slice into its own tree
+	for (int t = 1; t < threads && ok; t++)
+		if (pthread_create( &tids[t], NULL, build_shard, &shards[t]) != 0)
+		{
+			build_shard( &shards[t]); // no thread left: built here instead
+			shards[t].words = NULL;
+		}
+	if (ok) build_shard( &shards[0]);
+	for (int t = 1; t < threads && ok; t++)
+		if (shards[t].words) pthread_join( tids[t], NULL);
+	
+	for (int step = 1; step < threads && ok && !shared; step *= 2)
+		for (int t = 0; t + step < threads; t += 2 * step)
+			AVLT_Union( shards[t].tree, shards[t + step].tree, threads, merge_freq);
+	
+	if (shared)
+	{
+		if (ok) tree = shared;
+		else AVLT_Destroy( shared, destroyWord);
+	}
+	else for (int t = 0; t < threads; t++)
+	{
+		if (ok && t == 0) tree = shards[t].tree;
+		else if (shards[t].tree) AVLT_Destroy( shards[t].tree, destroyWord);
+	}
+	for (int i = 0; i < num_words; i++)
+		free( words[i]);
+	free( words);
+	free( shards);
+	free( tids);
+	return tree;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 int main( int argc, char **argv)
 {
 	TREE *tree;
 	
-	char word[100];
+	char word[100], word2[100];
 	tWord *pWord;
 	int ret;
 	FILE *fp;
+	char *filename = NULL;
+	int show_stats = 0;
+	int mem_report = 0;
+	int image_input = 0;
+	char *image_file = NULL;
+	int engine = AVLT_AVL;
+	int threads = 0;
+	int cache_entries = 0;
+	void (*print)(const void *) = print_word;
+	void (*print_only)(const void *) = print_word_only;
 	
-	if (argc != 2) {
-		fprintf( stderr, "usage: %s FILE\n", argv[0]);
-		return 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp( argv[i], "-s") == 0) show_stats = 1;
+		else if (strcmp( argv[i], "--mem-report") == 0) mem_report = 1;
+		else if (strcmp( argv[i], "-l") == 0) image_input = 1;
+		else if (strcmp( argv[i], "-w") == 0 && i + 1 < argc) image_file = argv[++i];
+		else if (strcmp( argv[i], "-e") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp( argv[i], "avl") == 0) engine = AVLT_AVL;
+			else if (strcmp( argv[i], "bplus") == 0) engine = AVLT_BPLUS;
+			else if (strcmp( argv[i], "compact") == 0) engine = AVLT_COMPACT;
+			else if (strcmp( argv[i], "concurrent") == 0) engine = AVLT_CONCURRENT;
+			else { filename = NULL; break; } // unknown engine
+		}
+		else if (strcmp( argv[i], "-p") == 0 && i + 1 < argc) threads = atoi( argv[++i]);
+		else if (strcmp( argv[i], "-c") == 0 && i + 1 < argc) cache_entries = atoi( argv[++i]);
+		else if (filename == NULL) filename = argv[i];
+		else { filename = NULL; break; } // too many files
 	}
 	
-	fp = fopen( argv[1], "rt");
-	if (!fp)
-	{
-		fprintf( stderr, "Error: cannot open file [%s]\n", argv[1]);
-		return 2;
+	// shards are united as AVL trees, or share one concurrent tree
+	if (threads > 0 && engine != AVLT_AVL && engine != AVLT_CONCURRENT) filename = NULL;
+	
+	if (filename == NULL) {
+		fprintf( stderr, "usage: %s [-s] [--mem-report] [-c ENTRIES] [-e avl|bplus|compact|concurrent] [-w IMAGE] FILE\n", argv[0]);
+		fprintf( stderr, "       %s [-s] [--mem-report] [-c ENTRIES] [-e avl|concurrent] [-w IMAGE] -p THREADS FILE\n", argv[0]);
+		fprintf( stderr, "       %s [-s] [--mem-report] [-c ENTRIES] -l IMAGE\n", argv[0]);
+		return 1;
 	}
 	
-	// creates an empty tree
-	tree = AVLT_Create(compare_by_word);
-	if (!tree)
+	// allocations of nodes, records and strings from here on (printed on quit)
+	if (mem_report) MEM_Start();
+	
+	if (image_input)
 	{
-		printf( "Cannot create a tree\n");
-		return 100;
+		// read-only tree served straight from the file
+		tree = AVLT_Load( filename, compare_to_record);
+		if (!tree)
+		{
+			fprintf( stderr, "Error: cannot load image [%s]\n", filename);
+			return 2;
+		}
+		print = print_record;
+		print_only = print_record_only;
 	}
-	
-	while(fscanf( fp, "%s", word) != EOF)
+	else
 	{
-		pWord = createWord( word);
+		fp = fopen( filename, "rt");
+		if (!fp)
+		{
+			fprintf( stderr, "Error: cannot open file [%s]\n", filename);
+			return 2;
+		}
 		
-		ret = AVLT_Insert( tree, pWord, increase_freq);
+		// creates an empty tree (or the whole tree at once for -p)
+		if (threads > 0) tree = build_sharded( fp, threads, engine);
+		else tree = AVLT_CreateEngine(compare_by_word, engine, word_key);
+		if (!tree)
+		{
+			printf( "Cannot create a tree\n");
+			return 100;
+		}
 		
-		if (ret == 0 || ret == 2) // failure or duplicated
+		// the concurrent tree frees deleted words once no thread can reach them
+		if (engine == AVLT_CONCURRENT) AVLT_SetRelease( tree, destroyWord);
+		
+		while(threads == 0 && fscanf( fp, "%s", word) != EOF)
 		{
-			destroyWord( pWord);
+			pWord = createWord( word);
+			
+			ret = AVLT_Insert( tree, pWord, increase_freq);
+			
+			if (ret == 0 || ret == 2) // failure or duplicated
+			{
+				destroyWord( pWord);
+			}
 		}
+		
+		fclose( fp);
 	}
 	
-	fclose( fp);
+	if (image_file && !AVLT_Save( tree, image_file, pack_word))
+		fprintf( stderr, "Error: cannot write image [%s]\n", image_file);
 	
-	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, T)ree print, S)earch, D)elete, C)ount, H)eight: ");
+	// caches the words searched last in front of the tree
+	if (cache_entries > 0 && !AVLT_EnableCache( tree, cache_entries, hash_word))
+		fprintf( stderr, "Error: cannot cache searches of this tree\n");
+	
+	if (show_stats) print_stats( tree);
+	
+	fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, T)ree print, S)earch, D)elete, C)ount, H)eight: ");
 	
 	while (1)
 	{
@@ -151,19 +424,21 @@ int main( int argc, char **argv)
 		switch( action)
 		{
 			case QUIT:
+				if (show_stats) print_stats( tree);
+				if (mem_report) MEM_Report( stderr);
 				AVLT_Destroy( tree, destroyWord);
 				return 0;
 			
 			case FORWARD_PRINT:
-				AVLT_Traverse( tree, print_word);
+				if (!AVLT_Traverse( tree, print)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 			
 			case BACKWARD_PRINT:
-				AVLT_TraverseR( tree, print_word);
+				if (!AVLT_TraverseR( tree, print)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 			
 			case TREE_PRINT:
-				printTree( tree, print_word_only);
+				if (!printTree( tree, print_only)) fprintf( stderr, "Error: out of memory while printing\n");
 				break;
 				
 			case SEARCH:
@@ -171,7 +446,7 @@ int main( int argc, char **argv)
 				
 				pWord = createWord( word);
 
-				if ((ptr = AVLT_Search( tree, pWord)) != NULL) print_word( ptr);
+				if ((ptr = AVLT_Search( tree, pWord)) != NULL) print( ptr);
 				else fprintf( stdout, "%s not found\n", word);
 				
 				destroyWord( pWord);
@@ -179,19 +454,39 @@ int main( int argc, char **argv)
 				
 			case DELETE:
 				input_word(word);
+				if (image_input)
+				{
+					fprintf( stdout, "%s: read-only image\n", word);
+					break;
+				}
 
 				pWord = createWord( word);
 
 				if ((ptr = AVLT_Delete( tree, pWord)) != NULL)
 				{
 					fprintf( stdout, "(%s, %d) deleted\n", ((tWord *)ptr)->word, ((tWord *)ptr)->freq);
-					destroyWord( ptr);
+					// the concurrent tree frees it itself (AVLT_SetRelease)
+					if (engine != AVLT_CONCURRENT) destroyWord( ptr);
 				}
 				else fprintf( stdout, "%s not found\n", word);
 
 				destroyWord( pWord);
 				break;
 			
+			case RANGE_PRINT:
+				input_range( word, word2);
+				if (image_input)
+				{
+					fprintf( stdout, "range print: read-only image\n");
+					break;
+				}
+				{
+					tWord from = { word, 0}, to = { word2, 0};
+					
+					AVLT_RangeTraverse( tree, &from, &to, print_word);
+				}
+				break;
+			
 			case COUNT:
 				fprintf( stdout, "%d\n", AVLT_Count(tree));
 				break;
@@ -201,7 +496,7 @@ int main( int argc, char **argv)
 				break;
 		}
 		
-		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, T)ree print, S)earch, D)elete, C)ount, H)eight: ");
+		if (action) fprintf( stderr, "Select Q)uit, P)rint, B)ackward print, R)ange print, T)ree print, S)earch, D)elete, C)ount, H)eight: ");
 	}
 	return 0;
 }
@@ -249,12 +544,16 @@ int main( int argc, char **argv)
 ////////////////////////////////////////////////////////////////////////////////
 tWord *createWord( char *word)
 {
+	int kind = MEM_Kind( MEM_RECORD); // for --mem-report
 	tWord *newWord = malloc( sizeof( tWord));
 	
-	if (newWord == NULL) return NULL;
-	
-	newWord->word = strdup( word);
-	newWord->freq = 1;
+	MEM_Kind( MEM_STRING);
+	if (newWord != NULL)
+	{
+		newWord->word = strdup( word);
+		newWord->freq = 1;
+	}
+	MEM_Kind( kind);
 	
 	return newWord;
 }
@@ -2,19 +2,66 @@
 #include <stdlib.h>	// malloc
 #include <string.h>	// strdup
 #include <ctype.h>	// isupper, tolower
+#include <stdint.h>	// uint32_t
+#include <fcntl.h>	// open
+#include <unistd.h>	// close
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
 
+#define MAX_WORDS	100000 // size of dic
 #define MAX_DEGREE	27 // 'a' ~ 'z' and EOW
 #define EOW			'$' // end of word
+#define MAX_DEPTH	101 // states on a path from the root: the root and a permuterm of 99 + 1 characters
 
 // used in the following functions: trieInsert, trieSearch, triePrefixList
 #define getIndex(x)		(((x) == EOW) ? MAX_DEGREE-1 : ((x) - 'a'))
 
+// kinds of trie nodes by the size of their child array
+#define TRIE4		0	// up to 4 children, keys sorted by getIndex
+#define TRIE16		1	// up to 16 children, keys sorted by getIndex
+#define TRIE27		2	// a child for every character (MAX_DEGREE), indexed by getIndex
+
 // TRIE type definition
+// path-compressed: a chain of nodes with one child each is a single node, and the
+// characters of the chain are the label of the edge into it (label[0] is the key the
+// parent finds it by); a node grows into the next kind when its child array is full
 typedef struct trieNode {
 	int 			index; // -1 (non-word), 0, 1, 2, ...
-	struct trieNode	*subtrees[MAX_DEGREE];
+	unsigned char	kind; // TRIE4, TRIE16, TRIE27
+	unsigned char	count; // number of children
+	unsigned short	len; // length of label
+	struct trieNode	*subtrees[]; // child array of the kind, then keys (not TRIE27), then label
 } TRIE;
 
+// used in the following functions: trieInsert, trieSearch, triePrefixList, trieMemory
+#define CAPACITY(kind)	((kind) == TRIE4 ? 4 : (kind) == TRIE16 ? 16 : MAX_DEGREE)
+#define KEYS(p)			((char *)((p)->subtrees + CAPACITY((p)->kind)))
+#define LABEL(p)		(KEYS(p) + ((p)->kind == TRIE27 ? 0 : CAPACITY((p)->kind)))
+#define NODE_SIZE(kind, len)	(sizeof(TRIE) + CAPACITY(kind) * (sizeof(TRIE *) + ((kind) != TRIE27)) + (len))
+
+// code of a character in the double array: 1 ~ MAX_DEGREE, in the order of getIndex
+#define getCode(x)		(getIndex(x) + 1)
+
+// DATRIE type definition
+// double-array trie compiled from a built TRIE for queries (trieCompile): the state
+// reached from state s by character x is t = cells[s].base + getCode(x) if
+// cells[t].check == s; state 0 is the root; the arrays hold no pointers, so they can be
+// written out and mapped back as they are
+typedef struct {
+	int		base;	// first slot of the children of the state
+	int		check;	// parent state, -1 if free, -2 for the root
+} DA_CELL;
+
+typedef struct {
+	int		size;	// number of slots
+	int		states;	// number of slots in use
+	DA_CELL	*cells;
+	int		*index;	// -1 (non-word), 0, 1, 2, ... of the entry ending at each state
+	unsigned int	*children;	// bit getCode(x) - 1 set if the state has a child by x (trieList)
+	void	*image;	// mapped index file holding the arrays (trieLoad), NULL otherwise
+	size_t	imageSize;
+} DATRIE;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Prototype declarations
 
@@ -37,23 +84,46 @@ void trieDestroy( TRIE *root);
 // 영문자와 EOW 외 문자를 포함하는 문자열은 삽입하지 않음
 int trieInsert( TRIE *root, char *str, int dic_index);
 
+/* Converts trie into a double-array trie for queries; trie is left as it was
+	return	double-array trie
+			NULL if overflow
+*/
+DATRIE *trieCompile( TRIE *root);
+
+/* recycles memory of double-array trie (unmaps a loaded index file)
+*/
+void datrieDestroy( DATRIE *pTrie);
+
+/* Writes double-array trie and words dic[0..num_words-1] into an index file
+	return	1 success
+			0 failure
+*/
+int trieSave( DATRIE *pTrie, char *dic[], int num_words, const char *path);
+
+/* Maps an index file written by trieSave read-only into memory; dic[0..*num_words-1]
+	point to the words in the file
+	return	double-array trie
+			NULL if the file cannot be mapped or is not an index
+*/
+DATRIE *trieLoad( const char *path, char *dic[], int *num_words);
+
 /* Retrieve trie for the requested key
 	return	index in dictionary (trie) if key found
 			-1 key not found
 */
-int trieSearch( TRIE *root, char *str);
+int trieSearch( DATRIE *pTrie, char *str);
 
-/* prints all entries in trie using preorder traversal
+/* prints all entries under state in trie using preorder traversal (0: all entries)
 */
-void trieList( TRIE *root, char *dic[]);
+void trieList( DATRIE *pTrie, int state, char *dic[]);
 
-static int trieList_main( TRIE *root, char *dic[], int count);
+static int trieList_main( DATRIE *pTrie, int state, char *dic[], int count, unsigned char *seen);
 
 /* prints all entries starting with str (as prefix) in trie
 	ex) "ab" -> "abandoned", "abandoning", "abandonment", "abased", ...
 	this function uses trieList function
 */
-void triePrefixList( TRIE *root, char *str, char *dic[]);
+void triePrefixList( DATRIE *pTrie, char *str, char *dic[]);
 
 /* makes permuterms for given str
 	ex) "abc" -> "abc$", "bc$a", "c$ab", "$abc"
@@ -65,150 +135,325 @@ int make_permuterms( char *str, char *permuterms[]);
 */
 void clear_permuterms( char *permuterms[], int size);
 
-/* wildcard search
+/* wildcard search over dic[0..num_words-1]
 	ex) "ab*", "*ab", "a*b", "*ab*"
+	a word with the infix of "*ab*" more than once ("*ana*": banana) is printed once
 	this function uses triePrefixList function
 */
-void trieSearchWildcard( TRIE *root, char *str, char *dic[]);
+void trieSearchWildcard( DATRIE *pTrie, char *str, char *dic[], int num_words);
+
+/* counts nodes, bytes of nodes and characters of labels in trie
+	every character of a label is a node of the trie without path compression
+*/
+void trieMemory( TRIE *root, long *nodes, long *bytes, long *chars);
 
 ////////////////////////////////////////////////////////////////////////////////
 int main(int argc, char **argv)
 {
 	TRIE *permute_trie;
-	char *dic[100000];
+	DATRIE *query_trie;
+	char *dic[MAX_WORDS];
 
 	int ret;
-	char str[100];
+	char str[102];
 	FILE *fp;
 	char *permuterms[100];
 	int num_p; // # of permuterms
 	int num_words = 0;
-	
-	if (argc != 2)
+	int show_memory = 0;
+	int image_input = 0;
+	char *filename = NULL;
+	char *image_file = NULL;
+
+	for (int i = 1; i < argc; i++)
 	{
-		fprintf( stderr, "Usage: %s FILE\n", argv[0]);
-		return 1;
+		if (strcmp( argv[i], "-m") == 0) show_memory = 1;
+		else if (strcmp( argv[i], "-l") == 0) image_input = 1;
+		else if (strcmp( argv[i], "-w") == 0 && i + 1 < argc) image_file = argv[++i];
+		else if (filename == NULL) filename = argv[i];
+		else { filename = NULL; break; } // too many files
 	}
-	
-	fp = fopen( argv[1], "rt");
-	if (fp == NULL)
+
+	if (filename == NULL || (image_input && image_file))
 	{
-		fprintf( stderr, "File open error: %s\n", argv[1]);
+		fprintf( stderr, "Usage: %s [-m] [-w INDEX] FILE\n", argv[0]);
+		fprintf( stderr, "       %s [-m] -l INDEX\n", argv[0]);
 		return 1;
 	}
-	
-	//permute_trie = trieCreateNode(); // trie for permuterm index
-    for (int i = 0; i < 100; i++) {
-        permuterms[i] = NULL;
-    }
 
-	while (fscanf( fp, "%s", str) != EOF)
-	{	
-		num_p = make_permuterms( str, permuterms);
-		
-		for (int i = 0; i < num_p; i++)
-			trieInsert( permute_trie, permuterms[i], num_words);
+	if (image_input)
+	{
+		// double array and words served straight from the index file
+		query_trie = trieLoad( filename, dic, &num_words);
+		if (query_trie == NULL)
+		{
+			fprintf( stderr, "Cannot load index: %s\n", filename);
+			return 1;
+		}
+	}
+	else
+	{
+		fp = fopen( filename, "rt");
+		if (fp == NULL)
+		{
+			fprintf( stderr, "File open error: %s\n", filename);
+			return 1;
+		}
+
+		permute_trie = trieCreateNode(); // trie for permuterm index
+		if (permute_trie == NULL)
+		{
+			fprintf( stderr, "Cannot create a trie\n");
+			return 1;
+		}
+
+		while (num_words < MAX_WORDS && fscanf( fp, "%99s", str) != EOF)
+		{
+			num_p = make_permuterms( str, permuterms);
+
+			for (int i = 0; i < num_p; i++)
+				trieInsert( permute_trie, permuterms[i], num_words);
+
+			clear_permuterms( permuterms, num_p);
+
+			dic[num_words++] = strdup( str);
+		}
+
+		fclose( fp);
+
+		// nodes of this trie against nodes of 27 pointers, one per character of every permuterm
+		if (show_memory)
+		{
+			long nodes = 0, bytes = 0, chars = 0;
+
+			trieMemory( permute_trie, &nodes, &bytes, &chars);
+			fprintf( stderr, "[memory] %ld nodes, %ld bytes (%ld nodes, %ld bytes of 27-pointer nodes)\n",
+				nodes, bytes, chars + 1, (chars + 1) * (long)sizeof( struct { int index; TRIE *subtrees[MAX_DEGREE]; }));
+		}
+
+		// queries run on the double array; the build structure is no longer needed
+		query_trie = trieCompile( permute_trie);
+		trieDestroy( permute_trie);
+		if (query_trie == NULL)
+		{
+			fprintf( stderr, "Cannot compile the trie\n");
+			return 1;
+		}
 
-		clear_permuterms( permuterms, num_p);
-		
-		dic[num_words++] = strdup( str);
+		if (image_file && !trieSave( query_trie, dic, num_words, image_file))
+			fprintf( stderr, "Cannot write index: %s\n", image_file);
 	}
-	
-	fclose( fp);
-	
+
+	if (show_memory)
+		fprintf( stderr, "[memory] double array: %d states of %d slots, %ld bytes\n",
+			query_trie->states, query_trie->size, (long)query_trie->size * (sizeof( DA_CELL) + sizeof( int) + sizeof( unsigned int)));
+
 	printf( "\nQuery: ");
-	while (fscanf( stdin, "%s", str) != EOF)
+	while (fscanf( stdin, "%99s", str) != EOF)
 	{
 		// wildcard search term
-		if (strchr( str, '*')) 
+		if (strchr( str, '*'))
 		{
-			trieSearchWildcard( permute_trie, str, dic);
+			trieSearchWildcard( query_trie, str, dic, num_words);
 		}
 		// keyword search
-		else 
+		else
 		{
-			//ret = trieSearch( permute_trie, str);
-			
-			//if (ret == -1) printf( "[%s] not found!\n", str);
-			//else printf( "[%s] found!\n", dic[ret]);
+			// the word is indexed as its permuterm "word$"
+			int len = strlen( str);
+
+			str[len] = EOW;
+			str[len + 1] = '\0';
+			ret = trieSearch( query_trie, str);
+			str[len] = '\0';
+
+			if (ret == -1) printf( "[%s] not found!\n", str);
+			else printf( "[%s] found!\n", dic[ret]);
 		}
 		printf( "\nQuery: ");
 	}
 
-	for (int i = 0; i < num_words; i++)
+	// words of a loaded index are in the mapped file
+	for (int i = 0; i < num_words && !image_input; i++)
 		free( dic[i]);
-	
-	//trieDestroy( permute_trie);
-	
+
+	datrieDestroy( query_trie);
+
 	return 0;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/* prints all entries in trie using preorder traversal
+/* prints all entries under state in trie using preorder traversal (0: all entries)
 */
-void trieList( TRIE *root, char *dic[])
+void trieList( DATRIE *pTrie, int state, char *dic[])
 {
-	if (root == NULL) return;
+	if (state < 0) return;
 
-	trieList_main(root, dic, 0);
+	trieList_main(pTrie, state, dic, 0, NULL);
 }
 
-static int trieList_main( TRIE *root, char *dic[], int count){
-    // condition to stop
-    if(root == NULL) return count;
-
-
-    for(int i = 0; i < MAX_DEGREE; i++){
-        trieList_main(root->subtrees[i], dic, count);
-        if(root->index != -1){
-            printf("[%d] %s", count, dic[root->index]);
-            count++;
-        }
+// seen: bit of each dic index printed so far, to print every word once (NULL: no check)
+// return	count + number of entries printed
+static int trieList_main( DATRIE *pTrie, int state, char *dic[], int count, unsigned char *seen){
+    int index = pTrie->index[state];
+    if(index != -1 && (seen == NULL || !(seen[index / 8] >> (index % 8) & 1))){
+        if(seen != NULL)
+            seen[index / 8] |= 1 << (index % 8);
+        printf("[%d] %s\n", count, dic[index]);
+        count++;
     }
+    // children in the order of getIndex (EOW last)
+    int base = pTrie->cells[state].base;
+    for(unsigned int bits = pTrie->children[state]; bits != 0; bits &= bits - 1)
+        count = trieList_main(pTrie, base + 1 + __builtin_ctz(bits), dic, count, seen);
     return count;
 }
 
+// internal function
+// return	state reached from state by c
+//			-1 if none
+static int _next( DATRIE *pTrie, int state, char c){
+    if((c < 'a' || c > 'z') && c != EOW)
+        return -1;
+    int t = pTrie->cells[state].base + getCode(c);
+    if(t <= 0 || t >= pTrie->size || pTrie->cells[t].check != state)
+        return -1;
+    return t;
+}
+
+// used in triePrefixList, trieSearchWildcard
+// return	state reached by str up to its first '*'
+//			-1 if none
+static int _prefixState( DATRIE *pTrie, char *str){
+    // '*' remove. only word.
+    int state = 0;
+    for(int i = 0; str[i] != 0 && str[i] != '*' && state != -1; i++)
+        state = _next(pTrie, state, str[i]);
+    return state;
+}
+
 /* prints all entries starting with str (as prefix) in trie
 	ex) "ab" -> "abandoned", "abandoning", "abandonment", "abased", ...
 	this function uses trieList function
 */
-void triePrefixList( TRIE *root, char *str, char *dic[]){
-    // '*' remove. only word.
-    int i = 0;
-    while(str[i] != '*') {
-        root = root->subtrees[getIndex(str[i])];
-        i++;
-    }
+void triePrefixList( DATRIE *pTrie, char *str, char *dic[]){
     // print all entries using function
-    trieList(root, dic);
+    trieList(pTrie, _prefixState(pTrie, str), dic);
 }
 
-/* wildcard search
+/* wildcard search over dic[0..num_words-1]
 	ex) "ab*", "*ab", "a*b", "*ab*"
 	this function uses triePrefixList function
 */
-void trieSearchWildcard( TRIE *root, char *str, char *dic[]){
-    // add '$' to the query
-    int i = 0;
-    while(str+i != NULL){
-        i++;
+void trieSearchWildcard( DATRIE *pTrie, char *str, char *dic[], int num_words){
+    int len = strlen(str);
+    char *query = malloc(len + 2);
+    if(query == NULL) return;
+
+    for(int i = 0; i < len; i++)
+        query[i] = tolower(str[i]);
+
+    // "*ab*": every permuterm starting with "ab", one for each place "ab" is found in
+    // the word, so the words already printed are skipped
+    if(len >= 2 && str[0] == '*' && str[len - 1] == '*'){
+        memmove(query, query + 1, len - 1);
+        query[len - 1] = '\0';
+        int state = _prefixState(pTrie, query);
+        unsigned char *seen = calloc(num_words / 8 + 1, 1);
+        if(seen != NULL && state >= 0)
+            trieList_main(pTrie, state, dic, 0, seen);
+        free(seen);
+        free(query);
+        return;
     }
-    str[i] = '$';
-
-    // move * to the last
-    while(str[i] != '*'){
-        char tmp = str[0];
-        for(int k = 0; k < i; k++){
-            str[k] = str[k+1];
+    // add '$' to the query and move * to the last: "a*b" -> "b$a*"
+    else{
+        query[len] = EOW;
+        query[len + 1] = '\0';
+        int star = strrchr(query, '*') - query;
+        char *rotated = malloc(len + 2);
+        if(rotated == NULL){
+            free(query);
+            return;
         }
-        str[i] = tmp;
+        strcpy(rotated, query + star + 1);
+        strncat(rotated, query, star + 1);
+        free(query);
+        query = rotated;
     }
-    triePrefixList(root, str, dic);
+    triePrefixList(pTrie, query, dic);
+    free(query);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Prototype declarations
+// internal function
+// return	node of kind with label[0..len-1]
+//			NULL if overflow
+static TRIE *_newNode( int kind, const char *label, int len, int index){
+    TRIE *new = malloc(NODE_SIZE(kind, len));
+    if(new == NULL)
+        return NULL;
+    new->index = index;
+    new->kind = kind;
+    new->count = 0;
+    new->len = len;
+    if(kind == TRIE27)
+        for(int i = 0; i < MAX_DEGREE; i++)
+            new->subtrees[i] = NULL;
+    memcpy(LABEL(new), label, len);
+    return new;
+}
+
+// internal function
+// return	address of the child pointer for c
+//			NULL if no child for c
+static TRIE **_child( TRIE *root, char c){
+    if(root->kind == TRIE27)
+        return (root->subtrees[getIndex(c)] != NULL) ? &root->subtrees[getIndex(c)] : NULL;
+
+    char *keys = KEYS(root);
+    for(int i = 0; i < root->count; i++)
+        if(keys[i] == c) return &root->subtrees[i];
+    return NULL;
+}
+
+// internal function
+// adds child under the first character of its label; a full node grows into the next kind
+// (*pRoot changes)
+// return	0 if overflow
+static int _addChild( TRIE **pRoot, TRIE *child){
+    TRIE *root = *pRoot;
+    char c = LABEL(child)[0];
+
+    if(root->kind != TRIE27 && root->count == CAPACITY(root->kind)){
+        TRIE *grown = _newNode(root->kind + 1, LABEL(root), root->len, root->index);
+        if(grown == NULL) return 0;
+        for(int i = 0; i < root->count; i++)
+            _addChild(&grown, root->subtrees[i]); // in order, never full
+        free(root);
+        *pRoot = root = grown;
+    }
+
+    if(root->kind == TRIE27){
+        root->subtrees[getIndex(c)] = child;
+        root->count++;
+        return 1;
+    }
+
+    // sorted insertion keeps the preorder of trieList
+    char *keys = KEYS(root);
+    int i = root->count;
+    while(i > 0 && getIndex(keys[i - 1]) > getIndex(c)){
+        keys[i] = keys[i - 1];
+        root->subtrees[i] = root->subtrees[i - 1];
+        i--;
+    }
+    keys[i] = c;
+    root->subtrees[i] = child;
+    root->count++;
+    return 1;
+}
 
 /* Allocates dynamic memory for a trie node and returns its address to caller
 	return	node pointer
@@ -216,19 +461,20 @@ void trieSearchWildcard( TRIE *root, char *str, char *dic[]){
 index = -1;
 all ptr = NULL; initialize
 */
+// the root has a pointer for every character, so it never grows (trieInsert cannot move it)
 TRIE *trieCreateNode(void){
-    TRIE *new = malloc(sizeof(TRIE));
-    if(new == NULL)
-        return NULL;
-    new->index = -1;
-    for(int i = 0; i < MAX_DEGREE; i++)
-        new->subtrees[i] = NULL;
-    return new;
+    return _newNode(TRIE27, "", 0, -1);
 }
 
 /* Deletes all data in trie and recycles memory
 */
-void trieDestroy( TRIE *root);
+void trieDestroy( TRIE *root){
+    if(root == NULL) return;
+    int n = (root->kind == TRIE27) ? MAX_DEGREE : root->count;
+    for(int i = 0; i < n; i++)
+        trieDestroy(root->subtrees[i]);
+    free(root);
+}
 
 /* Inserts new entry into the trie
 	return	1 success
@@ -238,45 +484,420 @@ void trieDestroy( TRIE *root);
 // 대소문자를 소문자로 통일하여 삽입
 // 영문자와 EOW 외 문자를 포함하는 문자열은 삽입하지 않음
 int trieInsert( TRIE *root, char *str, int dic_index){
-    // insert
-    int i = 0;
-    while(str[i] != 0){
+    for(int i = 0; str[i] != 0; i++){
         // upper check
         if(isupper(str[i]) != 0)
             str[i] = tolower(str[i]);
+        if((str[i] < 'a' || str[i] > 'z') && str[i] != EOW)
+            return 0;
+    }
 
-        // overlap check
+    TRIE **pRoot = &root; // pointer to root in its parent
+    int i = 0;
+    while(str[i] != 0){
+        TRIE **pChild = _child(root, str[i]);
+
+        // the rest of str becomes the label of a new leaf
+        if(pChild == NULL){
+            TRIE *leaf = _newNode(TRIE4, str + i, strlen(str + i), dic_index);
+            if(leaf == NULL)
+                return 0;
+            if(!_addChild(pRoot, leaf)){
+                free(leaf);
+                return 0;
+            }
+            return 1;
+        }
 
-        int num = getIndex(str[i]);
-        // alloc to next char
-        if(root->subtrees[num] == NULL){
-            root->subtrees[num] = malloc(sizeof(TRIE));// check it! (when it must stop)
-            root->subtrees[num]->index = -1;
+        TRIE *child = *pChild;
+        char *label = LABEL(child);
+        int j = 1;
+        while(j < child->len && str[i + j] == label[j])
+            j++;
+
+        // str leaves the label at j: the edge splits there
+        if(j < child->len){
+            TRIE *mid = _newNode(TRIE4, label, j, -1);
+            if(mid == NULL)
+                return 0;
+            memmove(label, label + j, child->len - j);
+            child->len -= j;
+            TRIE *shrunk = realloc(child, NODE_SIZE(child->kind, child->len));
+            if(shrunk != NULL)
+                child = shrunk;
+            _addChild(&mid, child); // empty TRIE4, never full
+            *pChild = child = mid;
         }
+
         // go to next node
-        root = root->subtrees[num];
+        pRoot = pChild;
+        root = child;
+        i += j;
+    }
 
-        i++;
+    // remove overlap
+    if(root->index != -1)
+        return 0;
+    root->index = dic_index;
+    return 1;
+}
+
+/* counts nodes, bytes of nodes and characters of labels in trie
+	every character of a label is a node of the trie without path compression
+*/
+void trieMemory( TRIE *root, long *nodes, long *bytes, long *chars){
+    if(root == NULL) return;
+    (*nodes)++;
+    *bytes += NODE_SIZE(root->kind, root->len);
+    *chars += root->len;
+    int n = (root->kind == TRIE27) ? MAX_DEGREE : root->count;
+    for(int i = 0; i < n; i++)
+        trieMemory(root->subtrees[i], nodes, bytes, chars);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// internal function
+// makes slots up to at least slot
+// return	0 if overflow
+static int _reserve( DATRIE *pTrie, int slot){
+    if(slot < pTrie->size) return 1;
+    int size = pTrie->size ? pTrie->size : 1024;
+    while(size <= slot) size *= 2;
+    DA_CELL *cells = realloc(pTrie->cells, sizeof(DA_CELL) * size);
+    if(cells == NULL) return 0;
+    pTrie->cells = cells;
+    int *index = realloc(pTrie->index, sizeof(int) * size);
+    if(index == NULL) return 0;
+    pTrie->index = index;
+    unsigned int *children = realloc(pTrie->children, sizeof(unsigned int) * size);
+    if(children == NULL) return 0;
+    pTrie->children = children;
+    for(int i = pTrie->size; i < size; i++){
+        pTrie->cells[i].base = 0;
+        pTrie->cells[i].check = -1;
+        pTrie->index[i] = -1;
+        pTrie->children[i] = 0;
     }
+    pTrie->size = size;
+    return 1;
+}
 
-    if(root->index == -1){
-        root->index = dic_index;
-        return 1;
+// internal function
+// claims base + codes[i] as children of state for the first base where all of them are
+// free, first fit from the lowest free slot (a state with one child takes that slot)
+// return	base
+//			-1 if overflow
+static int _placeChildren( DATRIE *pTrie, int state, const int codes[], int n, int *firstFree){
+    while(*firstFree < pTrie->size && pTrie->cells[*firstFree].check != -1)
+        (*firstFree)++;
+
+    for(int slot = *firstFree; ; slot++){
+        if(!_reserve(pTrie, slot + MAX_DEGREE)) return -1;
+        if(pTrie->cells[slot].check != -1) continue;
+
+        int base = slot - codes[0], i;
+        for(i = 1; i < n; i++)
+            if(pTrie->cells[base + codes[i]].check != -1) break;
+        if(i < n) continue;
+
+        pTrie->cells[state].base = base;
+        for(i = 0; i < n; i++){
+            pTrie->cells[base + codes[i]].check = state;
+            pTrie->children[state] |= 1u << (codes[i] - 1);
+        }
+        pTrie->states += n;
+        return base;
     }
-    // remove overlap
+}
+
+// internal function
+// places the children of root below state, a state per character of their labels
+// return	0 if overflow
+static int _compile( DATRIE *pTrie, TRIE *root, int state, int *firstFree){
+    int codes[MAX_DEGREE], n = 0;
+    TRIE *children[MAX_DEGREE];
+
+    pTrie->index[state] = root->index;
+    int count = (root->kind == TRIE27) ? MAX_DEGREE : root->count;
+    for(int i = 0; i < count; i++){
+        if(root->subtrees[i] == NULL) continue;
+        children[n] = root->subtrees[i];
+        codes[n++] = getCode(LABEL(root->subtrees[i])[0]);
+    }
+    if(n == 0) return 1;
+
+    int base = _placeChildren(pTrie, state, codes, n, firstFree);
+    if(base == -1) return 0;
+
+    for(int i = 0; i < n; i++){
+        // the rest of the label is a chain of states with one child each
+        int t = base + codes[i];
+        char *label = LABEL(children[i]);
+        for(int j = 1; j < children[i]->len; j++){
+            int code = getCode(label[j]);
+            int b = _placeChildren(pTrie, t, &code, 1, firstFree);
+            if(b == -1) return 0;
+            t = b + code;
+        }
+        if(!_compile(pTrie, children[i], t, firstFree)) return 0;
+    }
+    return 1;
+}
+
+/* Converts trie into a double-array trie for queries; trie is left as it was
+	return	double-array trie
+			NULL if overflow
+*/
+DATRIE *trieCompile( TRIE *root){
+    DATRIE *new = malloc(sizeof(DATRIE));
+    if(new == NULL)
+        return NULL;
+    new->size = 0;
+    new->states = 1;
+    new->cells = NULL;
+    new->index = NULL;
+    new->children = NULL;
+    new->image = NULL;
+    new->imageSize = 0;
+
+    int firstFree = 1;
+    if(!_reserve(new, 0)){
+        datrieDestroy(new);
+        return NULL;
+    }
+    new->cells[0].check = -2; // the root
+    if(!_compile(new, root, 0, &firstFree)){
+        datrieDestroy(new);
+        return NULL;
+    }
+
+    // slots past the last one in use are never reached
+    int size = new->size;
+    while(size > 1 && new->cells[size - 1].check == -1)
+        size--;
+    DA_CELL *cells = realloc(new->cells, sizeof(DA_CELL) * size);
+    int *index = realloc(new->index, sizeof(int) * size);
+    unsigned int *children = realloc(new->children, sizeof(unsigned int) * size);
+    if(cells != NULL) new->cells = cells;
+    if(index != NULL) new->index = index;
+    if(children != NULL) new->children = children;
+    new->size = size;
+    return new;
+}
+
+/* recycles memory of double-array trie (unmaps a loaded index file)
+*/
+void datrieDestroy( DATRIE *pTrie){
+    if(pTrie->image != NULL)
+        munmap(pTrie->image, pTrie->imageSize);
     else{
-        return 0;
+        free(pTrie->cells);
+        free(pTrie->index);
+        free(pTrie->children);
     }
+    free(pTrie);
 }
 
 /* Retrieve trie for the requested key
 	return	index in dictionary (trie) if key found
 			-1 key not found
 */
-int trieSearch( TRIE *root, char *str);
+int trieSearch( DATRIE *pTrie, char *str){
+    int state = 0;
+    for(int i = 0; str[i] != 0; i++){
+        state = _next(pTrie, state, tolower(str[i]));
+        if(state == -1)
+            return -1;
+    }
+    return pTrie->index[state];
+}
 
+////////////////////////////////////////////////////////////////////////////////
+// index file (trieSave, trieLoad)
+
+#define INDEX_MAGIC	"PTRIDX1" // 8 bytes with the terminating NUL
+
+// file header; every offset is from the start of the file
+typedef struct {
+	char		magic[8];
+	uint32_t	size;		// slots of the double array
+	uint32_t	states;
+	uint32_t	num_words;
+	uint32_t	cellsOff;	// DA_CELL[size]
+	uint32_t	indexOff;	// int[size]
+	uint32_t	childrenOff;	// unsigned int[size]
+	uint32_t	wordOff;	// uint32_t[num_words]: offset of each word in the pool
+	uint32_t	poolOff;	// words, each terminated by NUL
+	uint32_t	poolSize;
+} INDEX_HEADER;
+
+/* Writes double-array trie and words dic[0..num_words-1] into an index file
+	return	1 success
+			0 failure
+*/
+int trieSave( DATRIE *pTrie, char *dic[], int num_words, const char *path){
+    INDEX_HEADER h;
+    uint32_t *wordOff = malloc(sizeof(uint32_t) * (num_words ? num_words : 1));
+    if(wordOff == NULL)
+        return 0;
 
+    uint64_t poolSize = 0;
+    for(int i = 0; i < num_words; i++){
+        wordOff[i] = poolSize;
+        poolSize += strlen(dic[i]) + 1;
+    }
+    uint64_t cellsOff = (sizeof(INDEX_HEADER) + 7) / 8 * 8;
+    uint64_t poolOff = cellsOff + (uint64_t)pTrie->size * (sizeof(DA_CELL) + sizeof(int) + sizeof(unsigned int))
+        + sizeof(uint32_t) * (uint64_t)num_words;
+    if(poolOff + poolSize > UINT32_MAX){
+        free(wordOff);
+        return 0;
+    }
 
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, 8);
+    h.size = pTrie->size;
+    h.states = pTrie->states;
+    h.num_words = num_words;
+    h.cellsOff = cellsOff;
+    h.indexOff = h.cellsOff + sizeof(DA_CELL) * pTrie->size;
+    h.childrenOff = h.indexOff + sizeof(int) * pTrie->size;
+    h.wordOff = h.childrenOff + sizeof(unsigned int) * pTrie->size;
+    h.poolOff = poolOff;
+    h.poolSize = poolSize;
+
+    static const char zero[8];
+    FILE *fp = fopen(path, "wb");
+    int ok = 0;
+    if(fp != NULL){
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1
+            && fwrite(zero, 1, cellsOff - sizeof(h), fp) == cellsOff - sizeof(h)
+            && fwrite(pTrie->cells, sizeof(DA_CELL), pTrie->size, fp) == (size_t)pTrie->size
+            && fwrite(pTrie->index, sizeof(int), pTrie->size, fp) == (size_t)pTrie->size
+            && fwrite(pTrie->children, sizeof(unsigned int), pTrie->size, fp) == (size_t)pTrie->size
+            && fwrite(wordOff, sizeof(uint32_t), num_words, fp) == (size_t)num_words;
+        for(int i = 0; i < num_words && ok; i++)
+            ok = fwrite(dic[i], 1, strlen(dic[i]) + 1, fp) == strlen(dic[i]) + 1;
+        if(fclose(fp) != 0) ok = 0;
+    }
+    free(wordOff);
+    return ok;
+}
+
+// used in _indexValid
+// walks the states under the root level by level (each child names its parent in check,
+// so no state is reached twice)
+// return	1 if no path passes more than MAX_DEPTH states (trieList_main recurses along it)
+static int _depthValid( const DA_CELL *cells, const unsigned int *children, uint32_t size){
+    int *queue = malloc(sizeof(int) * size);
+    if(queue == NULL) return 0;
+    uint32_t head = 0, tail = 0, levelEnd = 1;
+    int depth = 1, ok = 1;
+    queue[tail++] = 0;
+    while(ok && head < tail){
+        if(head == levelEnd){
+            levelEnd = tail;
+            if(++depth > MAX_DEPTH) ok = 0;
+        }
+        int s = queue[head++];
+        for(unsigned int bits = children[s]; ok && bits != 0; bits &= bits - 1){
+            if(tail == size) ok = 0;
+            else queue[tail++] = cells[s].base + 1 + __builtin_ctz(bits);
+        }
+    }
+    free(queue);
+    return ok;
+}
+
+// internal function
+// checks the header and every state, so queries on the mapped arrays stay inside them
+// return	1 valid
+static int _indexValid( const void *image, size_t size){
+    const INDEX_HEADER *h = image;
+    if(size < sizeof(INDEX_HEADER) || memcmp(h->magic, INDEX_MAGIC, 8) != 0)
+        return 0;
+    if(h->size == 0 || h->num_words > MAX_WORDS
+        || h->cellsOff % 4 != 0 || h->indexOff % 4 != 0 || h->childrenOff % 4 != 0 || h->wordOff % 4 != 0
+        || h->cellsOff < sizeof(INDEX_HEADER)
+        || (uint64_t)h->cellsOff + (uint64_t)h->size * sizeof(DA_CELL) > h->indexOff
+        || (uint64_t)h->indexOff + (uint64_t)h->size * sizeof(int) > h->childrenOff
+        || (uint64_t)h->childrenOff + (uint64_t)h->size * sizeof(unsigned int) > h->wordOff
+        || (uint64_t)h->wordOff + (uint64_t)h->num_words * sizeof(uint32_t) > h->poolOff
+        || (uint64_t)h->poolOff + h->poolSize > size)
+        return 0;
+
+    const char *base = image;
+    const DA_CELL *cells = (const DA_CELL *)(base + h->cellsOff);
+    const int *index = (const int *)(base + h->indexOff);
+    const unsigned int *children = (const unsigned int *)(base + h->childrenOff);
+    const uint32_t *wordOff = (const uint32_t *)(base + h->wordOff);
+    const char *pool = base + h->poolOff;
+
+    if(cells[0].check != -2)
+        return 0;
+    for(uint32_t s = 0; s < h->size; s++){
+        if(index[s] < -1 || index[s] >= (int)h->num_words || children[s] >> MAX_DEGREE != 0)
+            return 0;
+        // base + getCode(c) in _next stays in int
+        if(cells[s].base < -MAX_DEGREE || cells[s].base >= (int)h->size)
+            return 0;
+        for(unsigned int bits = children[s]; bits != 0; bits &= bits - 1){
+            int64_t t = (int64_t)cells[s].base + 1 + __builtin_ctz(bits);
+            if(t <= 0 || t >= h->size || cells[t].check != (int)s)
+                return 0;
+        }
+    }
+    if(!_depthValid(cells, children, h->size))
+        return 0;
+    if(h->num_words > 0 && (h->poolSize == 0 || pool[h->poolSize - 1] != '\0'))
+        return 0;
+    for(uint32_t i = 0; i < h->num_words; i++)
+        if(wordOff[i] >= h->poolSize)
+            return 0;
+    return 1;
+}
+
+/* Maps an index file written by trieSave read-only into memory; dic[0..*num_words-1]
+	point to the words in the file
+	return	double-array trie
+			NULL if the file cannot be mapped or is not an index
+*/
+DATRIE *trieLoad( const char *path, char *dic[], int *num_words){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0) return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(INDEX_HEADER)){
+        close(fd);
+        return NULL;
+    }
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) return NULL;
+
+    DATRIE *new = NULL;
+    if(_indexValid(image, st.st_size))
+        new = malloc(sizeof(DATRIE));
+    if(new == NULL){
+        munmap(image, st.st_size);
+        return NULL;
+    }
+
+    const INDEX_HEADER *h = image;
+    char *base = image;
+    new->size = h->size;
+    new->states = h->states;
+    new->cells = (DA_CELL *)(base + h->cellsOff);
+    new->index = (int *)(base + h->indexOff);
+    new->children = (unsigned int *)(base + h->childrenOff);
+    new->image = image;
+    new->imageSize = st.st_size;
+
+    const uint32_t *wordOff = (const uint32_t *)(base + h->wordOff);
+    for(uint32_t i = 0; i < h->num_words; i++)
+        dic[i] = base + h->poolOff + wordOff[i];
+    *num_words = h->num_words;
+    return new;
+}
 
 /* makes permuterms for given str
 	ex) "abc" -> "abc$", "bc$a", "c$ab", "$abc"
@@ -284,21 +905,21 @@ int trieSearch( TRIE *root, char *str);
 */
 int make_permuterms( char *str, char *permuterms[]){
     int length = strlen(str);
-    str[length] = '$';
-    str[length+1] = '\0';
 
+    // permuterm i is "str$" rotated left by i
     for (int i = 0; i < length + 1; i++) {
-        permuterms[i] = calloc(100, sizeof(char));
+        permuterms[i] = malloc(length + 2);
+        if(permuterms[i] == NULL)
+            return i;
 
-        char tmp = str[0];
-        strcpy(permuterms[i],str);
-        for (int j = 0; j < length; j++) {
-            str[j] = str[j + 1];
+        for (int j = 0; j < length + 1; j++) {
+            int k = (i + j) % (length + 1);
+            permuterms[i][j] = (k == length) ? EOW : str[k];
         }
-        str[length] = tmp;
+        permuterms[i][length + 1] = '\0';
     }
 
-    return length;
+    return length + 1;
 }
 
 /* recycles memory for permuterms
@@ -308,6 +929,3 @@ void clear_permuterms( char *permuterms[], int size){
         free(permuterms[i]);
     }
 }
-
-
-